@@ -0,0 +1,86 @@
+//Compares hop latency of TCP bridge with and without busy polling
+//
+//Runs request-response of small messages over BridgeTCPServer and
+//BridgeTCPClient connected through localhost and prints median round
+//trip time and how often the IO threads had to sleep. Busy polling only
+//pays off when IO threads have dedicated cores (on a single core it is slower)
+//
+//Optional arguments: count of round trips, busy poll budget in microseconds,
+//list of cores for IO threads
+
+#include <zerobus/client.h>
+#include <zerobus/bridge_tcp_client.h>
+#include <zerobus/bridge_tcp_server.h>
+#include <zerobus/channel_notify.h>
+#include <zerobus/network_linux.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+using namespace zerobus;
+
+static void run(const char *name, NetContextConfig cfg, int count) {
+    auto ctx = make_network_context(cfg);
+    auto nctx = std::dynamic_pointer_cast<NetContext>(ctx);
+
+    auto master = Bus::create();
+    auto slave = Bus::create();
+
+    BridgeTCPServer server(master, ctx, "localhost:12133");
+    BridgeTCPClient client(slave, ctx, "localhost:12133");
+
+    auto echo = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    std::atomic<int> received = {0};
+    auto requester = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){
+        received.fetch_add(1);
+        received.notify_all();
+    });
+
+    echo.subscribe("echo");
+    if (!channel_wait_for(slave, "echo", std::chrono::seconds(5))) {
+        std::cerr << "Channel not available" << std::endl;
+        std::exit(1);
+    }
+
+    std::vector<double> samples;
+    samples.reserve(count);
+    auto before = nctx->get_stats();
+    for (int i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        requester.send_message("echo", "hello world", 0);
+        received.wait(i);
+        auto stop = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+    }
+    auto after = nctx->get_stats();
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    double n = count;
+    auto spin = after.spin - before.spin;
+    auto hits = after.spin_hit - before.spin_hit;
+    auto sleeps = after.sleep - before.sleep;
+    //each round trip is two hops
+    std::cout << name << std::fixed << std::setprecision(2)
+              << " | median hop: " << samples[samples.size() / 2] / 2 << " us"
+              << " | empty polls: " << static_cast<double>(spin) / n
+              << " | spin events: " << static_cast<double>(hits) / n
+              << " | sleeps: " << static_cast<double>(sleeps) / n
+              << " (per round trip)"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1?std::atoi(argv[1]):20000;
+    auto budget = std::chrono::microseconds(argc > 2?std::atoi(argv[2]):50);
+    std::vector<int> cores;
+    for (int i = 3; i < argc; ++i) cores.push_back(std::atoi(argv[i]));
+    std::cout << "Hop latency of small messages (" << count << " round trips)" << std::endl;
+    run("sleeping   ", NetContextConfig{.cpu_affinity = cores}, count);
+    run("busy poll  ", NetContextConfig{.busy_poll = budget, .cpu_affinity = cores}, count);
+}
@@ -0,0 +1,98 @@
+//Measures heap memory held by idle peers of BridgeTCPServer
+//
+//Opens many raw websocket connections to the server, completes the
+//handshake and then leaves them idle. Prints heap bytes per peer after
+//the handshake and after the idle check (send_ping), which releases
+//output buffers of idle peers.
+//
+//Optional argument: count of connections (limited by RLIMIT_NOFILE)
+
+#include <zerobus/bridge_tcp_server.h>
+
+#include <arpa/inet.h>
+#include <malloc.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace zerobus;
+
+static std::size_t heap_used() {
+    return mallinfo2().uordblks;
+}
+
+static int open_peer(int port) {
+    int s = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        ::close(s);
+        return -1;
+    }
+    std::string_view req = "GET / HTTP/1.1\r\n"
+                           "Host: localhost\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "\r\n";
+    if (::send(s, req.data(), req.size(), 0) != static_cast<ssize_t>(req.size())) {
+        ::close(s);
+        return -1;
+    }
+    //wait for the response header, frames which follow are not read
+    std::string resp;
+    char buff[1024];
+    while (resp.find("\r\n\r\n") == resp.npos) {
+        auto r = ::recv(s, buff, sizeof(buff), 0);
+        if (r <= 0) {
+            ::close(s);
+            return -1;
+        }
+        resp.append(buff, r);
+    }
+    return s;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1?std::atoi(argv[1]):500;
+    constexpr int port = 12134;
+    auto ctx = make_network_context(1);
+    auto master = Bus::create();
+    BridgeTCPServer server(master, ctx, "localhost:" + std::to_string(port));
+
+    auto base = heap_used();
+    std::vector<int> sockets;
+    for (int i = 0; i < count; ++i) {
+        int s = open_peer(port);
+        if (s < 0) {
+            std::cerr << "Connection failed after " << i << " peers" << std::endl;
+            break;
+        }
+        sockets.push_back(s);
+    }
+    if (sockets.empty()) return 1;
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    double n = static_cast<double>(sockets.size());
+    auto connected = heap_used();
+    //first call marks peers, second call finds them idle
+    server.send_ping();
+    server.send_ping();
+    std::this_thread::sleep_for(std::chrono::milliseconds(200));
+    auto idle = heap_used();
+
+    std::cout << "Idle peers: " << sockets.size() << std::endl
+              << "after handshake: " << static_cast<double>(connected - base) / n << " bytes per peer" << std::endl
+              << "after idle check: " << static_cast<double>(idle - base) / n << " bytes per peer" << std::endl;
+    for (int s: sockets) ::close(s);
+}
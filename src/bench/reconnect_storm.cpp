@@ -0,0 +1,143 @@
+//Measures how fast BridgeTCPServer resumes many sessions at once
+//
+//Opens many raw websocket connections with a session id, drops all of
+//them and then reconnects all sessions again. Every reconnect is handed
+//over to the peer which holds the session. Prints connections per second
+//of the first connect and of the reconnect storm.
+//
+//Optional argument: count of sessions (limited by RLIMIT_NOFILE, each
+//session needs three descriptors during the reconnect)
+
+#include <zerobus/bridge_tcp_server.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace zerobus;
+
+//requests are sent in batches to not overflow listen backlog
+static constexpr std::size_t batch_size = 256;
+
+static int send_request(int port, const std::string &session) {
+    int s = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) return -1;
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (::connect(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0) {
+        ::close(s);
+        return -1;
+    }
+    std::string req = "GET /" + session + " HTTP/1.1\r\n"
+                      "Host: localhost\r\n"
+                      "Upgrade: websocket\r\n"
+                      "Connection: Upgrade\r\n"
+                      "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                      "Sec-WebSocket-Version: 13\r\n"
+                      "\r\n";
+    if (::send(s, req.data(), req.size(), 0) != static_cast<ssize_t>(req.size())) {
+        ::close(s);
+        return -1;
+    }
+    return s;
+}
+
+static bool wait_response(int s) {
+    //wait for the response header, frames which follow are not read
+    std::string resp;
+    char buff[1024];
+    while (resp.find("\r\n\r\n") == resp.npos) {
+        auto r = ::recv(s, buff, sizeof(buff), 0);
+        if (r <= 0) return false;
+        resp.append(buff, r);
+    }
+    return true;
+}
+
+static std::vector<int> connect_all(int port, const std::vector<std::string> &sessions) {
+    std::vector<int> sockets;
+    sockets.reserve(sessions.size());
+    for (std::size_t i = 0; i < sessions.size(); i += batch_size) {
+        auto end = std::min(i + batch_size, sessions.size());
+        auto first = sockets.size();
+        for (std::size_t j = i; j < end; ++j) {
+            int s = send_request(port, sessions[j]);
+            if (s < 0) break;
+            sockets.push_back(s);
+        }
+        for (std::size_t j = first; j < sockets.size(); ++j) {
+            if (!wait_response(sockets[j])) {
+                std::cerr << "Handshake failed" << std::endl;
+                std::exit(1);
+            }
+        }
+        if (sockets.size() < end) break;
+    }
+    return sockets;
+}
+
+static double rate(std::size_t count, std::chrono::steady_clock::duration dur) {
+    return static_cast<double>(count) / std::chrono::duration<double>(dur).count();
+}
+
+int main(int argc, char **argv) {
+    std::size_t count = argc > 1?std::strtoul(argv[1], nullptr, 10):50000;
+    rlimit lim;
+    if (::getrlimit(RLIMIT_NOFILE, &lim) == 0) {
+        lim.rlim_cur = lim.rlim_max;
+        ::setrlimit(RLIMIT_NOFILE, &lim);
+        //client end, server end and old server end (closed by handover), some
+        //descriptors are reserved
+        if (lim.rlim_cur < count * 3 + 64) {
+            count = lim.rlim_cur > 64?(lim.rlim_cur - 64) / 3:0;
+            std::cerr << "Limited by RLIMIT_NOFILE to " << count << " sessions" << std::endl;
+        }
+    }
+    constexpr int port = 12135;
+    auto ctx = make_network_context(1);
+    auto master = Bus::create();
+    BridgeTCPServer server(master, ctx, "localhost:" + std::to_string(port));
+    server.set_session_timeout(600);
+
+    std::vector<std::string> sessions;
+    sessions.reserve(count);
+    for (std::size_t i = 0; i < count; ++i) {
+        char buff[40];
+        std::snprintf(buff, sizeof(buff), "%032zx", i * 2654435761u);
+        sessions.push_back(buff);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    auto sockets = connect_all(port, sessions);
+    auto connected = std::chrono::steady_clock::now();
+    if (sockets.size() < count) {
+        std::cerr << "Connection failed after " << sockets.size() << " sessions" << std::endl;
+        sessions.resize(sockets.size());
+    }
+    if (sockets.empty()) return 1;
+
+    //drop all connections, peers wait for resume of their sessions
+    for (int s: sockets) ::close(s);
+    std::this_thread::sleep_for(std::chrono::milliseconds(500));
+
+    auto storm = std::chrono::steady_clock::now();
+    auto resumed = connect_all(port, sessions);
+    auto done = std::chrono::steady_clock::now();
+
+    std::cout << "Sessions: " << sessions.size() << std::endl
+              << "connect: " << rate(sockets.size(), connected - start) << " connections/s" << std::endl
+              << "reconnect storm: " << rate(resumed.size(), done - storm) << " connections/s" << std::endl;
+    for (int s: resumed) ::close(s);
+}
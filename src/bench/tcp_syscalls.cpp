@@ -0,0 +1,78 @@
+//Measures count of system calls per message on TCP bridge
+//
+//Runs request-response over BridgeTCPServer and BridgeTCPClient for both
+//one-shot and edge triggered socket registration and prints counters
+//collected by the network context divided by count of messages
+
+#include <zerobus/client.h>
+#include <zerobus/bridge_tcp_client.h>
+#include <zerobus/bridge_tcp_server.h>
+#include <zerobus/channel_notify.h>
+#include <zerobus/network_linux.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+
+using namespace zerobus;
+
+static void run(bool edge_triggered, int count) {
+    auto ctx = make_network_context(NetContextConfig{.edge_triggered = edge_triggered});
+    auto nctx = std::dynamic_pointer_cast<NetContext>(ctx);
+
+    auto master = Bus::create();
+    auto slave = Bus::create();
+
+    BridgeTCPServer server(master, ctx, "localhost:12131");
+    BridgeTCPClient client(slave, ctx, "localhost:12131");
+
+    auto echo = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    std::atomic<int> received = {0};
+    auto requester = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){
+        received.fetch_add(1);
+        received.notify_all();
+    });
+
+    echo.subscribe("echo");
+    if (!channel_wait_for(slave, "echo", std::chrono::seconds(5))) {
+        std::cerr << "Channel not available" << std::endl;
+        std::exit(1);
+    }
+
+    auto before = nctx->get_stats();
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < count; ++i) {
+        requester.send_message("echo", "hello world", 0);
+        received.wait(i);
+    }
+    auto stop = std::chrono::steady_clock::now();
+    auto after = nctx->get_stats();
+
+    double n = count;
+    auto per_msg = [&](std::uint64_t a, std::uint64_t b) {
+        return static_cast<double>(a - b) / n;
+    };
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(stop - start).count();
+    std::cout << (edge_triggered?"edge triggered":"one-shot      ")
+              << std::fixed << std::setprecision(2)
+              << " | epoll_wait: " << per_msg(after.epoll_wait, before.epoll_wait)
+              << " | epoll_ctl: " << per_msg(after.epoll_ctl, before.epoll_ctl)
+              << " | recv: " << per_msg(after.recv, before.recv)
+              << " | send: " << per_msg(after.send, before.send)
+              << " | wakeup: " << per_msg(after.wakeup, before.wakeup)
+              << " | total: " << per_msg(after.epoll_wait + after.epoll_ctl + after.recv + after.send + after.wakeup,
+                                         before.epoll_wait + before.epoll_ctl + before.recv + before.send + before.wakeup)
+              << " | round trip: " << static_cast<double>(us)/n << " us"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1?std::atoi(argv[1]):20000;
+    std::cout << "System calls per request-response (" << count << " round trips)" << std::endl;
+    run(false, count);
+    run(true, count);
+}
@@ -0,0 +1,73 @@
+//Compares round trip latency of TCP bridge over loopback TCP and unix socket
+//
+//Runs request-response over BridgeTCPServer and BridgeTCPClient connected
+//through localhost TCP and through unix socket and prints average and
+//median round trip time
+
+#include <zerobus/client.h>
+#include <zerobus/bridge_tcp_client.h>
+#include <zerobus/bridge_tcp_server.h>
+#include <zerobus/channel_notify.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+
+using namespace zerobus;
+
+static void run(const char *name, std::string address, int count, std::size_t msg_size) {
+    auto ctx = make_network_context();
+
+    auto master = Bus::create();
+    auto slave = Bus::create();
+
+    BridgeTCPServer server(master, ctx, address);
+    BridgeTCPClient client(slave, ctx, address);
+
+    auto echo = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    std::atomic<int> received = {0};
+    auto requester = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){
+        received.fetch_add(1);
+        received.notify_all();
+    });
+
+    echo.subscribe("echo");
+    if (!channel_wait_for(slave, "echo", std::chrono::seconds(5))) {
+        std::cerr << "Channel not available" << std::endl;
+        std::exit(1);
+    }
+
+    std::string payload(msg_size, 'x');
+    std::vector<double> samples;
+    samples.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        auto start = std::chrono::steady_clock::now();
+        requester.send_message("echo", payload, 0);
+        received.wait(i);
+        auto stop = std::chrono::steady_clock::now();
+        samples.push_back(std::chrono::duration<double, std::micro>(stop - start).count());
+    }
+    double sum = 0;
+    for (auto s: samples) sum += s;
+    std::nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    std::cout << name << " | " << std::setw(6) << msg_size << " bytes"
+              << std::fixed << std::setprecision(2)
+              << " | average: " << sum / count << " us"
+              << " | median: " << samples[samples.size() / 2] << " us"
+              << std::endl;
+}
+
+int main(int argc, char **argv) {
+    int count = argc > 1?std::atoi(argv[1]):20000;
+    std::cout << "Round trip latency (" << count << " round trips)" << std::endl;
+    for (std::size_t sz: {16, 1024, 65536}) {
+        run("tcp loopback", "localhost:12132", count, sz);
+        run("unix socket ", "unix:@zerobus_bench", count, sz);
+    }
+}
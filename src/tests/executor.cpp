@@ -0,0 +1,76 @@
+#include "check.h"
+
+#include <zerobus/network.h>
+#include <zerobus/http_utils.h>
+#include <atomic>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace zerobus;
+
+void post_from_threads() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(2);
+    static constexpr int threads = 4;
+    static constexpr int count = 10000;
+    static std::atomic<int> executed = 0;
+    static std::promise<void> done;
+    executed = 0;
+    {
+        std::vector<std::jthread> thr;
+        for (int i = 0; i < threads; ++i) {
+            thr.emplace_back([&]{
+                for (int j = 0; j < count; ++j) {
+                    ctx->post([]{
+                        if (++executed == threads * count) done.set_value();
+                    });
+                }
+            });
+        }
+    }
+    //there are no other events, tasks must wake the context themselves
+    CHECK(done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK_EQUAL(executed.load(), threads * count);
+}
+
+void defer_and_dispatch_order() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    static std::string order;
+    static std::promise<void> done;
+    static INetContext *c = nullptr;
+    c = ctx.get();
+    CHECK(!ctx->on_loop());
+    ctx->post([]{
+        CHECK(c->on_loop());
+        c->defer([]{
+            order.push_back('D');
+            done.set_value();
+        });
+        c->dispatch([]{order.push_back('I');});
+        order.push_back('E');
+    });
+    done.get_future().wait();
+    CHECK_EQUAL(order, "IED");
+}
+
+coroutine coro_resume_on(INetContext &ctx, std::promise<bool> &res) {
+    co_await resume_on(ctx);
+    res.set_value(ctx.on_loop());
+}
+
+void coroutine_resume_on() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    std::promise<bool> res;
+    coro_resume_on(*ctx, res);
+    CHECK(res.get_future().get());
+}
+
+int main() {
+    post_from_threads();
+    defer_and_dispatch_order();
+    coroutine_resume_on();
+}
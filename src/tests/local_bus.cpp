@@ -3,8 +3,14 @@
 #include <zerobus/monitor.h>
 #include <zerobus/bridge.h>
 #include <zerobus/client.h>
+#include <zerobus/local_bus.h>
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <thread>
+#include <vector>
 using namespace zerobus;
 
 void testLocalBus() {
@@ -158,12 +164,94 @@ void testDialog() {
 
 }
 
+void testActiveChannelsDefault() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto broker = Bus::create();
+    auto noop = [](auto &, const Message &, bool){};
+    ClientCallback<decltype(noop)> a(broker, decltype(noop)(noop));
+    ClientCallback<decltype(noop)> b(broker, decltype(noop)(noop));
+    a.subscribe("a_only");
+    a.subscribe("both");
+    b.subscribe("both");
+    b.subscribe("b_only");
+    auto api = IBridgeAPI::from_bus(broker.get_handle());
+    const IListener *lsns[] = {&a, &b};
+    IBus::ChannelListStorage st1, st2;
+    std::vector<std::pair<const IListener *, std::size_t> > ex1, ex2;
+    auto l1 = api->get_active_channels(st1, lsns, ex1);
+    //implementation of the interface, built on per-listener lists
+    auto l2 = api->IBridgeAPI::get_active_channels(st2, lsns, ex2);
+    CHECK(std::equal(l1.begin(), l1.end(), l2.begin(), l2.end()));
+    CHECK_EQUAL(l2.size(), 3);
+    CHECK(ex1 == ex2);
+    CHECK_EQUAL(ex2.size(), 2);
+}
+
+void testParallelFanout() {
+    std::cout << __FUNCTION__ << std::endl;
+    constexpr int listeners = 40;
+    constexpr int messages = 500;
+    auto broker = LocalBus::create({8, 4});
+    std::vector<std::vector<int> > received(listeners);
+    std::vector<std::atomic<bool> > busy(listeners);
+    std::atomic<bool> concurrent = {false};
+    std::atomic<int> total = {0};
+    auto main_thread = std::this_thread::get_id();
+    std::atomic<bool> on_main = {false};
+    auto make_cb = [&](int idx) {
+        return [&, idx](auto &, const Message &msg, bool) {
+            if (std::this_thread::get_id() == main_thread) on_main = true;
+            int n = std::stoi(std::string(msg.get_content()));
+            //backlog in the first pool, when it is replaced
+            if (n < messages / 2) std::this_thread::sleep_for(std::chrono::microseconds(20));
+            //listener is never called from two threads at once
+            if (busy[idx].exchange(true)) concurrent = true;
+            else {
+                received[idx].push_back(n);
+                busy[idx] = false;
+            }
+            ++total;
+        };
+    };
+    std::deque<ClientCallback<decltype(make_cb(0))> > clients;
+    for (int i = 0; i < listeners; ++i) {
+        clients.emplace_back(broker, make_cb(i));
+        clients.back().subscribe("fanout");
+    }
+    auto bus = std::dynamic_pointer_cast<LocalBus>(broker.get_handle());
+    for (int i = 0; i < messages; ++i) {
+        //replaced pool must not break order of messages
+        if (i == messages / 2) bus->set_fanout({8, 3});
+        broker.send_message(nullptr, "fanout", std::to_string(i));
+    }
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (total < listeners * messages && std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK_EQUAL(total.load(), listeners * messages);
+    CHECK(!on_main);
+    CHECK(!concurrent);
+    //each listener receives messages in order
+    for (const auto &r: received) {
+        bool ordered = static_cast<int>(r.size()) == messages;
+        for (int i = 0; ordered && i < messages; ++i) ordered = r[i] == i;
+        CHECK(ordered);
+    }
+    //disabled fan-out delivers on the sending thread
+    bus->set_fanout({});
+    broker.send_message(nullptr, "fanout", std::to_string(messages));
+    CHECK_EQUAL(total.load(), listeners * (messages + 1));
+    CHECK(on_main);
+}
+
 int main() {
     testLocalBus();
     testReqRep();
     testReqRep2();
     testChannelForward();
     testDialog();
+    testActiveChannelsDefault();
+    testParallelFanout();
 
 
 }
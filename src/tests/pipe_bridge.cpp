@@ -50,6 +50,40 @@ void direct_bridge_simple() {
 
 }
 
+void large_message() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+
+    auto ctx = make_network_context();
+    auto p1 = ctx->create_pipe();
+    auto p2 = ctx->create_pipe();
+
+    BridgePipe b1(master, ctx, p1.read, p2.write);
+    BridgePipe b2(slave, ctx, p2.read, p1.write);
+
+    std::promise<std::string> result;
+
+    auto sn = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    auto cn= ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        result.set_value(std::string(msg.get_content()));
+    });
+
+    sn.subscribe("echo");
+
+    bool w = channel_wait_for(slave, "echo", std::chrono::seconds(2));
+    CHECK(w);
+
+    //message is much larger than initial receive buffer
+    std::string msg;
+    for (int i = 0; i < 1024*1024; ++i) msg.push_back(static_cast<char>('a' + i % 26));
+    cn.send_message("echo", msg);
+    auto r = result.get_future().get();
+    CHECK(r == msg);
+}
+
 int main() {
 #ifdef _WIN32
     _CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
@@ -67,4 +101,5 @@ int main() {
         if (!cond.wait_for(lk, std::chrono::minutes(1), [&]{return flag;})) abort();
     });
     direct_bridge_simple();
+    large_message();
 }
@@ -0,0 +1,102 @@
+#include "check.h"
+
+#include <zerobus/client.h>
+#include <zerobus/bridge_shared_memory.h>
+#include <zerobus/channel_notify.h>
+#include <future>
+#include <thread>
+#include <unistd.h>
+
+using namespace zerobus;
+
+static std::string reverse_test(Bus master, Bus slave, std::string_view text) {
+    std::promise<std::string> result;
+
+    auto sn = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        std::string s ( msg.get_content());
+        std::reverse(s.begin(), s.end());
+        c.send_message(msg.get_sender(), s, msg.get_conversation());
+    });
+    auto cn= ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        result.set_value(std::string(msg.get_content()));
+    });
+
+    sn.subscribe("reverse");
+
+    bool w = channel_wait_for(slave, "reverse", std::chrono::seconds(2));
+    CHECK(w);
+
+    cn.send_message("reverse", text);
+    return result.get_future().get();
+}
+
+void direct_bridge_simple() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context();
+
+    auto [e1, e2] = BridgeSharedMemory::create_endpoints();
+    BridgeSharedMemory b1(master, ctx, e1);
+    BridgeSharedMemory b2(slave, ctx, e2);
+
+    auto r = reverse_test(master, slave, "ahoj svete");
+    CHECK_EQUAL(r, "etevs joha");
+}
+
+void large_message() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context();
+
+    //message is larger than ring, so it is fragmented and the producer must wait for space
+    auto [e1, e2] = BridgeSharedMemory::create_endpoints(4096);
+    BridgeSharedMemory b1(master, ctx, e1);
+    BridgeSharedMemory b2(slave, ctx, e2, 100);
+
+    std::string msg;
+    for (int i = 0; i < 100000; ++i) msg.push_back(static_cast<char>('a' + i % 26));
+    std::string expected(msg.rbegin(), msg.rend());
+    auto r = reverse_test(master, slave, msg);
+    CHECK(r == expected);
+}
+
+void unix_socket_handshake() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context();
+
+    int lsn = BridgeSharedMemory::listen("@zerobus_shm_test");
+    std::promise<void> finished;
+    std::thread thr([&]{
+        auto server = BridgeSharedMemory::accept(master, ctx, lsn);
+        finished.get_future().wait();
+    });
+    auto client = BridgeSharedMemory::connect(slave, ctx, "@zerobus_shm_test");
+    ::close(lsn);
+
+    auto r = reverse_test(master, slave, "ahoj svete");
+    CHECK_EQUAL(r, "etevs joha");
+    finished.set_value();
+    thr.join();
+}
+
+int main() {
+    std::jthread timer([](std::stop_token tkn) {
+        std::mutex mx;
+        std::condition_variable cond;
+        bool flag = false;
+        std::stop_callback cb(tkn, [&]{
+            std::lock_guard _(mx);
+            flag = true;
+            cond.notify_all();
+        });
+        std::unique_lock lk(mx);
+        if (!cond.wait_for(lk, std::chrono::minutes(1), [&]{return flag;})) abort();
+    });
+    direct_bridge_simple();
+    large_message();
+    unix_socket_handshake();
+}
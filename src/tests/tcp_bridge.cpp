@@ -10,7 +10,15 @@
 #include <zerobus/bridge_tcp_server.h>
 #include <zerobus/channel_notify.h>
 #include <future>
+#include <set>
 #include <thread>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
 
 using namespace zerobus;
 
@@ -190,6 +198,687 @@ void test_reconnect() {
 
 }
 
+class ResyncClientTest: public BridgeTCPClient {
+public:
+    using BridgeTCPClient::BridgeTCPClient;
+    std::atomic<std::size_t> sent_channels = 0;
+    void drop_connection() {lost_connection();}
+protected:
+    virtual void send(const ChannelUpdate &msg) noexcept override {
+        sent_channels += msg.lst.size();
+        BridgeTCPClient::send(msg);
+    }
+};
+
+void resume_session() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    server.set_session_timeout(10);
+    ResyncClientTest client(slave, ctx, "localhost:12121");
+
+    constexpr int count = 200;
+    auto sub = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){});
+    auto srv = ClientCallback(master, [&](AbstractClient &, const Message &, bool){});
+    for (int i = 0; i < count; ++i) sub.subscribe("ch" + std::to_string(i));
+    srv.subscribe("srv");
+    CHECK(channel_wait_for(master, "ch" + std::to_string(count - 1), std::chrono::seconds(2)));
+    CHECK(channel_wait_for(slave, "srv", std::chrono::seconds(2)));
+
+    //change the list while the connection is broken
+    client.sent_channels = 0;
+    client.drop_connection();
+    sub.subscribe("extra");
+    sub.unsubscribe("ch0");
+    CHECK(channel_wait_for(master, "extra", std::chrono::seconds(2)));
+    for (int i = 0; i < 200 && master.is_channel("ch0"); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK(!master.is_channel("ch0"));
+    CHECK(master.is_channel("ch" + std::to_string(count - 1)));
+    CHECK(slave.is_channel("srv"));
+    //only the changes are sent again, not the whole list
+    CHECK_LESS(client.sent_channels, static_cast<std::size_t>(count));
+}
+
+static std::string subscribed_list(Bus &bus, const IListener *lsn) {
+    IBus::ChannelListStorage storage;
+    std::string r;
+    for (auto x: bus.get_subscribed_channels(lsn, storage)) {
+        r.append(x).push_back(',');
+    }
+    return r;
+}
+
+static bool wait_subscribed(Bus &bus, const IListener *lsn, std::string_view expected) {
+    for (int i = 0; i < 200; ++i) {
+        if (subscribed_list(bus, lsn) == expected) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+void shared_channel_list() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave1 = Bus::create();
+    auto slave2 = Bus::create();
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    BridgeTCPClient client1(slave1, ctx, "localhost:12121");
+    BridgeTCPClient client2(slave2, ctx, "localhost:12121");
+
+    auto sub1 = ClientCallback(slave1, [&](AbstractClient &, const Message &, bool){});
+    auto sub2 = ClientCallback(slave2, [&](AbstractClient &, const Message &, bool){});
+    auto srv = ClientCallback(master, [&](AbstractClient &, const Message &, bool){});
+    //the client bridge subscribes channels which were sent by the server
+    sub1.subscribe("a");
+    sub2.subscribe("b");
+    srv.subscribe("common");
+    CHECK_PRINT(wait_subscribed(slave1, &client1, "b,common,"), subscribed_list(slave1, &client1));
+    CHECK_PRINT(wait_subscribed(slave2, &client2, "a,common,"), subscribed_list(slave2, &client2));
+    //channel is no longer exclusive for the first peer
+    srv.subscribe("a");
+    CHECK_PRINT(wait_subscribed(slave1, &client1, "a,b,common,"), subscribed_list(slave1, &client1));
+    CHECK_PRINT(wait_subscribed(slave2, &client2, "a,common,"), subscribed_list(slave2, &client2));
+    //and back
+    srv.unsubscribe("a");
+    CHECK_PRINT(wait_subscribed(slave1, &client1, "b,common,"), subscribed_list(slave1, &client1));
+    sub2.unsubscribe("b");
+    srv.subscribe("c");
+    CHECK_PRINT(wait_subscribed(slave1, &client1, "c,common,"), subscribed_list(slave1, &client1));
+    CHECK_PRINT(wait_subscribed(slave2, &client2, "a,c,common,"), subscribed_list(slave2, &client2));
+}
+
+void broadcast_shared_frame() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    constexpr int count = 3;
+    std::vector<Bus> slaves;
+    std::vector<std::unique_ptr<BridgeTCPClient> > clients;
+    std::mutex mx;
+    std::multiset<std::string> received;
+    auto on_msg = [&](AbstractClient &, const Message &msg, bool){
+        std::lock_guard _(mx);
+        received.insert(std::string(msg.get_channel()) + ":" + std::string(msg.get_content()));
+    };
+    std::vector<std::unique_ptr<ClientCallback<decltype(on_msg)> > > subs;
+    for (int i = 0; i < count; ++i) {
+        auto &slave = slaves.emplace_back(Bus::create());
+        clients.push_back(std::make_unique<BridgeTCPClient>(slave, ctx, "localhost:12121"));
+        subs.push_back(std::make_unique<ClientCallback<decltype(on_msg)> >(slave, decltype(on_msg)(on_msg)));
+        subs.back()->subscribe("news");
+    }
+    //a listener which sends other message while the broadcast is running
+    auto relay = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message("relay", std::string(msg.get_content()).substr(0, 5));
+    });
+    relay.subscribe("news");
+    subs.front()->subscribe("relay");
+    CHECK(channel_wait_for(master, "relay", std::chrono::seconds(2)));
+    //wait until all peers subscribed
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+
+    auto sender = ClientCallback(master, [&](AbstractClient &, const Message &, bool){});
+    std::string large(BridgeTCPCommon::owned_message_min_size * 2, 'x');
+    sender.send_message("news", "hello world");
+    sender.send_message("news", large);
+    std::multiset<std::string> expected;
+    for (int i = 0; i < count; ++i) {
+        expected.insert("news:hello world");
+        expected.insert("news:" + large);
+    }
+    expected.insert("relay:hello");
+    expected.insert("relay:xxxxx");
+    for (int i = 0; i < 200; ++i) {
+        {
+            std::lock_guard _(mx);
+            if (received.size() >= expected.size()) break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    std::lock_guard _(mx);
+    CHECK(received == expected);
+}
+
+void zerocopy_large_message() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    NetContextConfig cfg;
+    cfg.zerocopy_threshold = 16384;
+    auto ctx = make_network_context(cfg);
+
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    BridgeTCPClient client(slave, ctx, "localhost:12121");
+
+    std::promise<std::string> result;
+
+    auto sn = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    auto cn= ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        result.set_value(std::string(msg.get_content()));
+    });
+
+    sn.subscribe("echo");
+    bool w = channel_wait_for(slave, "echo", std::chrono::seconds(2));
+    CHECK(w);
+
+    std::string msg;
+    for (int i = 0; i < 200000; ++i) msg.push_back(static_cast<char>('a' + i % 26));
+    cn.send_message("echo", msg);
+    auto r = result.get_future().get();
+    CHECK(r == msg);
+}
+
+void socket_options() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    SocketOptions opts;
+    opts.cork = true;
+    opts.keepalive = true;
+    opts.keepalive_idle = 10;
+    opts.keepalive_interval = 5;
+    opts.keepalive_count = 3;
+    opts.send_buffer = 16384;
+    opts.recv_buffer = 16384;
+
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121", opts);
+    BridgeTCPClient client(slave, ctx, "localhost:12121", opts);
+
+    constexpr int count = 100;
+    std::promise<void> result;
+    int received = 0;
+
+    auto sn = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        //replies are sent from receive callback of the connection, so they are corked
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    auto cn= ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        CHECK_EQUAL(msg.get_content(), std::to_string(received));
+        if (++received == count) result.set_value();
+    });
+
+    sn.subscribe("echo");
+    bool w = channel_wait_for(slave, "echo", std::chrono::seconds(2));
+    CHECK(w);
+
+    for (int i = 0; i < count; ++i) cn.send_message("echo", std::to_string(i));
+    CHECK(result.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+}
+
+void output_backlog() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    //small buffers, so the bridge must keep a backlog of frames
+    SocketOptions opts;
+    opts.send_buffer = 16384;
+    opts.recv_buffer = 16384;
+
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121", opts);
+    BridgeTCPClient client(slave, ctx, "localhost:12121", opts);
+
+    constexpr int count = 300;
+    constexpr std::size_t sizes[] = {100, 5000, 20000};
+    auto make_msg = [&](int i) {
+        std::string s = std::to_string(i);
+        s.resize(sizes[i % 3], static_cast<char>('a' + i % 26));
+        return s;
+    };
+    std::promise<void> result;
+    int received = 0;
+    bool order_ok = true;
+
+    auto cn = ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        if (msg.get_content() != make_msg(received)) order_ok = false;
+        if (++received == count) result.set_value();
+    });
+    auto sn = ClientCallback(master, [&](AbstractClient &, const Message &, bool){});
+
+    cn.subscribe("backlog");
+    bool w = channel_wait_for(master, "backlog", std::chrono::seconds(2));
+    CHECK(w);
+
+    for (int i = 0; i < count; ++i) sn.send_message("backlog", make_msg(i));
+    CHECK(result.get_future().wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    CHECK(order_ok);
+}
+
+void coalescing(CoalescingPolicy policy) {
+    std::cout << __FUNCTION__ << " " << policy.max_delay.count() << "us" << (policy.end_of_burst?" burst":"")
+              << (policy.adaptive?" adaptive":"") << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    BridgeTCPClient client(slave, ctx, "localhost:12121");
+    server.set_coalescing(policy);
+    client.set_coalescing(policy);
+
+    constexpr int count = 1000;
+    std::promise<void> result;
+    int received = 0;
+    bool order_ok = true;
+
+    auto sn = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        c.send_message(msg.get_sender(), msg.get_content(), msg.get_conversation());
+    });
+    auto cn = ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        if (msg.get_content() != std::to_string(received)) order_ok = false;
+        if (++received == count) result.set_value();
+    });
+
+    sn.subscribe("echo");
+    bool w = channel_wait_for(slave, "echo", std::chrono::seconds(2));
+    CHECK(w);
+
+    //burst of small messages, the last ones must not wait for more data
+    for (int i = 0; i < count; ++i) cn.send_message("echo", std::to_string(i));
+    CHECK(result.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(order_ok);
+}
+
+void send_credit() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    SocketOptions opts;
+    opts.send_buffer = 16384;
+    opts.recv_buffer = 16384;
+
+    constexpr std::size_t hwm = 65536;
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121", opts);
+    BridgeTCPClient client(slave, ctx, "localhost:12121", opts);
+    client.set_hwm(hwm, 1000);
+
+    std::atomic<int> received = 0;
+    auto sn = ClientCallback(master, [&](AbstractClient &, const Message &, bool){++received;});
+    auto cn = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){});
+    sn.subscribe("sink");
+    bool w = channel_wait_for(slave, "sink", std::chrono::seconds(2));
+    CHECK(w);
+
+    //produce while there is credit, then wait for the credit asynchronously
+    std::string payload(32768, 'x');
+    std::promise<void> writable;
+    int sent = 0;
+    while (sent < 20) {
+        if (client.get_send_credit() < payload.size()) {
+            if (client.on_writable(payload.size(), [&]{writable.set_value();})) break;
+        }
+        cn.send_message("sink", payload);
+        ++sent;
+    }
+    if (sent < 20) {
+        CHECK(writable.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        CHECK(client.get_send_credit() >= payload.size());
+    }
+    CHECK(client.get_send_credit() <= hwm);
+}
+
+///reads everything until connection is closed
+class Reader: public IPeer {
+public:
+    std::string data;
+    std::promise<std::string> result;
+    std::shared_ptr<INetContext> ctx;
+    ConnHandle h = no_connection;
+    virtual void receive_complete(std::string_view d) noexcept override {
+        if (d.empty()) result.set_value(data);
+        else {
+            data.append(d);
+            ctx->receive(h, this);
+        }
+    }
+    virtual void clear_to_send() noexcept override {}
+    virtual void on_timeout() noexcept override {}
+};
+
+void dispatch_pool(std::size_t max_inflight) {
+    std::cout << __FUNCTION__ << " " << max_inflight << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context(1);
+    auto workers = make_network_context(2);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    server.set_dispatch_pool(workers, max_inflight);
+    BridgeTCPClient client(slave, ctx, "localhost:12121");
+
+    constexpr int count = 1000;
+    std::vector<int> order;
+    std::atomic<bool> on_worker = true;
+    std::promise<void> done;
+    auto sn = ClientCallback(master, [&](AbstractClient &, const Message &msg, bool){
+        //messages are processed by the pool one at time, in order
+        if (!workers->on_loop()) on_worker = false;
+        order.push_back(std::stoi(std::string(msg.get_content())));
+        if (order.size() == count) done.set_value();
+    });
+    auto cn = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){});
+    sn.subscribe("sink");
+    bool w = channel_wait_for(slave, "sink", std::chrono::seconds(2));
+    CHECK(w);
+    for (int i = 0; i < count; ++i) {
+        cn.send_message("sink", std::to_string(i) + std::string(100, ' '));
+    }
+    CHECK(done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(on_worker);
+    bool in_order = true;
+    for (int i = 0; i < count; ++i) in_order = in_order && order[i] == i;
+    CHECK(in_order);
+}
+
+void dispatch_before_disconnect() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context(1);
+    auto workers = make_network_context(2);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    server.set_dispatch_pool(workers);
+
+    constexpr int count = 200;
+    std::atomic<int> received = 0;
+    auto sn = ClientCallback(master, [&](AbstractClient &, const Message &, bool){
+        //slow handler, the disconnect arrives while frames are queued
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        ++received;
+    });
+    sn.subscribe("sink");
+    {
+        BridgeTCPClient client(slave, ctx, "localhost:12121");
+        auto cn = ClientCallback(slave, [&](AbstractClient &, const Message &, bool){});
+        bool w = channel_wait_for(slave, "sink", std::chrono::seconds(2));
+        CHECK(w);
+        for (int i = 0; i < count; ++i) {
+            cn.send_message("sink", std::to_string(i) + std::string(100, ' '));
+        }
+    }
+    //all messages received before the disconnect are dispatched
+    for (int i = 0; i < 200 && received < count; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    CHECK_EQUAL(received.load(), count);
+}
+
+void connection_limit() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context(1);
+
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    server.set_connection_limit(1);
+    BridgeTCPClient client(slave, ctx, "localhost:12121");
+
+    auto sn = ClientCallback(master, [&](AbstractClient &, const Message &, bool){});
+    sn.subscribe("limit");
+    bool w = channel_wait_for(slave, "limit", std::chrono::seconds(2));
+    CHECK(w);
+
+    //second connection is over limit, the server closes it gracefully,
+    //it must not be reset because of unread request
+    std::atomic<int> errors = {0};
+    auto cctx = make_network_context([&](std::string_view, std::source_location){++errors;}, 1);
+    Reader rd;
+    rd.ctx = cctx;
+    rd.h = cctx->connect("localhost:12121");
+    std::string_view req[] = {"GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"};
+    CHECK(cctx->write(rd.h, req));
+    cctx->receive(rd.h, &rd);
+    auto r = rd.result.get_future().get();
+    cctx->destroy(rd.h);
+    CHECK(r.substr(0, 12) == "HTTP/1.1 503");
+    CHECK_EQUAL(errors.load(), 0);
+    CHECK_EQUAL(server.get_rejected_count(), 1);
+}
+
+#ifndef _WIN32
+void unresolved_host() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    //resolution runs in background, failure is reported as closed connection
+    Reader rd;
+    rd.ctx = ctx;
+    rd.h = ctx->connect("zerobus-test.invalid:12121");
+    ctx->receive(rd.h, &rd);
+    auto r = rd.result.get_future().get();
+    ctx->destroy(rd.h);
+    CHECK(r.empty());
+    //failure is cached, but reported the same way (connect doesn't throw)
+    Reader rd2;
+    rd2.ctx = ctx;
+    rd2.h = ctx->connect("zerobus-test.invalid:12121");
+    ctx->receive(rd2.h, &rd2);
+    auto f = rd2.result.get_future();
+    CHECK(f.wait_for(std::chrono::seconds(1)) == std::future_status::ready);
+    CHECK(f.get().empty());
+    //reconnect to the cached failure doesn't throw either
+    Reader rd3;
+    rd3.ctx = ctx;
+    rd3.h = rd2.h;
+    ctx->reconnect(rd3.h, "zerobus-test.invalid:12121");
+    ctx->receive(rd3.h, &rd3);
+    CHECK(rd3.result.get_future().get().empty());
+    ctx->destroy(rd2.h);
+}
+
+//connection which became writable
+class Writable: public IPeer {
+public:
+    std::promise<void> ready;
+    virtual void receive_complete(std::string_view) noexcept override {}
+    virtual void clear_to_send() noexcept override {ready.set_value();}
+    virtual void on_timeout() noexcept override {}
+};
+
+void zerocopy_reconnect() {
+    std::cout << __FUNCTION__ << std::endl;
+    NetContextConfig cfg;
+    cfg.zerocopy_threshold = 16384;
+    auto ctx = make_network_context(cfg);
+    int srv = ::socket(AF_INET, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    int one = 1;
+    ::setsockopt(srv, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(12122);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(::bind(srv, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+    CHECK(::listen(srv, 4) == 0);
+
+    auto owner = std::make_shared<std::string>(262144, 'x');
+    auto h = ctx->connect("127.0.0.1:12122");
+    auto send_large = [&]{
+        Writable w;
+        ctx->ready_to_send(h, &w);
+        CHECK(w.ready.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+        std::string_view seg = *owner;
+        return ctx->send(h, std::span<const std::string_view>(&seg, 1), owner);
+    };
+    int c1 = ::accept(srv, nullptr, nullptr);
+    CHECK(send_large() > 0);
+    //completions of the old socket never come, its pending sends are released
+    ctx->reconnect(h, "127.0.0.1:12122");
+    CHECK_EQUAL(owner.use_count(), 1);
+
+    int c2 = ::accept(srv, nullptr, nullptr);
+    CHECK(send_large() > 0);
+    std::thread rd([&]{
+        char buf[65536];
+        while (::recv(c2, buf, sizeof(buf), 0) > 0);
+    });
+    //the new socket numbers its zero copy sends from zero
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (owner.use_count() > 1 && std::chrono::steady_clock::now() < end) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK_EQUAL(owner.use_count(), 1);
+    ctx->destroy(h);
+    rd.join();
+    ::close(c1);
+    ::close(c2);
+    ::close(srv);
+}
+
+class AddrServer: public IServer {
+public:
+    std::shared_ptr<INetContext> ctx;
+    std::promise<std::string> addr;
+    virtual void on_accept(ConnHandle connection, std::string peer_addr) noexcept override {
+        ctx->destroy(connection);
+        addr.set_value(std::move(peer_addr));
+    }
+    virtual void on_timeout() noexcept override {}
+};
+
+void unix_peer_address() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    auto srv = ctx->create_server("unix:@zerobus_addr_test");
+    auto accept_from = [&](const char *name, std::size_t name_len) {
+        AddrServer as;
+        as.ctx = ctx;
+        ctx->accept(srv, &as);
+        int s = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (name) {
+            //abstract name, it is not terminated
+            std::copy(name, name + name_len, addr.sun_path + 1);
+            CHECK(::bind(s, reinterpret_cast<sockaddr *>(&addr),
+                         static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + name_len)) == 0);
+        }
+        std::string_view srv_name = "zerobus_addr_test";
+        std::fill(std::begin(addr.sun_path), std::end(addr.sun_path), 0);
+        std::copy(srv_name.begin(), srv_name.end(), addr.sun_path + 1);
+        CHECK(::connect(s, reinterpret_cast<sockaddr *>(&addr),
+                        static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + 1 + srv_name.size())) == 0);
+        auto r = as.addr.get_future().get();
+        ::close(s);
+        return r;
+    };
+    //client without a name, the address has no path
+    auto unnamed = accept_from(nullptr, 0);
+    CHECK_EQUAL(unnamed, "unix:");
+    //length of abstract name is given by the address length
+    auto abstract = accept_from("zerobus_client", 14);
+    CHECK_EQUAL(abstract, "unix:@zerobus_client");
+    auto with_zero = accept_from("zb\0client", 9);
+    CHECK(with_zero == std::string("unix:@zb\0client", 15));
+    ctx->destroy(srv);
+}
+
+//websocket connection which never responds to pings
+static int silent_peer(int port) {
+    int s = ::socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(static_cast<std::uint16_t>(port));
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    CHECK(::connect(s, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0);
+    std::string_view req = "GET / HTTP/1.1\r\n"
+                           "Host: localhost\r\n"
+                           "Upgrade: websocket\r\n"
+                           "Connection: Upgrade\r\n"
+                           "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\n"
+                           "Sec-WebSocket-Version: 13\r\n"
+                           "\r\n";
+    CHECK(::send(s, req.data(), req.size(), 0) == static_cast<ssize_t>(req.size()));
+    return s;
+}
+
+void keepalive() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    server.set_keepalive(std::chrono::milliseconds(50));
+    BridgeTCPClient client(slave, ctx, "localhost:12121");
+    int s = silent_peer(12121);
+    auto wait_for_peers = [&](std::size_t count) {
+        for (int i = 0; i < 100; ++i) {
+            if (server.get_peer_stats().size() == count) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    };
+    CHECK(wait_for_peers(2));
+    //the silent peer is removed, the client answers pings
+    std::this_thread::sleep_for(std::chrono::milliseconds(300));
+    CHECK(wait_for_peers(1));
+    auto st = server.get_peer_stats();
+    CHECK(st.size() == 1 && st[0].rtt.count() > 0 && st[0].srtt.count() > 0);
+    ::close(s);
+}
+
+void manual_ping() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+    auto ctx = make_network_context(1);
+    BridgeTCPServer server(master, ctx, "localhost:12121");
+    BridgeTCPClient client(slave, ctx, "localhost:12121");
+    int s = silent_peer(12121);
+    auto wait_for_peers = [&](std::size_t count) {
+        for (int i = 0; i < 100; ++i) {
+            if (server.get_peer_stats().size() == count) return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return false;
+    };
+    CHECK(wait_for_peers(2));
+    //first call starts the check, second sends the ping, third finds the silent
+    //peer dead (it is removed in background), the client answers in time
+    for (int i = 0; i < 3; ++i) {
+        server.send_ping();
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+    CHECK(wait_for_peers(1));
+    ::close(s);
+}
+
+void unix_socket_bridge(std::string server_url, std::string client_url) {
+    std::cout << __FUNCTION__ << " " << server_url << std::endl;
+    auto master = Bus::create();
+    auto slave = Bus::create();
+
+    BridgeTCPServer server(master, server_url);
+    BridgeTCPClient client(slave, client_url);
+
+    std::promise<std::string> result;
+
+    auto sn = ClientCallback(master, [&](AbstractClient &c, const Message &msg, bool){
+        std::string s ( msg.get_content());
+        std::reverse(s.begin(), s.end());
+        c.send_message(msg.get_sender(), s, msg.get_conversation());
+    });
+    auto cn= ClientCallback(slave, [&](AbstractClient &, const Message &msg, bool){
+        result.set_value(std::string(msg.get_content()));
+    });
+
+    sn.subscribe("reverse");
+    bool w = channel_wait_for(slave, "reverse", std::chrono::seconds(2));
+    CHECK(w);
+
+    cn.send_message("reverse", "ahoj svete");
+    auto r = result.get_future().get();
+    CHECK_EQUAL(r, "etevs joha");
+}
+#endif
+
 int main() {
 #ifdef _WIN32
     _CrtSetDbgFlag ( _CRTDBG_ALLOC_MEM_DF | _CRTDBG_LEAK_CHECK_DF );
@@ -211,4 +900,29 @@ int main() {
     two_hop_bridge();
     detect_cycle_test();
     test_reconnect();
+    resume_session();
+    shared_channel_list();
+    broadcast_shared_frame();
+    zerocopy_large_message();
+    socket_options();
+    output_backlog();
+    send_credit();
+    coalescing({.end_of_burst = true});
+    coalescing({.max_delay = std::chrono::microseconds(500)});
+    coalescing({.max_delay = std::chrono::microseconds(500), .adaptive = true});
+    dispatch_pool(1024*1024);
+    dispatch_pool(256);
+    dispatch_before_disconnect();
+    connection_limit();
+#ifndef _WIN32
+    unresolved_host();
+    zerocopy_reconnect();
+    unix_peer_address();
+    keepalive();
+    manual_ping();
+    unix_socket_bridge("unix:@zerobus_test", "unix:@zerobus_test");
+    unix_socket_bridge("ws+unix:/tmp/zerobus_test.sock:/bus", "ws+unix:///tmp/zerobus_test.sock:/bus");
+    //server must remove its socket file
+    CHECK(::access("/tmp/zerobus_test.sock", F_OK) != 0);
+#endif
 }
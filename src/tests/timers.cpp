@@ -0,0 +1,125 @@
+#include "check.h"
+
+#include <zerobus/timer_wheel.h>
+#include <zerobus/network.h>
+#include <algorithm>
+#include <future>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace zerobus;
+
+using Wheel = TimerWheel<int>;
+
+void wheel_expiration_order() {
+    std::cout << __FUNCTION__ << std::endl;
+    Wheel wheel;
+    auto base = Wheel::Clock::now();
+    std::default_random_engine rnd(1);
+    std::uniform_int_distribution<std::int64_t> dist(0, 36000000000LL);   //up to 10 hours in microseconds
+    std::vector<Wheel::TimePoint> expires;
+    for (int i = 0; i < 10000; ++i) {
+        auto tp = base + std::chrono::microseconds(dist(rnd));
+        expires.push_back(tp);
+        wheel.arm(tp, i);
+    }
+    std::size_t fired = 0;
+    bool early = false;
+    bool late = false;
+    auto now = base;
+    while (!wheel.empty()) {
+        auto next = wheel.next_expiration();
+        CHECK(next != Wheel::TimePoint::max());
+        now = std::max(next, now);
+        wheel.advance(now);
+        while (auto e = wheel.pop_expired()) {
+            if (expires[e->payload] > now) early = true;
+            //nothing can be skipped - each step advances only to the next expiration
+            if (Wheel::to_tick(expires[e->payload]) < Wheel::to_tick(now)) late = true;
+            ++fired;
+        }
+    }
+    CHECK(!early);
+    CHECK(!late);
+    CHECK_EQUAL(fired, expires.size());
+    CHECK(wheel.next_expiration() == Wheel::TimePoint::max());
+}
+
+void wheel_cancel() {
+    std::cout << __FUNCTION__ << std::endl;
+    Wheel wheel;
+    auto base = Wheel::Clock::now();
+    std::vector<TimerID> ids;
+    for (int i = 0; i < 100; ++i) {
+        ids.push_back(wheel.arm(base + std::chrono::milliseconds(i * 37), i));
+    }
+    for (int i = 0; i < 100; i += 2) {
+        CHECK(wheel.cancel(ids[i]));
+    }
+    CHECK(!wheel.cancel(ids[0]));
+    //reused entry must not be canceled by old id
+    auto nid = wheel.arm(base, 1000);
+    CHECK(!wheel.cancel(ids[0]));
+    CHECK(wheel.get(nid) != nullptr);
+    wheel.advance(base + std::chrono::hours(1));
+    int cnt = 0;
+    bool odd = true;
+    while (auto e = wheel.pop_expired()) {
+        if (e->payload != 1000 && (e->payload & 1) == 0) odd = false;
+        ++cnt;
+    }
+    CHECK(odd);
+    CHECK_EQUAL(cnt, 51);
+    CHECK(wheel.empty());
+}
+
+void context_timers() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context();
+    auto now = std::chrono::steady_clock::now();
+    std::mutex mx;
+    std::vector<int> order;
+    std::promise<void> done;
+    auto record = [&](int v) {
+        std::lock_guard _(mx);
+        order.push_back(v);
+    };
+    struct Action {
+        decltype(record) *r;
+        int v;
+        void operator()() const {(*r)(v);}
+    };
+    ctx->set_timer(no_connection, now + std::chrono::milliseconds(30), Action{&record, 3});
+    ctx->set_timer(no_connection, now + std::chrono::milliseconds(10), Action{&record, 1});
+    auto id = ctx->set_timer(no_connection, now + std::chrono::milliseconds(20), Action{&record, 2});
+    auto conn = ctx->connect(SpecialConnection::null);
+    ctx->set_timer(conn, now + std::chrono::milliseconds(25), Action{&record, 4});
+    ctx->set_timer(no_connection, now + std::chrono::milliseconds(50), [p = &done]{p->set_value();});
+    CHECK(ctx->cancel_timer(id));
+    CHECK(!ctx->cancel_timer(id));
+    ctx->destroy(conn);
+    done.get_future().get();
+    std::lock_guard _(mx);
+    CHECK_EQUAL(order.size(), 2U);
+    CHECK_EQUAL(order[0], 1);
+    CHECK_EQUAL(order[1], 3);
+}
+
+int main() {
+    std::jthread timer([](std::stop_token tkn) {
+        std::mutex mx;
+        std::condition_variable cond;
+        bool flag = false;
+        std::stop_callback cb(tkn, [&]{
+            std::lock_guard _(mx);
+            flag = true;
+            cond.notify_all();
+        });
+        std::unique_lock lk(mx);
+        if (!cond.wait_for(lk, std::chrono::minutes(1), [&]{return flag;})) abort();
+    });
+    wheel_expiration_order();
+    wheel_cancel();
+    context_timers();
+}
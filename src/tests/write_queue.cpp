@@ -0,0 +1,230 @@
+#include "check.h"
+
+#include <zerobus/network.h>
+#include <zerobus/output_queue.h>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace zerobus;
+
+void output_queue_segments() {
+    std::cout << __FUNCTION__ << std::endl;
+    OutputQueue q;
+    q.append("hello ");
+    q.append("world");
+    //contiguous copies are merged into one segment
+    CHECK_EQUAL(q.segments(), 1);
+    auto big = std::make_shared<std::string>(OutputQueue::chunk_size * 2, 'x');
+    q.append(*big, big);
+    CHECK_EQUAL(q.segments(), 2);
+    CHECK_EQUAL(q.size(), 11 + big->size());
+    std::string_view segs[4];
+    CHECK_EQUAL(q.gather(segs), 2);
+    CHECK_EQUAL(segs[0], "hello world");
+    CHECK(segs[1].data() == big->data());
+    q.consume(8);
+    q.gather(segs);
+    CHECK_EQUAL(segs[0], "rld");
+    q.consume(3 + 10);
+    CHECK_EQUAL(q.segments(), 1);
+    CHECK_EQUAL(q.size(), big->size() - 10);
+    q.consume(q.size());
+    CHECK(q.empty());
+    //owner is released when the data are written
+    CHECK_EQUAL(big.use_count(), 1);
+    q.append("world");
+    q.prepend("hello ");
+    CHECK_EQUAL(q.gather(segs), 2);
+    CHECK_EQUAL(segs[0], "hello ");
+    CHECK_EQUAL(segs[1], "world");
+    CHECK_EQUAL(q.size(), 11);
+}
+
+class PipeReader: public IPeer {
+public:
+    PipeReader(INetContext &ctx, ConnHandle h, std::size_t expected)
+        :_ctx(ctx),_h(h),_expected(expected) {}
+    void start() {_ctx.receive(_h, this);}
+    std::string result;
+    std::promise<void> done;
+
+    virtual void receive_complete(std::string_view data) noexcept override {
+        result.append(data);
+        if (data.empty() || result.size() >= _expected) done.set_value();
+        else _ctx.receive(_h, this);
+    }
+    virtual void clear_to_send() noexcept override {}
+    virtual void on_timeout() noexcept override {}
+protected:
+    INetContext &_ctx;
+    ConnHandle _h;
+    std::size_t _expected;
+};
+
+class FlushWaiter: public IPeer {
+public:
+    std::promise<void> flushed;
+    virtual void receive_complete(std::string_view) noexcept override {}
+    virtual void clear_to_send() noexcept override {flushed.set_value();}
+    virtual void on_timeout() noexcept override {}
+};
+
+void write_large_queue() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    auto pipe = ctx->create_pipe();
+    std::string expected;
+    for (int i = 0; i < 20000; ++i) expected.append(std::to_string(i)).push_back(',');
+    auto big = std::make_shared<std::string>(1024*1024, 'A');
+    expected.append(*big);
+    //many small writes without waiting, they are queued in order
+    for (int i = 0; i < 20000; ++i) {
+        std::string s = std::to_string(i);
+        std::string_view segs[] = {s, ","};
+        CHECK(ctx->write(pipe.write, segs));
+    }
+    std::string_view bsegs[] = {*big};
+    CHECK(ctx->write(pipe.write, bsegs, big));
+    CHECK(ctx->get_queued_bytes(pipe.write) > 0);
+    PipeReader rd(*ctx, pipe.read, expected.size());
+    FlushWaiter fw;
+    ctx->wait_for_flush(pipe.write, &fw);
+    rd.start();
+    CHECK(rd.done.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(fw.flushed.get_future().wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+    CHECK(rd.result == expected);
+    CHECK_EQUAL(ctx->get_queued_bytes(pipe.write), 0);
+    ctx->destroy(pipe.write);
+    ctx->destroy(pipe.read);
+}
+
+void stale_handle() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    auto p1 = ctx->create_pipe();
+    ctx->destroy(p1.write);
+    ctx->destroy(p1.read);
+    //slots are reused, but the old handles must not refer to new connections
+    auto p2 = ctx->create_pipe();
+    CHECK(p2.write != p1.write);
+    CHECK(p2.read != p1.read);
+    std::string_view segs[] = {"x"};
+    CHECK(!ctx->write(p1.write, segs));
+    CHECK(ctx->write(p2.write, segs));
+    ctx->destroy(p2.write);
+    ctx->destroy(p2.read);
+}
+
+//every connection carries only own byte, the receiver requests next data
+//before it checks the received data (another thread reads meanwhile)
+class ByteChecker: public IPeer {
+public:
+    ByteChecker(INetContext &ctx, ConnHandle h, char expected)
+        :_ctx(ctx),_h(h),_expected(expected) {}
+    void start() {_ctx.receive(_h, this);}
+    std::atomic<bool> corrupted = {false};
+    std::atomic<bool> closed = {false};
+
+    virtual void receive_complete(std::string_view data) noexcept override {
+        if (data.empty()) {
+            closed = true;
+            return;
+        }
+        _ctx.receive(_h, this);
+        std::this_thread::sleep_for(std::chrono::microseconds(50));
+        for (char c: data) if (c != _expected) corrupted = true;
+    }
+    virtual void clear_to_send() noexcept override {}
+    virtual void on_timeout() noexcept override {}
+protected:
+    INetContext &_ctx;
+    ConnHandle _h;
+    char _expected;
+};
+
+void shared_read_buffers() {
+    std::cout << __FUNCTION__ << std::endl;
+    constexpr int conns = 8;
+    auto ctx = make_network_context(4);
+    std::vector<PipePair> pipes;
+    std::vector<std::unique_ptr<ByteChecker> > checkers;
+    for (int i = 0; i < conns; ++i) {
+        pipes.push_back(ctx->create_pipe());
+        checkers.push_back(std::make_unique<ByteChecker>(*ctx, pipes.back().read, static_cast<char>('a' + i)));
+        checkers.back()->start();
+    }
+    //buffers borrowed by reads of other connections must never be visible to a running callback
+    std::vector<std::thread> writers;
+    for (int i = 0; i < conns; ++i) {
+        writers.emplace_back([&, i]{
+            std::string chunk(512, static_cast<char>('a' + i));
+            std::string_view segs[] = {chunk};
+            auto end = std::chrono::steady_clock::now() + std::chrono::milliseconds(300);
+            while (std::chrono::steady_clock::now() < end) {
+                ctx->write(pipes[i].write, segs);
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        });
+    }
+    for (auto &t: writers) t.join();
+    bool ok = true;
+    for (auto &c: checkers) if (c->corrupted) ok = false;
+    CHECK(ok);
+    for (auto &p: pipes) ctx->destroy(p.write);
+    for (auto &p: pipes) ctx->destroy(p.read);
+}
+
+class PromiseReader: public IPeer {
+public:
+    std::promise<std::string> result;
+    virtual void receive_complete(std::string_view data) noexcept override {
+        result.set_value(std::string(data));
+    }
+    virtual void clear_to_send() noexcept override {}
+    virtual void on_timeout() noexcept override {}
+};
+
+void caller_descriptor_flags() {
+    std::cout << __FUNCTION__ << std::endl;
+    auto ctx = make_network_context(1);
+    //pipe is reopened, socket passed as a descriptor is armed in one-shot mode
+    int pfd[2];
+    int sfd[2];
+    CHECK(::pipe(pfd) == 0);
+    CHECK(::socketpair(AF_UNIX, SOCK_STREAM, 0, sfd) == 0);
+    int rds[] = {pfd[0], sfd[0]};
+    int wrs[] = {pfd[1], sfd[1]};
+    for (int i = 0; i < 2; ++i) {
+        auto h = ctx->connect(SpecialConnection::descriptor, &rds[i]);
+        //the context must not change the caller's descriptor
+        CHECK((fcntl(rds[i], F_GETFL) & O_NONBLOCK) == 0);
+        for (const char *msg: {"hello", "world"}) {
+            PromiseReader rd;
+            auto f = rd.result.get_future();
+            ctx->receive(h, &rd);
+            CHECK(::write(wrs[i], msg, 5) == 5);
+            CHECK(f.wait_for(std::chrono::seconds(5)) == std::future_status::ready);
+            auto data = f.get();
+            CHECK_EQUAL(data, msg);
+        }
+        ctx->destroy(h);
+        ::close(rds[i]);
+        ::close(wrs[i]);
+    }
+}
+
+int main() {
+    output_queue_segments();
+    write_large_queue();
+    stale_handle();
+    shared_read_buffers();
+    caller_descriptor_flags();
+}
@@ -3,14 +3,23 @@
 #include <mutex>
 #include <numeric>
 #include <iterator>
+#include <random>
 
 namespace zerobus {
 
 static std::function<void(AbstractBridge *lsn, bool cycle)> cycle_report;
 
 
+static std::uint32_t generate_epoch() {
+    static std::atomic<std::uint32_t> cntr = {std::random_device()()};
+    std::uint32_t r;
+    do r = cntr.fetch_add(1, std::memory_order_relaxed); while (r == 0);
+    return r;
+}
+
 AbstractBridge::AbstractBridge(Bus bus)
-    :_ptr(std::static_pointer_cast<IBridgeAPI>(bus.get_handle())) {}
+    :_ptr(std::static_pointer_cast<IBridgeAPI>(bus.get_handle()))
+    ,_chan_epoch(generate_epoch()) {}
 
 
 
@@ -25,8 +34,14 @@ void AbstractBridge::process_mine_channels(ChannelList lst, bool reset) noexcept
         lst = ChannelList(lst.begin(), e);
         check_rules(flt);
     }
+    if (_cycle_detected) lst = {};
+    if (send_channel_changes(lst, reset)) {
+        _cur_channels = ChannelSnapshot::make(lst);
+        _cur_excluded.reset();
+    }
+}
 
-
+void AbstractBridge::send_serial() {
     auto srl = _ptr->get_serial(this);
     std::hash<std::string_view> hasher;
     auto h = hasher(srl);
@@ -34,36 +49,214 @@ void AbstractBridge::process_mine_channels(ChannelList lst, bool reset) noexcept
         _srl_hash = h;
         if (!srl.empty()) send(UpdateSerial{srl});
     }
-    if (_cycle_detected) lst = {};
+}
+
+bool AbstractBridge::send_channel_changes(ChannelList lst, bool reset) {
+    send_serial();
+
+    auto resync = _resync_from.exchange(no_resync);
+    if (resync != no_resync && !reset && !replay_channels(resync)) reset = true;
 
-    if (_cur_channels.empty() || reset) {
-        if (!lst.empty()) send(ChannelUpdate{lst, Operation::replace});
+    auto cur = get_cur_channels();
+    if (cur.empty() || reset) {
+        if (lst.empty() && cur.empty()) {
+            if (resync != no_resync) send_channel_version();
+            return false;
+        }
+        send(ChannelUpdate{lst, Operation::replace});
+        log_channels(Operation::replace, lst);
     } else if (lst.empty()) {
         send(ChannelUpdate{lst,  Operation::replace});
+        log_channels(Operation::replace, lst);
     } else {
         bool p = false;
         std::set_difference(lst.begin(), lst.end(),
-                _cur_channels.begin(), _cur_channels.end(), std::back_inserter(_tmp));
-        if (!_tmp.empty()) {send(ChannelUpdate{_tmp,  Operation::add}); p = true;}
+                cur.begin(), cur.end(), std::back_inserter(_tmp));
+        if (!_tmp.empty()) {
+            send(ChannelUpdate{_tmp,  Operation::add});
+            log_channels(Operation::add, _tmp);
+            p = true;
+        }
         _tmp.clear();
 
-        std::set_difference(_cur_channels.begin(), _cur_channels.end(),
+        std::set_difference(cur.begin(), cur.end(),
                 lst.begin(), lst.end(), std::back_inserter(_tmp));
-        if (!_tmp.empty()) {send(ChannelUpdate{_tmp,  Operation::erase}); p = true;}
+        if (!_tmp.empty()) {
+            send(ChannelUpdate{_tmp,  Operation::erase});
+            log_channels(Operation::erase, _tmp);
+            p = true;
+        }
         _tmp.clear();
-        if (!p)
-            return;
+        if (!p) {
+            //resync without changes still confirms current version
+            if (resync != no_resync) send_channel_version();
+            return false;
+        }
     }
-    persist_channel_list(lst, _cur_channels, _char_buffer);
+    ++_chan_version;
+    send_channel_version();
+    return true;
 }
 
-void AbstractBridge::send_mine_channels(bool reset) noexcept {
+AbstractBridge::ChannelList AbstractBridge::get_cur_channels() {
+    if (!_cur_channels) return {};
+    if (!_cur_excluded) return _cur_channels->channels;
+    _cur_buffer.clear();
+    std::set_difference(_cur_channels->channels.begin(), _cur_channels->channels.end(),
+            _cur_excluded->channels.begin(), _cur_excluded->channels.end(),
+            std::back_inserter(_cur_buffer));
+    return _cur_buffer;
+}
+
+std::size_t AbstractBridge::get_cur_channels_count() const {
+    if (!_cur_channels) return 0;
+    return _cur_channels->channels.size() - (_cur_excluded?_cur_excluded->channels.size():0);
+}
+
+void AbstractBridge::process_shared_channels(const SharedChannels &shared, bool reset) noexcept {
+    if (_filter.load() || _cycle_detected) {
+        //the shared list can't be used
+        process_mine_channels(_cycle_detected?ChannelList():_ptr->get_active_channels(this, _bus_channels), reset);
+        return;
+    }
+    //channels where this bridge is only listener are not exported to it
+    auto r = std::equal_range(shared.exclusive.begin(), shared.exclusive.end(),
+            std::pair<const IListener *, std::size_t>(this, 0),
+            [](const auto &a, const auto &b){return a.first < b.first;});
+    std::vector<ChannelID> excl;
+    excl.reserve(std::distance(r.first, r.second));
+    for (auto iter = r.first; iter != r.second; ++iter) {
+        excl.push_back(shared.list->channels[iter->second]);
+    }
+
+    if (!reset && _cur_channels && _cur_channels == shared.prev && _resync_from.load() == no_resync) {
+        //the other side has previous shared list, so only changes are sent
+        send_serial();
+        send_shared_changes(shared, excl);
+    } else {
+        ChannelList lst = shared.list->channels;
+        std::vector<ChannelID> own;
+        if (!excl.empty()) {
+            std::set_difference(lst.begin(), lst.end(), excl.begin(), excl.end(), std::back_inserter(own));
+            lst = own;
+        }
+        send_channel_changes(lst, reset);
+    }
+    //the list sent is the shared list without excluded channels
+    _cur_channels = shared.list;
+    if (excl.empty()) {
+        _cur_excluded.reset();
+    } else if (!_cur_excluded || !std::equal(excl.begin(), excl.end(),
+                    _cur_excluded->channels.begin(), _cur_excluded->channels.end())) {
+        _cur_excluded = ChannelSnapshot::make(excl);
+    }
+}
+
+void AbstractBridge::send_shared_changes(const SharedChannels &shared, const std::vector<ChannelID> &excl) {
+    bool p = false;
+    auto send_delta = [&](Operation op, const PChannelSnapshot &delta, const SharedMessage &msg, std::vector<ChannelID> &adjusted) {
+        if (std::equal(adjusted.begin(), adjusted.end(), delta->channels.begin(), delta->channels.end())) {
+            if (adjusted.empty()) return;
+            send(ChannelUpdate{delta->channels, op}, msg);
+            log_channels(op, delta);
+        } else {
+            if (adjusted.empty()) return;
+            send(ChannelUpdate{adjusted, op});
+            log_channels(op, ChannelList(adjusted));
+        }
+        p = true;
+    };
+    auto &added = shared.added->channels;
+    auto &erased = shared.erased->channels;
+    if (excl.empty() && !_cur_excluded) {
+        //the most common case, this bridge receives the same changes as others
+        send_delta(Operation::add, shared.added, shared.added_msg, added);
+        send_delta(Operation::erase, shared.erased, shared.erased_msg, erased);
+    } else {
+        //adjust changes by channels where this bridge was or became only listener
+        static const std::vector<ChannelID> empty;
+        const auto &old_excl = _cur_excluded?_cur_excluded->channels:empty;
+        const auto &lst = shared.list->channels;
+        const auto &prev = shared.prev->channels;
+        std::vector<ChannelID> a, b, adj;
+        //added - excl + ((old_excl & list) - excl)
+        std::set_intersection(old_excl.begin(), old_excl.end(), lst.begin(), lst.end(), std::back_inserter(a));
+        std::set_union(added.begin(), added.end(), a.begin(), a.end(), std::back_inserter(b));
+        std::set_difference(b.begin(), b.end(), excl.begin(), excl.end(), std::back_inserter(adj));
+        send_delta(Operation::add, shared.added, shared.added_msg, adj);
+        a.clear(); b.clear(); adj.clear();
+        //erased - old_excl + ((excl - old_excl) & prev)
+        std::set_difference(excl.begin(), excl.end(), old_excl.begin(), old_excl.end(), std::back_inserter(a));
+        std::set_intersection(a.begin(), a.end(), prev.begin(), prev.end(), std::back_inserter(b));
+        a.clear();
+        std::set_difference(erased.begin(), erased.end(), old_excl.begin(), old_excl.end(), std::back_inserter(a));
+        std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(adj));
+        send_delta(Operation::erase, shared.erased, shared.erased_msg, adj);
+    }
+    if (p) {
+        ++_chan_version;
+        send_channel_version();
+    }
+}
+
+void AbstractBridge::log_channels(Operation op, const ChannelList &lst) {
+    log_channels(op, op == Operation::replace?PChannelSnapshot():ChannelSnapshot::make(lst));
+}
+
+void AbstractBridge::log_channels(Operation op, PChannelSnapshot lst) {
+    //changes are logged under the version which is announced once the update is sent
+    auto version = _chan_version + 1;
+    if (op == Operation::replace) {
+        //replace makes older changes useless
+        _chan_log.clear();
+        _chan_log_size = 0;
+        _chan_log_base = version;
+        return;
+    }
+    _chan_log_size += lst->channels.size();
+    _chan_log.push_back(ChannelDelta{version, op, std::move(lst)});
+    while (_chan_log_size > max_channel_log) {
+        auto &f = _chan_log.front();
+        _chan_log_size -= f.list->channels.size();
+        _chan_log_base = f.version;
+        _chan_log.pop_front();
+    }
+}
+
+bool AbstractBridge::replay_channels(std::uint32_t from) {
+    if (from == _chan_version) return true;
+    if (from < _chan_log_base || from > _chan_version) return false;
+    auto iter = std::find_if(_chan_log.begin(), _chan_log.end(), [&](const ChannelDelta &d){
+        return d.version > from;
+    });
+    std::size_t cnt = std::accumulate(iter, _chan_log.end(), std::size_t(0), [](std::size_t c, const ChannelDelta &d){
+        return c + d.list->channels.size();
+    });
+    //whole list is cheaper
+    if (cnt > get_cur_channels_count()) return false;
+    for (; iter != _chan_log.end(); ++iter) {
+        send(ChannelUpdate{iter->list->channels, iter->op});
+    }
+    return true;
+}
+
+void AbstractBridge::send_channel_version() {
+    send(ChannelVersion{_chan_epoch, _chan_version});
+}
+
+template<typename Fn>
+void AbstractBridge::lock_send_mine_channels(bool reset, Fn &&fn) noexcept {
     constexpr unsigned int reset_flag  = 1 << 10;
     constexpr unsigned int lock_flag = 1;
     bool rep;
+    bool first = true;
     do {
         if (_send_mine_channels_lock.fetch_add(lock_flag + (reset?reset_flag:0)) != 0) return;
-        if (!_cycle_detected) {
+        if (first) {
+            fn(reset);
+            first = false;
+        } else if (!_cycle_detected) {
+            //repeated request - the list could change meanwhile
             process_mine_channels(_ptr->get_active_channels(this, _bus_channels), reset);
         } else {
             process_mine_channels({}, reset);
@@ -78,6 +271,48 @@ void AbstractBridge::send_mine_channels(bool reset) noexcept {
     while (rep);
 }
 
+void AbstractBridge::send_mine_channels(bool reset) noexcept {
+    lock_send_mine_channels(reset, [&](bool reset){
+        if (!_cycle_detected) {
+            process_mine_channels(_ptr->get_active_channels(this, _bus_channels), reset);
+        } else {
+            process_mine_channels({}, reset);
+        }
+    });
+}
+
+void AbstractBridge::send_mine_channels(const SharedChannels &shared) noexcept {
+    lock_send_mine_channels(false, [&](bool reset){
+        process_shared_channels(shared, reset);
+    });
+}
+
+std::shared_ptr<AbstractBridge::ChannelSnapshot> AbstractBridge::ChannelSnapshot::make(const ChannelList &lst) {
+    auto s = std::make_shared<ChannelSnapshot>();
+    persist_channel_list(lst, s->channels, s->characters);
+    return s;
+}
+
+void AbstractBridge::SharedChannels::update(IBridgeAPI &api, std::span<const IListener * const> bridges) {
+    IBus::ChannelListStorage storage;
+    auto lst = api.get_active_channels(storage, bridges, exclusive);
+    if (!list) list = ChannelSnapshot::make({});
+    prev = list;
+    auto &cur = prev->channels;
+    if (!std::equal(lst.begin(), lst.end(), cur.begin(), cur.end())) {
+        list = ChannelSnapshot::make(lst);
+    }
+    //indexes of exclusive refer to the list
+    std::vector<ChannelID> tmp;
+    std::set_difference(lst.begin(), lst.end(), cur.begin(), cur.end(), std::back_inserter(tmp));
+    added = ChannelSnapshot::make(tmp);
+    tmp.clear();
+    std::set_difference(cur.begin(), cur.end(), lst.begin(), lst.end(), std::back_inserter(tmp));
+    erased = ChannelSnapshot::make(tmp);
+    added_msg = {};
+    erased_msg = {};
+}
+
 void AbstractBridge::receive(const ChannelUpdate &chan_up) {
     if (_cycle_detected) return;
     ChannelList chans = chan_up.lst;
@@ -99,6 +334,30 @@ void AbstractBridge::receive(ChannelReset) {
     send_mine_channels(true);
 }
 
+void AbstractBridge::receive(const ChannelVersion &msg) {
+    _remote_list.store((static_cast<std::uint64_t>(msg.epoch) << 32) | msg.version);
+}
+
+void AbstractBridge::receive(const ChannelResync &msg) {
+    if (msg.epoch != _chan_epoch) {
+        //they have list of other instance
+        send_mine_channels(true);
+        return;
+    }
+    _resync_from.store(msg.version);
+    send_mine_channels(false);
+}
+
+void AbstractBridge::resync_channels() noexcept {
+    //they support resync, if they have sent a version
+    auto v = _remote_list.load();
+    if (v) {
+        send(ChannelResync{static_cast<std::uint32_t>(v >> 32), static_cast<std::uint32_t>(v)});
+    } else {
+        send(ChannelReset{});
+    }
+}
+
 
 void AbstractBridge::receive(const Message &msg) {
     auto ch = msg.get_channel();
@@ -153,6 +412,7 @@ void AbstractBridge::receive(const UpdateSerial &msg) {
         send_mine_channels();
         if (_cycle_detected) {
             _ptr->unsubscribe_all_channels(this, false);
+            _remote_list.store(0);  //their list must be received whole
         } else {
             send(ChannelReset{});
         }
@@ -261,6 +521,7 @@ void AbstractBridge::receive(const GroupEmpty &msg) {
 }
 void AbstractBridge::receive(const NewSession &msg) {
     _version = msg.version;
+    _remote_list.store(0);
     _ptr->unsubscribe_all_channels(this, true);
     _srl_hash = 0;  //force update_session
     if (_cycle_detected) {
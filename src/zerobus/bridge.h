@@ -3,6 +3,8 @@
 
 #include "filter.h"
 
+#include <deque>
+#include <memory>
 #include <span>
 #include <vector>
 #include <atomic>
@@ -52,6 +54,35 @@ struct NewSession {
         return out;
     }
 };
+///announces version of the channel list sent so far
+/**
+ * Sent after channel updates. The receiver uses the version in ChannelResync after
+ * reconnect. Older receivers ignore it as unknown message, so they never request resync
+ */
+struct ChannelVersion {
+    ///identifies the list (changes with every new bridge instance)
+    std::uint32_t epoch;
+    ///version of the list
+    std::uint32_t version;
+    friend std::ostream &operator<<(std::ostream &out, const ChannelVersion &ch) {
+        out << "Channel version:" << ch.epoch << "/" << ch.version;
+        return out;
+    }
+};
+
+///request to resend channel list changed since given version (after reconnect)
+/**
+ * If the version is no longer available, the whole list is sent (as ChannelReset)
+ */
+struct ChannelResync {
+    std::uint32_t epoch;
+    std::uint32_t version;
+    friend std::ostream &operator<<(std::ostream &out, const ChannelResync &ch) {
+        out << "Channel resync:" << ch.epoch << "/" << ch.version;
+        return out;
+    }
+};
+
 struct NoRoute {
     ChannelID sender;
     ChannelID receiver;
@@ -103,13 +134,59 @@ public:
     using GroupEmpty = Msg::GroupEmpty;
     using NewSession = Msg::NewSession;
     using UpdateSerial = Msg::UpdateSerial;
+    using ChannelVersion = Msg::ChannelVersion;
+    using ChannelResync = Msg::ChannelResync;
+
+    ///immutable list of channels, which can be shared between bridges
+    struct ChannelSnapshot {
+        std::vector<ChannelID> channels;
+        std::vector<char> characters;
+        ///create snapshot of the list (copies names)
+        static std::shared_ptr<ChannelSnapshot> make(const ChannelList &lst);
+    };
+    ///content of the snapshot is never changed once created
+    using PChannelSnapshot = std::shared_ptr<ChannelSnapshot>;
+
+    ///message serialized once and sent by many bridges
+    struct SharedMessage {
+        std::string_view data;
+        std::shared_ptr<const void> owner;
+    };
+
+    ///list of channels computed once for many bridges connected to the same bus
+    /**
+     * @see send_mine_channels(const SharedChannels &)
+     */
+    struct SharedChannels {
+        ///channels exported to bridges, except channels listed in exclusive
+        PChannelSnapshot list;
+        ///list of previous update
+        PChannelSnapshot prev;
+        ///channels added since previous update
+        PChannelSnapshot added;
+        ///channels erased since previous update
+        PChannelSnapshot erased;
+        ///bridges which are only listener of a channel (index to list), ordered
+        std::vector<std::pair<const IListener *, std::size_t> > exclusive;
+        ///serialized added update (optional, set by the transport)
+        SharedMessage added_msg;
+        ///serialized erased update (optional, set by the transport)
+        SharedMessage erased_msg;
+
+        ///retrieve a new list from the bus and calculate changes
+        /**
+         * @param api bus
+         * @param bridges bridges which will receive the list
+         */
+        void update(IBridgeAPI &api, std::span<const IListener * const> bridges);
+    };
 
     AbstractBridge(Bus bus);
 
     virtual ~AbstractBridge();
 
 
-    AbstractBridge(const AbstractBridge &other):_ptr(other._ptr) {}
+    AbstractBridge(const AbstractBridge &other):_ptr(other._ptr),_chan_epoch(other._chan_epoch) {}
     AbstractBridge &operator=(const AbstractBridge &other) = delete;
 
     auto get_handle() const {return _ptr;}
@@ -126,6 +203,19 @@ public:
      */
     void send_mine_channels(bool reset = false) noexcept;
 
+    ///Sends list of channels computed once for many bridges
+    /**
+     * Has the same effect as send_mine_channels(), but the list of the bus is not scanned
+     * again. If this bridge sent the previous shared list, only changes are sent,
+     * adjusted by channels where this bridge is only listener. Bridges with filter or
+     * detected cycle retrieve own list.
+     *
+     * @param shared list updated by SharedChannels::update()
+     *
+     * @note @b mt-safety: this method is mt-safe.
+     */
+    void send_mine_channels(const SharedChannels &shared) noexcept;
+
     ///Apply list of channels of other/remote broker
     /**
      * The function subscribes new channels and unsubscribes no longer active channels by a list
@@ -142,6 +232,17 @@ public:
 
     void receive(ChannelReset);
 
+    ///store version of the channel list of other side
+    void receive(const ChannelVersion &msg);
+    ///resend changes of channel list since requested version
+    void receive(const ChannelResync &msg);
+
+    ///request channel list of other side after reconnect
+    /**
+     * Sends ChannelResync with the last received version, when the other side
+     * announced any. Otherwise sends ChannelReset, which requests whole list
+     */
+    void resync_channels() noexcept;
 
     ///apply their clear path command
     void receive(const NoRoute &cp);
@@ -204,6 +305,19 @@ protected:
     virtual void send(const GroupEmpty &) noexcept = 0;
     virtual void send(const NewSession &) noexcept = 0;
     virtual void send(const UpdateSerial &) noexcept = 0;
+    ///override when bridge can resume session after reconnect
+    virtual void send(const ChannelVersion &) noexcept {}
+    ///override when bridge can resume session after reconnect
+    virtual void send(const ChannelResync &) noexcept {}
+    ///send channel update shared by many bridges
+    /**
+     * @param msg update
+     * @param serialized serialized update, if available. Default implementation sends msg
+     */
+    virtual void send(const ChannelUpdate &msg, const SharedMessage &serialized) noexcept {
+        (void)serialized;
+        send(msg);
+    }
 
 
     ///diagnostic override called when cycle detection state changed;
@@ -214,8 +328,9 @@ protected:
 
     std::shared_ptr<IBridgeAPI> _ptr;
 
-    std::vector<char> _char_buffer = {};    ///buffer to store character data for persistent channels
-    std::vector<ChannelID> _cur_channels = {};
+    PChannelSnapshot _cur_channels = {};    ///< last sent list (base list, when shared)
+    PChannelSnapshot _cur_excluded = {};    ///< channels of the shared list not sent to this bridge
+    std::vector<ChannelID> _cur_buffer = {};    ///< last sent list, when it must be calculated
     std::vector<ChannelID> _tmp = {};   ///< temporary buffer for channel operations
     IBus::ChannelListStorage _bus_channels = {}; ///<temporary buffer to retrieve channels
     std::atomic<Filter *> _filter = {};
@@ -224,11 +339,41 @@ protected:
     std::size_t _srl_hash = 0;
     unsigned int _version = 0;
 
+    ///changes of channel list sent with given version
+    struct ChannelDelta {
+        std::uint32_t version;
+        Operation op;
+        PChannelSnapshot list;
+    };
+    ///maximum count of channels kept in the log of changes
+    static constexpr std::size_t max_channel_log = 16384;
+    static constexpr std::uint32_t no_resync = 0xFFFFFFFF;
+
+    std::uint32_t _chan_epoch;              ///< identifies our channel list
+    std::uint32_t _chan_version = 0;        ///< version of the last sent list
+    std::uint32_t _chan_log_base = 0;       ///< oldest version which can be resynced from the log
+    std::deque<ChannelDelta> _chan_log = {};    ///< changes since _chan_log_base
+    std::size_t _chan_log_size = 0;         ///< count of channels in the log
+    std::atomic<std::uint32_t> _resync_from = {no_resync}; ///< requested resync
+    std::atomic<std::uint64_t> _remote_list = {0};  ///< epoch (high 32 bits) and version of other side
+
     static ChannelList persist_channel_list(const ChannelList &source, std::vector<ChannelID> &channels, std::vector<char> &characters);
 
     virtual void on_message(const Message &message, bool pm) noexcept override;
 
     void process_mine_channels(ChannelList lst, bool reset) noexcept;
+    void process_shared_channels(const SharedChannels &shared, bool reset) noexcept;
+    bool send_channel_changes(ChannelList lst, bool reset);
+    void send_shared_changes(const SharedChannels &shared, const std::vector<ChannelID> &excl);
+    void send_serial();
+    ChannelList get_cur_channels();
+    std::size_t get_cur_channels_count() const;
+    template<typename Fn>
+    void lock_send_mine_channels(bool reset, Fn &&fn) noexcept;
+    void log_channels(Operation op, const ChannelList &lst);
+    void log_channels(Operation op, PChannelSnapshot lst);
+    bool replay_channels(std::uint32_t from);
+    void send_channel_version();
 
     void check_rules(Filter *flt);
 
@@ -1,14 +1,52 @@
 #pragma once
 #include "bus.h"
 #include "monitor.h"
+#include <algorithm>
 #include <span>
 #include <exception>
+#include <vector>
 
 namespace zerobus {
 
 
 using SerialID = std::string_view;
 
+///Marks a message, which is being delivered to many listeners on current thread
+/**
+ * The bus creates the scope while it broadcasts a message to listeners of a channel.
+ * The first bridge which serializes the message stores the result to the scope,
+ * other bridges send the same data. The data are released with the scope
+ */
+class BroadcastScope {
+public:
+    ///start broadcast of the message
+    explicit BroadcastScope(const Message &msg):_msg(msg),_prev(_current) {_current = this;}
+    ///end broadcast
+    ~BroadcastScope() {_current = _prev;}
+    BroadcastScope(const BroadcastScope &) = delete;
+    BroadcastScope &operator=(const BroadcastScope &) = delete;
+
+    ///find scope of the message
+    /**
+     * @param msg message
+     * @return pointer to scope if the message is being broadcast by current thread, otherwise nullptr
+     */
+    static BroadcastScope *find(const Message &msg) {
+        auto s = _current;
+        return s && &s->_msg == &msg?s:nullptr;
+    }
+
+    ///serialized message (empty, if not serialized yet)
+    std::string_view serialized = {};
+    ///owner of serialized data
+    std::shared_ptr<const void> owner = {};
+
+protected:
+    const Message &_msg;
+    BroadcastScope *_prev;
+    static inline thread_local BroadcastScope *_current = nullptr;
+};
+
 class IBridgeAPI : public IBus {
 public:
 
@@ -40,6 +78,38 @@ public:
      * @return list of channels. List is always ordered (std::less<std::string>)
      */
     virtual ChannelList get_active_channels(const IListener *listener, ChannelListStorage &storage) const = 0;
+    ///Retrieve active channels for many listeners at once
+    /**
+     * The list is the same as get_active_channels() of a listener which doesn't subscribe
+     * anything. A channel which has only one listener is not exported to that listener, so
+     * these channels are reported separately.
+     *
+     * Default implementation calls get_active_channels() for every listener, the bus can
+     * override it to compute the result in one pass
+     *
+     * @param storage object used as storage for channel data
+     * @param listeners listeners which need the list
+     * @param exclusive receives pairs of the only listener and index of its channel in the
+     * returned list. It contains at least pairs of the given listeners. The vector is ordered
+     * @return list of channels. List is always ordered (std::less<std::string>)
+     */
+    virtual ChannelList get_active_channels(ChannelListStorage &storage, std::span<const IListener * const> listeners,
+                                            std::vector<std::pair<const IListener *, std::size_t> > &exclusive) const {
+        auto lst = get_active_channels(nullptr, storage);
+        exclusive.clear();
+        ChannelListStorage tmp;
+        for (const IListener *l: listeners) {
+            //channels missing in the list of the listener are not exported to it
+            auto own = get_active_channels(l, tmp);
+            auto iter = own.begin();
+            for (std::size_t i = 0; i < lst.size(); ++i) {
+                while (iter != own.end() && *iter < lst[i]) ++iter;
+                if (iter == own.end() || *iter != lst[i]) exclusive.emplace_back(l, i);
+            }
+        }
+        std::sort(exclusive.begin(), exclusive.end());
+        return lst;
+    }
     ///Unsubscribe all channels subscribed to this listener
     /**
      *
@@ -8,7 +8,6 @@ BridgePipe::BridgePipe(Bus bus, std::shared_ptr<INetContext> ctx,
 ,_ctx(std::move(ctx))
 ,_h_read(read)
 ,_h_write(write) {
-    ready_to_send();
     ready_to_receive();
     BridgePipe::send(NewSession{});
     register_monitor(this);
@@ -81,28 +80,19 @@ std::string_view BridgePipe::parse_messages(const std::string_view &data) {
 }
 
 void BridgePipe::clear_to_send() noexcept {
-    bool ok = false;
-    {
-        std::lock_guard _(_mx);
-        _clear_to_send = true;
-        ok = flush_output();
-    }
-    if (!ok) on_disconnect();
+    //output is written by the write queue of the network context
 }
 
 void BridgePipe::on_timeout() noexcept {
-}
-
-void BridgePipe::ready_to_send() {
-    _ctx->ready_to_send(_h_write, this);
+    send_mine_channels();
 }
 
 void BridgePipe::ready_to_receive() {
-    _ctx->receive(_h_read, _input_buffer, this);
+    _ctx->receive(_h_read, this);
 }
 
 void BridgePipe::on_channels_update() noexcept {
-    _ctx->set_timeout(_h_read, std::chrono::system_clock::now(), this);
+    _ctx->set_timeout(_h_read, std::chrono::steady_clock::now(), this);
 }
 
 std::string_view BridgePipe::combine_input_before_parse(const std::string_view &data) {
@@ -116,22 +106,6 @@ std::string_view BridgePipe::combine_input_before_parse(const std::string_view &
     }
 }
 
-bool BridgePipe::flush_output() {
-    if (_output_buffer.empty()) return true;
-    if (!_clear_to_send) return false;
-    auto r = _ctx->send(_h_write, {_output_buffer.data(), _output_buffer.size()});
-    if (r == _output_buffer.size()) {
-        _output_buffer.clear();
-    } else if (r > 0){
-        _output_buffer.erase(_output_buffer.begin(), _output_buffer.begin()+r);
-    } else {
-        return false;
-    }
-    _clear_to_send = false;
-    ready_to_send();
-    return true;
-}
-
 void BridgePipe::combine_input_after_parse(const std::string_view &data) {
     if (_msg_tmp_buffer.size() < data.size()) {
         if (!data.empty()) {
@@ -145,10 +119,17 @@ void BridgePipe::combine_input_after_parse(const std::string_view &data) {
 }
 
 template<typename T> void BridgePipe::send_gen(const T &msg) {
-    std::lock_guard _(_mx);
-    auto str = _ser(msg);
-    Serialization::write_uint(std::back_inserter(_output_buffer), str.size());
-    std::copy(str.begin(), str.end(), std::back_inserter(_output_buffer));
-    flush_output();
+    bool ok;
+    {
+        std::lock_guard _(_mx);
+        auto str = _ser(msg);
+        //length and message are passed as two segments, the context
+        //writes them directly or queues what cannot be written now
+        char hdr[16];
+        auto hdr_end = Serialization::write_uint(hdr, str.size());
+        std::string_view segments[] = {{hdr, static_cast<std::size_t>(hdr_end - hdr)}, str};
+        ok = _ctx->write(_h_write, segments);
+    }
+    if (!ok) on_disconnect();
 }
 }
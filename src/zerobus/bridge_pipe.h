@@ -10,8 +10,6 @@ namespace zerobus {
 class BridgePipe: public AbstractBridge, public IPeer, public IMonitor {
 public:
 
-    static constexpr std::size_t _input_buffer_size = 4096;
-
     virtual void on_channels_update() noexcept override;
     BridgePipe(Bus bus, std::shared_ptr<INetContext> ctx,  ConnHandle read, ConnHandle write);
     ~BridgePipe();
@@ -85,18 +83,13 @@ protected:
     std::shared_ptr<INetContext> _ctx;
     ConnHandle _h_read;
     ConnHandle _h_write;
-    std::vector<char> _output_buffer;
-    char _input_buffer[_input_buffer_size];
     std::vector<char> _msg_tmp_buffer;
-    bool _clear_to_send = false;
     Serialization _ser;
     Deserialization _deser;
 
     std::mutex _mx;
 
-    void ready_to_send();
     void ready_to_receive();
-    bool flush_output();
     std::string_view combine_input_before_parse(const std::string_view &data);
     void combine_input_after_parse(const std::string_view &data);
     std::string_view parse_messages(const std::string_view &data);
@@ -0,0 +1,461 @@
+#include "bridge_shared_memory.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace zerobus {
+
+static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Lock-free 64-bit atomics are required");
+static_assert(std::atomic<std::uint32_t>::is_always_lock_free, "Lock-free 32-bit atomics are required");
+
+///header of one ring. Producer and consumer fields are on different cache lines
+struct BridgeSharedMemory::Ring {
+    alignas(64) std::atomic<std::uint64_t> head;            //write position, written by producer
+    std::atomic<std::uint32_t> producer_waiting;            //producer waits for free space
+    alignas(64) std::atomic<std::uint64_t> tail;            //read position, written by consumer
+    std::atomic<std::uint32_t> consumer_waiting;            //consumer waits for data
+};
+
+namespace {
+
+struct SegmentHeader {
+    std::uint32_t magic;
+    std::uint32_t version;
+    std::uint64_t ring_size;
+};
+
+constexpr std::uint32_t segment_magic = 0x7A627573;    //zbus
+constexpr std::uint32_t segment_version = 1;
+//layout: header, two rings, page aligned data of the first ring, data of the second ring
+constexpr std::size_t rings_offset = 64;
+constexpr std::size_t data_offset = 4096;
+
+//record: 32bit length, data, padding to 8 bytes
+constexpr std::uint32_t wrap_marker = 0xFFFFFFFF;       //rest of ring is unused, continue at beginning
+constexpr std::uint32_t more_fragments = 0x80000000;    //message continues in next record
+constexpr std::size_t record_header = sizeof(std::uint32_t);
+constexpr std::size_t record_align = 8;
+
+constexpr std::size_t record_size(std::size_t sz) {
+    return (record_header + sz + record_align - 1) & ~(record_align - 1);
+}
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#endif
+}
+
+int make_unix_address(std::string_view path, sockaddr_un &addr) {
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("Invalid unix socket path (empty or too long)");
+    }
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    std::copy(path.begin(), path.end(), addr.sun_path);
+    if (path.front() == '@') {
+        addr.sun_path[0] = 0;
+        return static_cast<int>(offsetof(sockaddr_un, sun_path) + path.size());
+    }
+    return static_cast<int>(offsetof(sockaddr_un, sun_path) + path.size() + 1);
+}
+
+void close_endpoint(BridgeSharedMemory::Endpoint &ep) {
+    for (int *fd: {&ep.memfd, &ep.doorbell, &ep.peer_doorbell, &ep.control}) {
+        if (*fd >= 0) ::close(*fd);
+        *fd = -1;
+    }
+}
+
+}
+
+static int dup_cloexec(int fd) {
+    int r = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+    if (r < 0) throw std::system_error(errno, std::system_category());
+    return r;
+}
+
+std::pair<BridgeSharedMemory::Endpoint, BridgeSharedMemory::Endpoint>
+BridgeSharedMemory::create_endpoints(std::size_t ring_size) {
+    ring_size = std::bit_ceil(std::max<std::size_t>(ring_size, 4096));
+    std::size_t total = data_offset + 2 * ring_size;
+    Endpoint a, b;
+    try {
+        a.memfd = memfd_create("zerobus", MFD_CLOEXEC);
+        if (a.memfd < 0) throw std::system_error(errno, std::system_category(), "memfd_create");
+        if (ftruncate(a.memfd, static_cast<off_t>(total)) < 0) {
+            throw std::system_error(errno, std::system_category(), "ftruncate");
+        }
+        void *p = mmap(nullptr, data_offset, PROT_READ|PROT_WRITE, MAP_SHARED, a.memfd, 0);
+        if (p == MAP_FAILED) throw std::system_error(errno, std::system_category(), "mmap");
+        //memory is zeroed, so rings are already initialized
+        auto hdr = reinterpret_cast<SegmentHeader *>(p);
+        hdr->magic = segment_magic;
+        hdr->version = segment_version;
+        hdr->ring_size = ring_size;
+        munmap(p, data_offset);
+        a.doorbell = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (a.doorbell < 0) throw std::system_error(errno, std::system_category(), "eventfd");
+        a.peer_doorbell = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+        if (a.peer_doorbell < 0) throw std::system_error(errno, std::system_category(), "eventfd");
+        b.memfd = dup_cloexec(a.memfd);
+        b.doorbell = dup_cloexec(a.peer_doorbell);
+        b.peer_doorbell = dup_cloexec(a.doorbell);
+        a.first = true;
+        b.first = false;
+    } catch (...) {
+        close_endpoint(a);
+        close_endpoint(b);
+        throw;
+    }
+    return {a, b};
+}
+
+BridgeSharedMemory::BridgeSharedMemory(Bus bus, std::shared_ptr<INetContext> ctx, Endpoint ep, unsigned int spin_count)
+:AbstractBridge(std::move(bus))
+,_ctx(std::move(ctx))
+,_spin_count(spin_count)
+,_control_peer(*this) {
+    static_assert(rings_offset + 2 * sizeof(Ring) <= data_offset);
+    try {
+        struct stat st;
+        if (fstat(ep.memfd, &st) < 0) throw std::system_error(errno, std::system_category(), "fstat");
+        _segment_size = static_cast<std::size_t>(st.st_size);
+        if (_segment_size < data_offset) throw std::invalid_argument("Invalid shared memory segment");
+        _segment = mmap(nullptr, _segment_size, PROT_READ|PROT_WRITE, MAP_SHARED, ep.memfd, 0);
+        if (_segment == MAP_FAILED) {
+            _segment = nullptr;
+            throw std::system_error(errno, std::system_category(), "mmap");
+        }
+        auto base = reinterpret_cast<char *>(_segment);
+        auto hdr = reinterpret_cast<const SegmentHeader *>(base);
+        _ring_size = static_cast<std::size_t>(hdr->ring_size);
+        if (hdr->magic != segment_magic || hdr->version != segment_version
+                || !std::has_single_bit(_ring_size) || data_offset + 2 * _ring_size != _segment_size) {
+            throw std::invalid_argument("Invalid shared memory segment");
+        }
+        auto rings = reinterpret_cast<Ring *>(base + rings_offset);
+        char *data[2] = {base + data_offset, base + data_offset + _ring_size};
+        int out = ep.first?0:1;
+        _output = rings + out;
+        _output_data = data[out];
+        _input = rings + (1 - out);
+        _input_data = data[1 - out];
+        _h_doorbell = _ctx->connect(SpecialConnection::descriptor, &ep.doorbell);
+        if (ep.control >= 0) {
+            _h_control = _ctx->connect(SpecialConnection::socket, &ep.control);
+        }
+    } catch (...) {
+        if (_h_doorbell != no_connection) _ctx->destroy(_h_doorbell);
+        if (_segment) munmap(_segment, _segment_size);
+        close_endpoint(ep);
+        throw;
+    }
+    _peer_doorbell = std::exchange(ep.peer_doorbell, -1);
+    close_endpoint(ep);
+    BridgeSharedMemory::send(NewSession{});
+    register_monitor(this);
+    if (_h_control != no_connection) {
+        _ctx->receive(_h_control, _control_buffer, &_control_peer);
+    }
+    process_input();
+}
+
+BridgeSharedMemory::~BridgeSharedMemory() {
+    unregister_monitor(this);
+    if (_h_control != no_connection) _ctx->destroy(_h_control);
+    _ctx->destroy(_h_doorbell);
+    munmap(_segment, _segment_size);
+    ::close(_peer_doorbell);
+}
+
+void BridgeSharedMemory::send(const AddToGroup &msg) noexcept {send_gen(msg);}
+void BridgeSharedMemory::send(const ChannelReset &msg) noexcept {send_gen(msg);}
+void BridgeSharedMemory::send(const GroupEmpty &msg) noexcept {send_gen(msg);}
+void BridgeSharedMemory::send(const ChannelUpdate &msg) noexcept {send_gen(msg);}
+void BridgeSharedMemory::send(const NewSession &msg) noexcept {send_gen(msg);}
+void BridgeSharedMemory::send(const CloseGroup &msg) noexcept {send_gen(msg);}
+void BridgeSharedMemory::send(const NoRoute &msg) noexcept  {send_gen(msg);}
+void BridgeSharedMemory::send(const Message &msg) noexcept  {send_gen(msg);}
+void BridgeSharedMemory::send(const UpdateSerial &msg) noexcept  {send_gen(msg);}
+
+template<typename T> void BridgeSharedMemory::send_gen(const T &msg) {
+    std::lock_guard _(_mx);
+    auto str = _ser(msg);
+    std::size_t written = 0;
+    if (flush_pending_lk()) written = write_some_lk(str);
+    if (written < str.size()) {
+        //store rest of the message, it is written when consumer frees space
+        auto rest = str.substr(written);
+        std::uint64_t sz = rest.size();
+        auto p = reinterpret_cast<const char *>(&sz);
+        _pending.insert(_pending.end(), p, p + sizeof(sz));
+        _pending.insert(_pending.end(), rest.begin(), rest.end());
+        wait_for_space_lk();
+    }
+    ring_doorbell();
+}
+
+std::size_t BridgeSharedMemory::write_some_lk(std::string_view data) {
+    const std::size_t mask = _ring_size - 1;
+    const std::size_t max_fragment = _ring_size / 4;
+    std::uint64_t head = _output->head.load(std::memory_order_relaxed);
+    std::uint64_t tail = _output->tail.load(std::memory_order_acquire);
+    std::size_t written = 0;
+    do {
+        std::size_t chunk = std::min(data.size() - written, max_fragment);
+        std::size_t need = record_size(chunk);
+        std::size_t pos = static_cast<std::size_t>(head & mask);
+        std::size_t contiguous = _ring_size - pos;
+        std::size_t skip = need > contiguous?contiguous:0;
+        if (_ring_size - (head - tail) < skip + need) {
+            tail = _output->tail.load(std::memory_order_acquire);
+            if (_ring_size - (head - tail) < skip + need) break;
+        }
+        if (skip) {
+            std::uint32_t m = wrap_marker;
+            std::memcpy(_output_data + pos, &m, sizeof(m));
+            head += skip;
+            pos = 0;
+        }
+        std::uint32_t len = static_cast<std::uint32_t>(chunk);
+        if (written + chunk < data.size()) len |= more_fragments;
+        std::memcpy(_output_data + pos, &len, sizeof(len));
+        std::memcpy(_output_data + pos + record_header, data.data() + written, chunk);
+        head += need;
+        written += chunk;
+        _output->head.store(head, std::memory_order_release);
+    } while (written < data.size());
+    return written;
+}
+
+bool BridgeSharedMemory::flush_pending_lk() {
+    std::size_t pos = 0;
+    bool done = true;
+    while (pos < _pending.size()) {
+        std::uint64_t sz;
+        std::memcpy(&sz, _pending.data() + pos, sizeof(sz));
+        std::string_view msg(_pending.data() + pos + sizeof(sz), static_cast<std::size_t>(sz));
+        auto written = write_some_lk(msg);
+        if (written < msg.size()) {
+            //keep unwritten part, update its size
+            pos += written;
+            sz -= written;
+            std::memcpy(_pending.data() + pos, &sz, sizeof(sz));
+            done = false;
+            break;
+        }
+        pos += sizeof(sz) + msg.size();
+    }
+    _pending.erase(_pending.begin(), _pending.begin() + pos);
+    return done;
+}
+
+void BridgeSharedMemory::wait_for_space_lk() {
+    _output->producer_waiting.store(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    //consumer could free space before it saw the flag
+    if (flush_pending_lk()) _output->producer_waiting.store(0, std::memory_order_relaxed);
+}
+
+void BridgeSharedMemory::ring_doorbell() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_output->consumer_waiting.load(std::memory_order_relaxed)
+            && _output->consumer_waiting.exchange(0, std::memory_order_relaxed)) {
+        eventfd_write(_peer_doorbell, 1);
+    }
+}
+
+void BridgeSharedMemory::process_input() {
+    const std::size_t mask = _ring_size - 1;
+    unsigned int spin = 0;
+    std::uint64_t tail = _input->tail.load(std::memory_order_relaxed);
+    while (true) {
+        std::uint64_t head = _input->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            if (spin < _spin_count) {
+                ++spin;
+                cpu_relax();
+                continue;
+            }
+            _input->consumer_waiting.store(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (_input->head.load(std::memory_order_acquire) == tail) break;
+            _input->consumer_waiting.store(0, std::memory_order_relaxed);
+            continue;
+        }
+        spin = 0;
+        std::size_t pos = static_cast<std::size_t>(tail & mask);
+        std::uint32_t len;
+        std::memcpy(&len, _input_data + pos, sizeof(len));
+        if (len == wrap_marker) {
+            tail += _ring_size - pos;
+        } else {
+            std::size_t sz = len & ~more_fragments;
+            std::string_view data(_input_data + pos + record_header, sz);
+            if ((len & more_fragments) || !_fragments.empty()) {
+                _fragments.insert(_fragments.end(), data.begin(), data.end());
+                if (!(len & more_fragments)) {
+                    std::visit([&](const auto &x){receive(x);},
+                            _deser(std::string_view(_fragments.data(), _fragments.size())));
+                    _fragments.clear();
+                }
+            } else {
+                //deserialize directly from the ring, space is released after processing
+                std::visit([&](const auto &x){receive(x);}, _deser(data));
+            }
+            tail += record_size(sz);
+        }
+        _input->tail.store(tail, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_input->producer_waiting.load(std::memory_order_relaxed)
+                && _input->producer_waiting.exchange(0, std::memory_order_relaxed)) {
+            eventfd_write(_peer_doorbell, 1);
+        }
+    }
+    _ctx->receive(_h_doorbell, {reinterpret_cast<char *>(&_doorbell_buffer), sizeof(_doorbell_buffer)}, this);
+}
+
+void BridgeSharedMemory::receive_complete(std::string_view data) noexcept {
+    if (data.empty()) {
+        on_disconnect();
+        return;
+    }
+    {
+        std::lock_guard _(_mx);
+        //woken up by consumer, which freed space
+        if (!_pending.empty()) {
+            if (!flush_pending_lk()) wait_for_space_lk();
+            ring_doorbell();
+        }
+    }
+    process_input();
+}
+
+void BridgeSharedMemory::ControlPeer::receive_complete(std::string_view data) noexcept {
+    if (data.empty()) {
+        _owner.on_disconnect();
+    } else {
+        _owner._ctx->receive(_owner._h_control, _owner._control_buffer, this);
+    }
+}
+
+void BridgeSharedMemory::on_timeout() noexcept {
+    send_mine_channels();
+}
+
+void BridgeSharedMemory::on_channels_update() noexcept {
+    _ctx->set_timeout(_h_doorbell, std::chrono::steady_clock::now(), this);
+}
+
+int BridgeSharedMemory::listen(std::string_view path) {
+    sockaddr_un addr;
+    int len = make_unix_address(path, addr);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::system_error(errno, std::system_category(), "socket");
+    if (addr.sun_path[0]) ::unlink(addr.sun_path);
+    if (::bind(fd, reinterpret_cast<const sockaddr *>(&addr), static_cast<socklen_t>(len)) < 0
+            || ::listen(fd, SOMAXCONN) < 0) {
+        int e = errno;
+        ::close(fd);
+        throw std::system_error(e, std::system_category(), "Failed to listen on socket");
+    }
+    return fd;
+}
+
+BridgeSharedMemory BridgeSharedMemory::accept(Bus bus, std::shared_ptr<INetContext> ctx, int listen_socket,
+        std::size_t ring_size, unsigned int spin_count) {
+    int conn = ::accept4(listen_socket, nullptr, nullptr, SOCK_CLOEXEC);
+    if (conn < 0) throw std::system_error(errno, std::system_category(), "accept");
+    std::pair<Endpoint, Endpoint> eps;
+    try {
+        eps = create_endpoints(ring_size);
+    } catch (...) {
+        ::close(conn);
+        throw;
+    }
+    auto &[mine, theirs] = eps;
+    //pass descriptors of other side, the byte carries the ring selector
+    char flag = theirs.first?1:0;
+    iovec iov = {&flag, 1};
+    int fds[3] = {theirs.memfd, theirs.doorbell, theirs.peer_doorbell};
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    cm->cmsg_level = SOL_SOCKET;
+    cm->cmsg_type = SCM_RIGHTS;
+    cm->cmsg_len = CMSG_LEN(sizeof(fds));
+    std::memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+    auto r = ::sendmsg(conn, &msg, MSG_NOSIGNAL);
+    int e = errno;
+    close_endpoint(theirs);
+    if (r < 0) {
+        ::close(conn);
+        close_endpoint(mine);
+        throw std::system_error(e, std::system_category(), "sendmsg");
+    }
+    mine.control = conn;
+    return BridgeSharedMemory(std::move(bus), std::move(ctx), mine, spin_count);
+}
+
+BridgeSharedMemory BridgeSharedMemory::connect(Bus bus, std::shared_ptr<INetContext> ctx, std::string_view path,
+        unsigned int spin_count) {
+    sockaddr_un addr;
+    int len = make_unix_address(path, addr);
+    int fd = ::socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+    if (fd < 0) throw std::system_error(errno, std::system_category(), "socket");
+    if (::connect(fd, reinterpret_cast<const sockaddr *>(&addr), static_cast<socklen_t>(len)) < 0) {
+        int e = errno;
+        ::close(fd);
+        throw std::system_error(e, std::system_category(), "Failed to connect");
+    }
+    char flag = 0;
+    iovec iov = {&flag, 1};
+    int fds[3];
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(fds))] = {};
+    msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    auto r = ::recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    int e = errno;
+    cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+    if (r <= 0 || !cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS
+            || cm->cmsg_len != CMSG_LEN(sizeof(fds))) {
+        if (cm && cm->cmsg_type == SCM_RIGHTS) {
+            std::size_t n = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            std::memcpy(fds, CMSG_DATA(cm), std::min(n, std::size(fds)) * sizeof(int));
+            for (std::size_t i = 0; i < std::min(n, std::size(fds)); ++i) ::close(fds[i]);
+        }
+        ::close(fd);
+        if (r < 0) throw std::system_error(e, std::system_category(), "recvmsg");
+        throw std::invalid_argument("Invalid shared memory handshake");
+    }
+    std::memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+    Endpoint ep;
+    ep.memfd = fds[0];
+    ep.doorbell = fds[1];
+    ep.peer_doorbell = fds[2];
+    ep.control = fd;
+    ep.first = flag != 0;
+    return BridgeSharedMemory(std::move(bus), std::move(ctx), ep, spin_count);
+}
+
+}
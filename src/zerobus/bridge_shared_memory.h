@@ -0,0 +1,175 @@
+#pragma once
+
+#include "bridge.h"
+#include "serialization.h"
+#include "network.h"
+
+#include <atomic>
+#include <mutex>
+namespace zerobus {
+
+///Bridge which connects two buses on the same host through shared memory
+/**
+ * Both sides share a memory segment (memfd) with two single-producer
+ * single-consumer ring buffers, one for each direction. Messages use the same
+ * wire format as BridgePipe (length + serialized message), the receiving side
+ * deserializes them directly from the ring without copying. Each side has
+ * an eventfd as a doorbell. A side rings the doorbell of the other side only
+ * when the other side is going to sleep (waiting for data or for free space),
+ * so under load no system call is needed to transfer a message.
+ *
+ * Connection between processes is established over unix socket. The
+ * server creates the segment and the doorbells and passes them to the client
+ * using SCM_RIGHTS. The unix socket is kept open to detect that the other
+ * side has exited.
+ *
+ * @note available only on Linux
+ */
+class BridgeSharedMemory: public AbstractBridge, public IPeer, public IMonitor {
+public:
+
+    ///default size of one ring buffer
+    static constexpr std::size_t default_ring_size = 1024*1024;
+
+    ///descriptors of one side of the bridge
+    /** The bridge takes ownership of all descriptors */
+    struct Endpoint {
+        ///memfd of shared segment
+        int memfd = -1;
+        ///eventfd which wakes up this side
+        int doorbell = -1;
+        ///eventfd which wakes up other side
+        int peer_doorbell = -1;
+        ///connected unix socket used to detect disconnect (optional)
+        int control = -1;
+        ///selects ring used for sending (the other side uses the other ring)
+        bool first = true;
+    };
+
+    ///create shared segment and both endpoints
+    /**
+     * @param ring_size size of one ring buffer in bytes. It is rounded up to power of two
+     * @return pair of endpoints. Each endpoint is used to construct one side of the bridge
+     */
+    static std::pair<Endpoint, Endpoint> create_endpoints(std::size_t ring_size = default_ring_size);
+
+    ///construct the bridge
+    /**
+     * @param bus bus instance
+     * @param ctx network context, used to wait on doorbell
+     * @param ep endpoint (ownership is transfered)
+     * @param spin_count count of iterations the receiving side polls the ring
+     * before it goes to sleep. Nonzero value reduces latency and count of wakeups
+     * for the cost of CPU time of IO thread
+     */
+    BridgeSharedMemory(Bus bus, std::shared_ptr<INetContext> ctx, Endpoint ep, unsigned int spin_count = 0);
+    ~BridgeSharedMemory();
+
+    BridgeSharedMemory(const BridgeSharedMemory &) = delete;
+    BridgeSharedMemory &operator=(const BridgeSharedMemory &) = delete;
+
+    ///create unix socket to accept shared memory bridges
+    /**
+     * @param path path of unix socket. Use @name for abstract namespace
+     * @return listening socket
+     * @exception std::system_error
+     */
+    static int listen(std::string_view path);
+
+    ///accept a process connecting to the listening socket
+    /**
+     * Function blocks until connection is made. Then it creates shared segment
+     * and sends the descriptors to the other side
+     *
+     * @param bus bus instance
+     * @param ctx network context
+     * @param listen_socket socket created by listen()
+     * @param ring_size size of one ring buffer
+     * @param spin_count see constructor
+     * @return bridge instance
+     * @exception std::system_error
+     */
+    static BridgeSharedMemory accept(Bus bus, std::shared_ptr<INetContext> ctx, int listen_socket,
+            std::size_t ring_size = default_ring_size, unsigned int spin_count = 0);
+
+    ///connect to the process listening on unix socket
+    /**
+     * @param bus bus instance
+     * @param ctx network context
+     * @param path path of unix socket. Use @name for abstract namespace
+     * @param spin_count see constructor
+     * @return bridge instance
+     * @exception std::system_error
+     */
+    static BridgeSharedMemory connect(Bus bus, std::shared_ptr<INetContext> ctx, std::string_view path,
+            unsigned int spin_count = 0);
+
+    virtual void on_channels_update() noexcept override;
+
+protected:
+    virtual void send(const AddToGroup&msg) noexcept override;
+    virtual void send(const ChannelReset&msg) noexcept override;
+    virtual void send(const GroupEmpty&msg) noexcept override;
+    virtual void send(const ChannelUpdate &msg) noexcept override;
+    virtual void send(const NewSession&msg) noexcept override;
+    virtual void send(const CloseGroup&msg) noexcept override;
+    virtual void send(const NoRoute&msg) noexcept override;
+    virtual void send(const Message &msg) noexcept override;
+    virtual void send(const UpdateSerial&msg) noexcept override;
+
+    virtual void receive_complete(std::string_view data) noexcept override;
+    virtual void clear_to_send() noexcept override {}
+    virtual void on_timeout() noexcept override;
+
+    ///called when other side disconnects (control socket is closed)
+    virtual void on_disconnect() noexcept {}
+
+protected:
+
+    struct Ring;
+
+    ///receives EOF on control socket
+    class ControlPeer: public IPeer {
+    public:
+        ControlPeer(BridgeSharedMemory &owner):_owner(owner) {}
+        virtual void receive_complete(std::string_view data) noexcept override;
+        virtual void clear_to_send() noexcept override {}
+        virtual void on_timeout() noexcept override {}
+    protected:
+        BridgeSharedMemory &_owner;
+    };
+
+    std::shared_ptr<INetContext> _ctx;
+    void *_segment = nullptr;
+    std::size_t _segment_size = 0;
+    Ring *_output = nullptr;
+    Ring *_input = nullptr;
+    char *_output_data = nullptr;
+    char *_input_data = nullptr;
+    std::size_t _ring_size = 0;
+    int _peer_doorbell = -1;
+    ConnHandle _h_doorbell = no_connection;
+    ConnHandle _h_control = no_connection;
+    unsigned int _spin_count;
+    ControlPeer _control_peer;
+    std::uint64_t _doorbell_buffer = 0;
+    char _control_buffer[16];
+
+    Serialization _ser;
+    Deserialization _deser;
+    std::vector<char> _pending;         //serialized messages which didn't fit to the ring
+    std::vector<char> _fragments;       //collects fragments of large message
+    std::mutex _mx;
+
+    void ring_doorbell();
+    bool flush_pending_lk();
+    void wait_for_space_lk();
+    std::size_t write_some_lk(std::string_view data);
+    void process_input();
+    using AbstractBridge::receive;
+    void receive(const  Deserialization::UserMsg &) {}
+    template<typename T> void send_gen(const T &msg);
+};
+
+
+}
@@ -4,9 +4,9 @@
 namespace zerobus {
 
 
-BridgeTCPClient::BridgeTCPClient(Bus bus, std::shared_ptr<INetContext> ctx, std::string address)
+BridgeTCPClient::BridgeTCPClient(Bus bus, std::shared_ptr<INetContext> ctx, std::string address, const SocketOptions &opts)
 :BridgeTCPClient(std::move(bus)) {
-    bind(std::move(ctx), std::move(address));
+    bind(std::move(ctx), std::move(address), opts);
 }
 
 
@@ -35,8 +35,8 @@ BridgeTCPClient::~BridgeTCPClient() {
     _destructor_called = true;
 }
 
-void BridgeTCPClient::bind(std::shared_ptr<INetContext> ctx, std::string address) {
-    BridgeTCPCommon::bind(ctx, ctx->connect(get_address_from_url(address)));
+void BridgeTCPClient::bind(std::shared_ptr<INetContext> ctx, std::string address, const SocketOptions &opts) {
+    BridgeTCPCommon::bind(ctx, ctx->connect(get_address_from_url(address), opts));
     _address = address;
     register_monitor(this);
     send(NewSession{});
@@ -74,13 +74,13 @@ void BridgeTCPClient::lost_connection() {
         _ctx->ready_to_send(_aux, this);
     } catch (...) {
         _timeout_reconnect = true;
-        _ctx->set_timeout(_aux, std::chrono::system_clock::now()+std::chrono::seconds(2), this);
+        _ctx->set_timeout(_aux, std::chrono::steady_clock::now()+std::chrono::seconds(2), this);
     }
 
 }
 
 void BridgeTCPClient::on_channels_update() noexcept {
-    _ctx->set_timeout(_aux, std::chrono::system_clock::time_point::min(), this);
+    _ctx->set_timeout(_aux, std::chrono::steady_clock::time_point::min(), this);
 }
 
 
@@ -107,9 +107,12 @@ bool BridgeTCPClient::send_handshake() {
     if (path.empty() || path.back() != '/') path.push_back('/');
     path.append(_session_id);
 
+    std::string host = get_address_from_url(_address);
+    if (host.substr(0, 5) == "unix:") host = "localhost";
+
     std::ostringstream hdr;
     hdr << "GET " << path << " HTTP/1.1\r\n"
-           "Host: " << get_address_from_url(_address) << "\r\n"
+           "Host: " << host << "\r\n"
            "Upgrade: websocket\r\n"
            "Connection: Upgrade\r\n"
            "Sec-WebSocket-Key: " << key << "\r\n"
@@ -135,7 +138,7 @@ void BridgeTCPClient::receive_complete(std::string_view data) noexcept {
         _input_data.clear();
         if (check_ws_response(whole_hdr)) {
             _handshake = false;
-            if (_send_reset_on_connect) send(ChannelReset{});
+            if (_send_reset_on_connect) resync_channels();
             _ctx->ready_to_send(_aux, this);
             if (rest.empty()) {
                 read_from_connection();
@@ -16,9 +16,9 @@ public:
      * @param bus local end of the bus
      * @param ctx network context
      * @param address server's address:port
-     * @param acb optional a callback which is called when authentication is requested
+     * @param opts socket options
      */
-    BridgeTCPClient(Bus bus, std::shared_ptr<INetContext> ctx, std::string address);
+    BridgeTCPClient(Bus bus, std::shared_ptr<INetContext> ctx, std::string address, const SocketOptions &opts = {});
     ///construct the client
     /**
      *
@@ -41,7 +41,13 @@ public:
 
     void set_linger_timeout(std::size_t timeout_ms);
 
-    void bind(std::shared_ptr<INetContext> ctx, std::string address);
+    ///connect the bridge
+    /**
+     * @param ctx network context
+     * @param address server's address:port or ws:// url
+     * @param opts socket options. They are also used when the bridge reconnects
+     */
+    void bind(std::shared_ptr<INetContext> ctx, std::string address, const SocketOptions &opts = {});
 
 protected:
 
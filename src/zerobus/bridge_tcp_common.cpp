@@ -10,11 +10,6 @@ namespace zerobus {
 
 thread_local Serialization BridgeTCPCommon::_ser = {};
 
-static std::condition_variable &get_shared_cond_var() {
-    static std::condition_variable cond;
-    return cond;
-}
-
 BridgeTCPCommon::BridgeTCPCommon(Bus bus, bool client_masking)
 :AbstractBridge(std::move(bus))
 ,_ws_builder(client_masking)
@@ -44,8 +39,8 @@ BridgeTCPCommon::~BridgeTCPCommon() {
 
 void BridgeTCPCommon::clear_to_send() noexcept {
     std::unique_lock lk(_mx);
-    if (!_output_data.empty())  {
-        auto s = _ctx->send(_aux, get_view_to_send());
+    if (!_output.empty())  {
+        auto s = send_output();
         if (s == 0) {
             lk.unlock();
             lost_connection();
@@ -53,68 +48,75 @@ void BridgeTCPCommon::clear_to_send() noexcept {
         } else {
             if (after_send(s)) {
                 _ctx->ready_to_send(_aux, this);
+                notify_writable(lk);
                 return;
             }
         }
     }
     _output_allowed = true;
+    notify_writable(lk);
 }
 
 
 
 bool BridgeTCPCommon::after_send(std::size_t sz) {
-    // - _output_msg_sp contain message seaprators, indices to _ouput_data where messages begins
-    // - if this buffer is empty, this is invalid operation, so return false (nothing to do)
-    if (_output_msg_sp.empty()) return false;
+    //nothing queued, nothing to do
+    if (_output_frames_head == _output_frames.size()) return false;
 
-    //write finished signal
-    get_shared_cond_var().notify_all();
-    // increase position of output cursor
     _output_cursor += sz;
-    // if we reached end, writing is done
-    if (_output_cursor == _output_data.size()) {
-        //reset cursor
-        _output_cursor = 0;
-        //clear separators
-        _output_msg_sp.clear();
-        //clear data
-        _output_data.clear();
-        //no more write is needed
-        return false;
+    //drop complete frames, the partially sent frame stays in the queue,
+    //so it can be sent again from beginning after reconnect
+    while (_output_frames_head < _output_frames.size() && _output_cursor >= _output_frames[_output_frames_head]) {
+        auto fsz = _output_frames[_output_frames_head++];
+        _output.consume(fsz);
+        _output_cursor -= fsz;
     }
+    if (_output_frames_head == _output_frames.size()) {
+        _output_frames.clear();
+        _output_frames_head = 0;
+    } else if (_output_frames_head > _output_frames.size() / 2) {
+        //compact sizes, amortized O(1) per frame
+        _output_frames.erase(_output_frames.begin(), _output_frames.begin() + _output_frames_head);
+        _output_frames_head = 0;
+    }
+    //wake threads blocked on high water mark of this bridge
+    if (_hwm_waiters && get_pending_size() <= _hwm) _hwm_cond.notify_all();
+    return !_output_frames.empty();
+}
 
-    //so some data not been written
-    //find index which messages has been send complete
-    //find index which is greater then cursor (end of next message)
-    //this can return end (last message)
-    auto iter = std::upper_bound(_output_msg_sp.begin(), _output_msg_sp.end(), _output_cursor);
-    //decrease iterator, so we pointing to offset of incomplete message
-    --iter;
-    //retrieve its offset
-    auto pos = *iter;
-    //if nonzero offset
-    if (pos) {
-        auto t = _output_msg_sp.begin();
-        //erase and shift while recalculating separators removing complete message
-        //the first separator is always zero
-        while (iter != _output_msg_sp.end()) {
-            *t = *iter - pos;
-            ++iter;
-            ++t;
-        }
-        //erase anything left
-        _output_msg_sp.erase(t, _output_msg_sp.end());
-        //erase complete messages
-        _output_data.erase(_output_data.begin(), _output_data.begin()+pos);
-        //update cursor to point to current message and already send offset
-        _output_cursor-=pos;
+std::size_t BridgeTCPCommon::send_output() {
+    std::string_view segs[max_send_segments];
+    auto cnt = _output.gather(segs);
+    //skip data already sent
+    std::size_t skip = _output_cursor;
+    std::size_t first = 0;
+    while (first < cnt && skip >= segs[first].size()) {
+        skip -= segs[first].size();
+        ++first;
     }
-    return true; //we still need continue in sending
+    if (first == cnt) return 0;
+    segs[first] = segs[first].substr(skip);
+    return _ctx->send(_aux, std::span<const std::string_view>(segs + first, cnt - first));
 }
 
-std::string_view BridgeTCPCommon::get_view_to_send() const {
-    //retrieves output data with offset of _output_cursor
-    return std::string_view(_output_data.data()+_output_cursor, _output_data.size()-_output_cursor);
+void BridgeTCPCommon::release_idle_buffers() {
+    std::lock_guard _(_mx);
+    if (!_output.empty()) return;
+    _output.release();
+    std::vector<std::size_t>().swap(_output_frames);
+    std::vector<char>().swap(_header_data);
+}
+
+void BridgeTCPCommon::push_frame(std::string_view data) {
+    _output.append(data);
+    _output_frames.push_back(data.size());
+}
+
+void BridgeTCPCommon::push_frame(std::string_view header, std::string_view payload, std::shared_ptr<const void> owner) {
+    _output.append(header);
+    if (owner) _output.append(payload, std::move(owner));
+    else _output.append(payload);
+    _output_frames.push_back(header.size() + payload.size());
 }
 
 
@@ -127,23 +129,24 @@ void BridgeTCPCommon::deserialize_message(const std::string_view &msg) {
 void BridgeTCPCommon::receive_complete(std::string_view data) noexcept {
     if (data.empty()) {
         //function is called with empty string when disconnect happened
-        lost_connection();
+        if (!offload_disconnect(&BridgeTCPCommon::lost_connection)) lost_connection();
     } else {
         while (_ws_parser.push_data(data)) {
             ws::Message msg = _ws_parser.get_message();
             switch (msg.type) {
                 case ws::Type::binary:
-                    deserialize_message(msg.payload);
+                    if (!offload_message(msg.payload)) deserialize_message(msg.payload);
                     break;
                 case ws::Type::ping:
                     output_message(ws::Message{msg.payload, ws::Type::pong});
                     break;
                 case ws::Type::pong:
+                    on_pong(msg.payload);
                     break;
                 case ws::Type::connClose:
                     output_message(ws::Message{"", ws::Type::connClose, _ws_builder.closeNormal});
                     _ws_parser.reset();
-                    close();
+                    if (!offload_disconnect(&BridgeTCPCommon::close)) close();
                     return;
                 default:    //ignore unknown message
                     break;
@@ -151,41 +154,213 @@ void BridgeTCPCommon::receive_complete(std::string_view data) noexcept {
             data = _ws_parser.get_unused_data();
             _ws_parser.reset();
         }
-        //request read from network
-        read_from_connection();
+        //request read from network, unless workers are full
+        if (!pause_reading()) read_from_connection();
+    }
+
+}
+
+void BridgeTCPCommon::set_dispatch_pool(std::shared_ptr<INetContext> workers, std::size_t max_inflight) {
+    std::lock_guard _(_mx);
+    if (!_strand_state) {
+        if (!workers) return;
+        _strand_state = std::make_shared<DispatchStrand>();
+        _strand_state->owner = this;
+    }
+    {
+        std::lock_guard _(_strand_state->mx);
+        _strand_state->workers = std::move(workers);
+        _strand_state->max_inflight = max_inflight;
+    }
+    _strand.store(_strand_state.get(), std::memory_order_release);
+}
+
+bool BridgeTCPCommon::offload_message(std::string_view msg) {
+    auto st = _strand.load(std::memory_order_acquire);
+    if (!st) return false;
+    std::lock_guard _(st->mx);
+    //without pool, the message is processed here, unless older messages are still queued
+    if (!st->workers && !st->scheduled) return false;
+    //payload is valid only during the callback, so it must be copied
+    st->frames.emplace_back(msg);
+    st->inflight += msg.size();
+    if (!st->scheduled) {
+        st->scheduled = true;
+        st->keep_alive = _strand_state;
+        st->workers->post([st]{run_strand(st);});
+    }
+    return true;
+}
+
+bool BridgeTCPCommon::offload_disconnect(void (BridgeTCPCommon::*fn)()) {
+    auto st = _strand.load(std::memory_order_acquire);
+    if (!st) return false;
+    std::lock_guard _(st->mx);
+    //frames received before the disconnect are dispatched first
+    if (!st->scheduled) return false;
+    st->disconnect = fn;
+    return true;
+}
+
+bool BridgeTCPCommon::pause_reading() {
+    auto st = _strand.load(std::memory_order_acquire);
+    if (!st) return false;
+    std::lock_guard _(st->mx);
+    if (!st->max_inflight || st->inflight < st->max_inflight) return false;
+    //reading is resumed by the worker
+    st->read_paused = true;
+    return true;
+}
+
+void BridgeTCPCommon::run_strand(DispatchStrand *st) noexcept {
+    std::unique_lock lk(st->mx);
+    for (unsigned int i = 0; i < strand_batch || !st->workers; ++i) {
+        if (st->owner && st->frames.empty() && st->disconnect) {
+            auto owner = st->owner;
+            auto fn = std::exchange(st->disconnect, nullptr);
+            st->running = true;
+            st->runner = std::this_thread::get_id();
+            lk.unlock();
+            (owner->*fn)();
+            lk.lock();
+            st->running = false;
+            st->cond.notify_all();
+        }
+        if (!st->owner || st->frames.empty()) {
+            st->scheduled = false;
+            //the state can be released with the last reference
+            auto keep = std::move(st->keep_alive);
+            lk.unlock();
+            return;
+        }
+        auto owner = st->owner;
+        auto frame = std::move(st->frames.front());
+        st->frames.pop_front();
+        st->running = true;
+        st->runner = std::this_thread::get_id();
+        lk.unlock();
+        owner->deserialize_message(frame);
+        lk.lock();
+        st->running = false;
+        st->inflight -= frame.size();
+        //resume reading at half of the limit, so it is not paused after every message
+        if (st->read_paused && st->owner && st->inflight <= st->max_inflight / 2) {
+            st->read_paused = false;
+            owner->read_from_connection();
+        }
+        st->cond.notify_all();
     }
+    //give other strands a chance, continue in a new task
+    st->workers->post([st]{run_strand(st);});
+}
 
+void BridgeTCPCommon::stop_dispatch() {
+    auto st = _strand.load(std::memory_order_acquire);
+    if (!st) return;
+    std::unique_lock lk(st->mx);
+    st->owner = nullptr;
+    st->frames.clear();
+    st->inflight = 0;
+    st->disconnect = nullptr;
+    //wait for the message being processed, unless the bridge is destroyed by its handler
+    st->cond.wait(lk, [&]{return !st->running || st->runner == std::this_thread::get_id();});
 }
 
 
 void BridgeTCPCommon::destroy() {
+    stop_dispatch();
+    if (auto g = _flush_guard.get()) {
+        //wait for running deferred flush, unless the bridge is destroyed by its callback
+        std::unique_lock lk(g->mx);
+        g->owner = nullptr;
+        g->cond.wait(lk, [&]{return !g->running || g->runner == std::this_thread::get_id();});
+    }
     if (!_destroyed) {
         _destroyed = true;
         _ctx->destroy(_aux);
     }
 }
 void BridgeTCPCommon::read_from_connection() {
-    _ctx->receive(_aux, _input_buffer, this);
+    _ctx->receive(_aux, this);
 }
 
 bool BridgeTCPCommon::block_hwm(std::unique_lock<std::mutex> &lk) {
-    if (get_view_to_send().size() > _hwm) {
-        auto expires = std::chrono::system_clock::now()+std::chrono::milliseconds(_hwm_timeout);
-        while (get_view_to_send().size() > _hwm) {
-            if (get_shared_cond_var().wait_until(lk, expires) == std::cv_status::timeout)
-                return false;
-        }
+    if (get_pending_size() > _hwm) {
+        auto expires = std::chrono::steady_clock::now()+std::chrono::milliseconds(_hwm_timeout);
+        ++_hwm_waiters;
+        bool ok = _hwm_cond.wait_until(lk, expires, [&]{return get_pending_size() <= _hwm;});
+        --_hwm_waiters;
+        return ok;
     }
     return true;
 }
 
-void BridgeTCPCommon::output_message(const ws::Message &msg) {
+std::size_t BridgeTCPCommon::get_send_credit_lk() const {
+    auto pending = get_pending_size();
+    return pending < _hwm?_hwm - pending:0;
+}
+
+std::size_t BridgeTCPCommon::get_send_credit() {
+    std::lock_guard _(_mx);
+    return get_send_credit_lk();
+}
+
+bool BridgeTCPCommon::on_writable(std::size_t credit, std::function<void()> cb) {
+    std::lock_guard _(_mx);
+    credit = std::min(credit, _hwm);
+    if (get_send_credit_lk() >= credit) return false;
+    _writable_cbs.emplace_back(credit, std::move(cb));
+    return true;
+}
+
+void BridgeTCPCommon::notify_writable(std::unique_lock<std::mutex> &lk) {
+    if (_writable_cbs.empty()) return;
+    auto credit = get_send_credit_lk();
+    std::vector<std::function<void()> > ready;
+    std::erase_if(_writable_cbs, [&](auto &w){
+        if (credit < w.first) return false;
+        ready.push_back(std::move(w.second));
+        return true;
+    });
+    if (ready.empty()) return;
+    lk.unlock();
+    for (auto &cb: ready) cb();
+    lk.lock();
+}
+
+void BridgeTCPCommon::output_message(const ws::Message &msg, std::shared_ptr<const void> owner) {
     std::unique_lock lk(_mx);
     if (_handshake) return; //can't send message when handshake
     if (!block_hwm(lk)) return;
-    _output_msg_sp.push_back(_output_data.size());
-    _ws_builder.build(msg, _output_data);
-    flush_buffer();
+    _header_data.clear();
+    bool delay = delay_flush(msg.payload.size());
+    if (_ws_builder.build_header(msg, _header_data)) {
+        std::string_view hdr(_header_data.data(), _header_data.size());
+        if (!delay && _output_allowed && _output.empty()) {
+            //fast path - header and payload are sent as two segments without copying
+            std::string_view segments[] = {hdr, msg.payload};
+            auto s = owner?_ctx->send(_aux, segments, owner):_ctx->send(_aux, segments);
+            if (s < hdr.size() + msg.payload.size()) {
+                //keep the whole frame, the cursor skips the part already sent
+                push_frame(hdr, msg.payload, std::move(owner));
+                after_send(s);
+            }
+            _output_allowed = false;
+            _ctx->ready_to_send(_aux, this);
+            return;
+        }
+        //payload with owner is queued without copying
+        push_frame(hdr, msg.payload, std::move(owner));
+    } else {
+        //masked frame (client) is built whole, the buffer is reused
+        _header_data.clear();
+        if (!_ws_builder.build(msg, _header_data)) return;
+        push_frame({_header_data.data(), _header_data.size()});
+    }
+    if (!delay) {
+        flush_buffer();
+        notify_writable(lk);
+    }
 
 }
 void BridgeTCPCommon::output_message(std::string_view data) {
@@ -196,9 +371,75 @@ void BridgeTCPCommon::output_message(std::string_view data) {
 void BridgeTCPCommon::on_timeout() noexcept {
 }
 
+bool BridgeTCPCommon::delay_flush(std::size_t frame_size) {
+    if (!_coalescing.enabled()) return false;
+    if (get_pending_size() + frame_size >= _coalescing.threshold) return false;
+    auto now = std::chrono::steady_clock::now();
+    auto delay = std::chrono::duration_cast<std::chrono::nanoseconds>(_coalescing.max_delay);
+    if (_coalescing.adaptive) {
+        //exponential moving average of gaps between messages (alpha = 1/8)
+        auto gap = std::min<std::chrono::nanoseconds>(now - _last_output, std::chrono::seconds(1));
+        _last_output = now;
+        _output_gap += (gap - _output_gap) / 8;
+        if (_output_gap >= delay) return false;
+        //wait for few next messages
+        delay = std::min(delay, _output_gap * 8);
+    }
+    if (_flush_scheduled) return true;
+    if (_coalescing.end_of_burst) {
+        //flushed when the IO thread finishes current batch of callbacks
+        FlushGuard *g = _flush_guard.get();
+        {
+            std::lock_guard _(g->mx);
+            if (!g->pending++) g->keep_alive = _flush_guard;
+        }
+        _ctx->defer([g]{run_deferred_flush(g);});
+    } else if (!_ctx->set_timer(_aux, now + delay, [this]{delayed_flush();})) {
+        //connection is gone, nothing would flush the data later
+        return false;
+    }
+    _flush_scheduled = true;
+    return true;
+}
+
+void BridgeTCPCommon::run_deferred_flush(FlushGuard *g) noexcept {
+    std::unique_lock lk(g->mx);
+    if (auto owner = g->owner) {
+        g->running = true;
+        g->runner = std::this_thread::get_id();
+        lk.unlock();
+        owner->delayed_flush();
+        lk.lock();
+        g->running = false;
+        g->cond.notify_all();
+    }
+    if (--g->pending == 0) {
+        //the state can be released with the last reference
+        auto keep = std::move(g->keep_alive);
+        lk.unlock();
+        return;
+    }
+}
+
+void BridgeTCPCommon::delayed_flush() {
+    std::unique_lock lk(_mx);
+    _flush_scheduled = false;
+    if (!_output.empty()) flush_buffer();
+    notify_writable(lk);
+}
+
+void BridgeTCPCommon::set_coalescing(const CoalescingPolicy &policy) {
+    std::lock_guard _(_mx);
+    _coalescing = policy;
+    if (policy.end_of_burst && !_flush_guard) {
+        _flush_guard = std::make_shared<FlushGuard>();
+        _flush_guard->owner = this;
+    }
+}
+
 void BridgeTCPCommon::flush_buffer() {
     if (_output_allowed) {
-        auto s = _ctx->send(_aux, get_view_to_send());
+        auto s = send_output();
         after_send(s);
         _output_allowed = false;
         _ctx->ready_to_send(_aux, this);
@@ -210,6 +451,12 @@ void BridgeTCPCommon::flush_buffer() {
 
 
 std::string BridgeTCPCommon::get_address_from_url(std::string_view url) {
+    if (url.substr(0, ws_unix_scheme.size()) == ws_unix_scheme) {
+        //ws+unix:/path/to/socket:/request/path
+        url = url.substr(ws_unix_scheme.size());
+        if (url.substr(0, 2) == "//") url = url.substr(2);
+        return "unix:" + std::string(url.substr(0, url.find(':')));
+    }
     if (url.substr(0, 5) != "ws://") return std::string(url);
     url = url.substr(5);
     auto pos = url.find('/');
@@ -221,8 +468,12 @@ std::string BridgeTCPCommon::get_address_from_url(std::string_view url) {
         return std::string(addr);
     }
 }
-
 std::string BridgeTCPCommon::get_path_from_url(std::string_view url) {
+    if (url.substr(0, ws_unix_scheme.size()) == ws_unix_scheme) {
+        auto pos = url.find(':', ws_unix_scheme.size());
+        if (pos == url.npos) return "/";
+        return std::string(url.substr(pos + 1));
+    }
     if (url.substr(0, 5) != "ws://") return "/";
     url = url.substr(5);
     auto pos = url.find('/');
@@ -246,13 +497,50 @@ void BridgeTCPCommon::send(const CloseGroup& m) noexcept {
 }
 
 void BridgeTCPCommon::send(const Message &m) noexcept {
-    output_message(_ser(m));
+    auto scope = BroadcastScope::find(m);
+    if (scope) {
+        //message is broadcast to many peers, it is serialized only once
+        if (!scope->owner) {
+            scope->serialized = _ser(m);
+            scope->owner = _ser.release_buffer();
+        }
+        auto data = scope->serialized;
+        output_message(ws::Message{data, ws::Type::binary},
+                data.size() >= owned_message_min_size?scope->owner:nullptr);
+        return;
+    }
+    auto data = _ser(m);
+    if (data.size() >= owned_message_min_size) {
+        output_message(ws::Message{data, ws::Type::binary}, _ser.release_buffer());
+    } else {
+        output_message(data);
+    }
 }
 
 void BridgeTCPCommon::send(const ChannelUpdate &m) noexcept {
     output_message(_ser(m));
 }
 
+void BridgeTCPCommon::send(const ChannelUpdate &m, const SharedMessage &serialized) noexcept {
+    if (serialized.owner) {
+        //the same frame payload is shared by all bridges
+        output_message(ws::Message{serialized.data, ws::Type::binary}, serialized.owner);
+    } else {
+        send(m);
+    }
+}
+
+void BridgeTCPCommon::serialize(SharedChannels &shared) {
+    if (!shared.added->channels.empty()) {
+        auto data = _ser(ChannelUpdate{shared.added->channels, Operation::add});
+        shared.added_msg = {data, _ser.release_buffer()};
+    }
+    if (!shared.erased->channels.empty()) {
+        auto data = _ser(ChannelUpdate{shared.erased->channels, Operation::erase});
+        shared.erased_msg = {data, _ser.release_buffer()};
+    }
+}
+
 void BridgeTCPCommon::send(const NoRoute &m) noexcept {
     output_message(_ser(m));
 }
@@ -272,4 +560,12 @@ void BridgeTCPCommon::send(const UpdateSerial&m) noexcept {
     output_message(_ser(m));
 }
 
+void BridgeTCPCommon::send(const ChannelVersion &m) noexcept {
+    output_message(_ser(m));
+}
+
+void BridgeTCPCommon::send(const ChannelResync &m) noexcept {
+    output_message(_ser(m));
+}
+
 }
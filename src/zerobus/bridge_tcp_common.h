@@ -3,24 +3,69 @@
 #include "bridge.h"
 #include "websocket.h"
 #include "serialization.h"
+#include "output_queue.h"
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <deque>
+#include <functional>
 #include <mutex>
+#include <thread>
 namespace zerobus {
 
+///Policy of coalescing of small frames into single send
+/**
+ * Without coalescing, every message is sent immediately. With coalescing, messages
+ * are collected and sent together, which saves system calls for the price of latency.
+ * Coalescing is active, when end_of_burst is set or max_delay is nonzero
+ */
+struct CoalescingPolicy {
+    ///collected data are sent immediately, when their size reaches this threshold
+    std::size_t threshold = 64*1024;
+    ///send collected data once the IO thread finishes current work (no fixed delay)
+    bool end_of_burst = false;
+    ///maximum time for which data can be delayed
+    std::chrono::microseconds max_delay = {};
+    ///tune the delay up to max_delay from observed rate of messages
+    /** When messages are sparse (average gap is above max_delay), they are
+     * sent immediately, because nothing would be coalesced */
+    bool adaptive = false;
+
+    bool enabled() const {return end_of_burst || max_delay.count() > 0;}
+};
+
 class BridgeTCPCommon: public AbstractBridge, public IPeer {
 public:
 
-    static constexpr int input_buffer_size = 8192;
     static constexpr std::string_view magic = "zbus";
     static constexpr unsigned char close_session_msg = 0x1F;
+    ///messages of this size and above keep their buffer while sent (allows zero copy)
+    static constexpr std::size_t owned_message_min_size = 16384;
 
 
     virtual ~BridgeTCPCommon() override;
     BridgeTCPCommon(const BridgeTCPCommon &) = delete;
     BridgeTCPCommon &operator=(const BridgeTCPCommon &) = delete;
 
+    ///scheme of websocket url over unix socket: ws+unix:/path/to/socket:/request/path
+    static constexpr std::string_view ws_unix_scheme = "ws+unix:";
+
+    ///retrieve address of the peer from the url
+    /**
+     * @param url url in form ws://host:port/path or ws+unix:/socket/path:/path. Other
+     * strings are returned as they are (host:port, unix:/socket/path)
+     * @return address for INetContext::connect or INetContext::create_server
+     */
     static std::string get_address_from_url(std::string_view url);
+    ///retrieve request path from the url
     static std::string get_path_from_url(std::string_view url);
 
+    ///serialize changes of shared channel list, so they are not serialized by every bridge
+    /**
+     * @param shared updated list, serialized messages are stored into it
+     */
+    static void serialize(SharedChannels &shared);
+
     ///set high water mark
     /**
      * @param hwm specified high water mark limit for total buffered data in bytes. Default is
@@ -33,6 +78,61 @@ public:
      */
     void set_hwm(std::size_t hwm, std::size_t timeout_ms);
 
+    ///set coalescing policy
+    /**
+     * @param policy new policy. Default policy disables coalescing
+     */
+    void set_coalescing(const CoalescingPolicy &policy);
+
+    ///offload deserialization and dispatching of received messages to a worker pool
+    /**
+     * By default, received messages are processed by the IO thread, so local
+     * listeners delay other connections of the same context. With a worker pool,
+     * the IO thread only parses frames and copies their payloads. Messages of
+     * one connection are still processed in order, one at time (strand)
+     *
+     * @param workers context which threads process the messages (through post()), for
+     * example make_network_context(4). Set nullptr to process messages on IO thread
+     * @param max_inflight maximum size of received messages waiting to processing.
+     * When reached, reading from the connection is paused until workers catch up, so
+     * the sender is slowed down by TCP flow control
+     */
+    void set_dispatch_pool(std::shared_ptr<INetContext> workers, std::size_t max_inflight = 1024*1024);
+
+    ///retrieve count of bytes which can be sent before high water mark is reached
+    std::size_t get_send_credit();
+
+    ///register callback which is called when the bridge can accept more data
+    /**
+     * Allows to react to backpressure without blocking the thread in high water mark
+     *
+     * @param credit requested credit in bytes (capped to high water mark)
+     * @param cb callback, called once when the credit is available. It is called
+     * from a thread which writes data to the connection
+     * @retval true callback registered
+     * @retval false credit is already available, callback is not called
+     */
+    bool on_writable(std::size_t credit, std::function<void()> cb);
+
+    ///awaitable which suspends coroutine until the bridge can accept more data
+    /**
+     * @code
+     * co_await BridgeTCPCommon::writable(client, msg.size());
+     * @endcode
+     */
+    class writable {
+    public:
+        writable(BridgeTCPCommon &owner, std::size_t credit):_owner(owner),_credit(credit) {}
+        static constexpr bool await_ready() noexcept {return false;}
+        bool await_suspend(std::coroutine_handle<> h) {
+            return _owner.on_writable(_credit, [h]{h.resume();});
+        }
+        static constexpr void await_resume() noexcept {}
+    protected:
+        BridgeTCPCommon &_owner;
+        std::size_t _credit;
+    };
+
 protected:
 
     virtual void clear_to_send() noexcept override;
@@ -42,6 +142,8 @@ protected:
 
     virtual void lost_connection() {}
     virtual void close() {}
+    ///called when pong frame is received
+    virtual void on_pong(std::string_view ) {}
 
     void destroy();
 
@@ -55,16 +157,23 @@ protected:
     bool _bound = false;
 
 
-    char _input_buffer[input_buffer_size];
-
     std::mutex _mx;
+    std::condition_variable _hwm_cond;                  //signaled when data are written and somebody waits
+    unsigned int _hwm_waiters = 0;                      //count of threads blocked in block_hwm
+    std::vector<std::pair<std::size_t, std::function<void()> > > _writable_cbs = {};  //callbacks of on_writable
 
-    std::vector<char> _output_data = {};
+    OutputQueue _output = {};                   //queued frames, front frame can be partially sent
+    std::vector<std::size_t> _output_frames = {};   //sizes of queued frames
+    std::size_t _output_frames_head = 0;        //index of the first queued frame
+    std::vector<char> _header_data = {};
     std::vector<char> _input_data = {};
-    std::vector<std::size_t> _output_msg_sp = {};
-    std::size_t _output_cursor = 0;
+    std::size_t _output_cursor = 0;             //bytes of queued frames already sent
     bool _handshake = true;
     bool _output_allowed = false;
+    CoalescingPolicy _coalescing = {};
+    bool _flush_scheduled = false;                      //delayed flush is armed
+    std::chrono::steady_clock::time_point _last_output = {};
+    std::chrono::nanoseconds _output_gap = {};          //average gap between messages (adaptive mode)
 
     virtual void send(const ChannelReset &) noexcept override;
     virtual void send(const CloseGroup &) noexcept override;
@@ -75,12 +184,24 @@ protected:
     virtual void send(const GroupEmpty &) noexcept override;
     virtual void send(const NewSession &) noexcept override;
     virtual void send(const UpdateSerial &) noexcept override;
+    virtual void send(const ChannelVersion &) noexcept override;
+    virtual void send(const ChannelResync &) noexcept override;
+    virtual void send(const ChannelUpdate &msg, const SharedMessage &serialized) noexcept override;
     void read_from_connection();
 
+    ///maximum segments passed to single send
+    static constexpr std::size_t max_send_segments = 64;
+
     bool after_send(std::size_t sz);
-    std::string_view get_view_to_send() const;
+    std::size_t send_output();
+    std::size_t get_pending_size() const {return _output.size() - _output_cursor;}
+    void release_idle_buffers();
+    void push_frame(std::string_view data);
+    void push_frame(std::string_view header, std::string_view payload, std::shared_ptr<const void> owner);
 
     void flush_buffer();
+    bool delay_flush(std::size_t frame_size);
+    void delayed_flush();
 
     ///create common class
     /**
@@ -94,18 +215,64 @@ protected:
     void bind(std::shared_ptr<INetContext> ctx, ConnHandle aux);
     void init();
 
-    void output_message(const ws::Message &msg);
+    void output_message(const ws::Message &msg, std::shared_ptr<const void> owner = {});
 
 
 
     void deserialize_message(const std::string_view &msg);
     Deserialization _deser;
+
+    ///received frames waiting to dispatch on worker pool
+    /** The state can outlive the bridge, a posted task holds it through keep_alive */
+    struct DispatchStrand {
+        std::mutex mx;
+        std::condition_variable cond;
+        BridgeTCPCommon *owner = nullptr;   //nullptr when bridge was destroyed
+        std::shared_ptr<INetContext> workers;
+        std::size_t max_inflight = 0;
+        std::deque<std::string> frames;
+        std::size_t inflight = 0;           //total size of frames
+        bool scheduled = false;             //task is posted or running
+        bool running = false;               //a frame is being dispatched
+        std::thread::id runner;             //thread which dispatches the frame
+        bool read_paused = false;           //reading paused because of max_inflight
+        void (BridgeTCPCommon::*disconnect)() = nullptr;   //lost_connection or close, called after queued frames
+        std::shared_ptr<DispatchStrand> keep_alive; //set while scheduled
+    };
+    ///maximum frames dispatched by one task before other strands get a chance
+    static constexpr unsigned int strand_batch = 16;
+
+    ///prevents deferred flush from running after the bridge is destroyed
+    /** The state can outlive the bridge, a deferred task holds it through keep_alive */
+    struct FlushGuard {
+        std::mutex mx;
+        std::condition_variable cond;
+        BridgeTCPCommon *owner = nullptr;   //nullptr when bridge was destroyed
+        unsigned int pending = 0;           //count of deferred tasks
+        bool running = false;               //owner is flushing
+        std::thread::id runner;             //thread which flushes
+        std::shared_ptr<FlushGuard> keep_alive; //set while pending
+    };
+
+    std::shared_ptr<FlushGuard> _flush_guard = {};   //created for end_of_burst policy
+
+    static void run_deferred_flush(FlushGuard *g) noexcept;
+    std::shared_ptr<DispatchStrand> _strand_state = {};
+    std::atomic<DispatchStrand *> _strand = {};  //set once, read by IO thread without lock
+
+    bool offload_message(std::string_view msg);
+    bool offload_disconnect(void (BridgeTCPCommon::*fn)());
+    bool pause_reading();
+    static void run_strand(DispatchStrand *st) noexcept;
+    void stop_dispatch();
     static thread_local Serialization _ser;
 
     using AbstractBridge::receive;
     virtual void receive(const Deserialization::UserMsg &) {}
 
     bool block_hwm(std::unique_lock<std::mutex> &lk);
+    std::size_t get_send_credit_lk() const;
+    void notify_writable(std::unique_lock<std::mutex> &lk);
 
 
 };
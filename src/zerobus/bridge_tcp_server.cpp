@@ -3,6 +3,8 @@
 
 #include "bridge.h"
 #include <charconv>
+#include <cmath>
+#include <cstring>
 
 namespace zerobus {
 
@@ -13,9 +15,9 @@ BridgeTCPServer::BridgeTCPServer(Bus bus)
 
 }
 
-void BridgeTCPServer::bind(std::shared_ptr<INetContext> ctx, std::string address_port) {
+void BridgeTCPServer::bind(std::shared_ptr<INetContext> ctx, std::string address_port, const SocketOptions &opts) {
     if (_bound) throw std::runtime_error("Server is already bound");
-    auto aux = ctx->create_server(BridgeTCPCommon::get_address_from_url(address_port));
+    auto aux = ctx->create_server(BridgeTCPCommon::get_address_from_url(address_port), opts);
     _bound = true;
     _ctx = std::move(ctx);
     _path = BridgeTCPCommon::get_path_from_url(address_port);
@@ -25,9 +27,9 @@ void BridgeTCPServer::bind(std::shared_ptr<INetContext> ctx, std::string address
     _ctx->accept(_aux, this);
 }
 
-BridgeTCPServer::BridgeTCPServer(Bus bus, std::shared_ptr<INetContext> ctx, std::string address_port)
+BridgeTCPServer::BridgeTCPServer(Bus bus, std::shared_ptr<INetContext> ctx, std::string address_port, const SocketOptions &opts)
 :BridgeTCPServer(std::move(bus)) {
-    bind(std::move(ctx), address_port);
+    bind(std::move(ctx), address_port, opts);
 }
 
 BridgeTCPServer::BridgeTCPServer(Bus bus, std::string address_port)
@@ -39,8 +41,10 @@ BridgeTCPServer::~BridgeTCPServer() {
     br->unregister_monitor(this);
     std::unique_lock lk(_mx);
     auto p = std::move(_peers);
+    auto r = std::move(_rejected);
     lk.unlock();
     p.clear();
+    r.clear();
     _ctx->destroy(_aux);
     delete _http_server.exchange(nullptr);
 }
@@ -49,45 +53,129 @@ BridgeTCPServer::~BridgeTCPServer() {
 void BridgeTCPServer::on_channels_update() noexcept {
     std::lock_guard _(_mx);
     _send_mine_channels_flag = true;
-    _ctx->set_timeout(_aux, std::chrono::system_clock::time_point::min(), this);
+    _ctx->set_timeout(_aux, std::chrono::steady_clock::time_point::min(), this);
 }
 
 
+bool BridgeTCPServer::accept_allowed_lk() {
+    if (_max_connections && _peers.size() >= _max_connections) return false;
+    if (_accept_rate) {
+        //token bucket - refill by elapsed time, one token per connection
+        auto now = std::chrono::steady_clock::now();
+        std::chrono::duration<double> elapsed = now - _accept_tokens_tp;
+        _accept_tokens_tp = now;
+        _accept_tokens = std::min<double>(static_cast<double>(_accept_burst),
+                _accept_tokens + elapsed.count() * static_cast<double>(_accept_rate));
+        if (_accept_tokens < 1.0) return false;
+        _accept_tokens -= 1.0;
+    }
+    return true;
+}
+
 void BridgeTCPServer::on_accept(ConnHandle aux, std::string /*peer_addr*/) noexcept {
     //TODO report peer_addr
     std::lock_guard _(_mx);
+    if (!accept_allowed_lk()) {
+        //reject before the peer is created, the request is not read
+        static constexpr std::string_view response =
+                "HTTP/1.1 503 Service Unavailable\r\n"
+                "Retry-After: 1\r\n"
+                "Content-Length: 0\r\n"
+                "Connection: close\r\n"
+                "\r\n";
+        _rejected.push_back(std::make_unique<Rejected>(*this, aux, response));
+        _rejected_count.fetch_add(1, std::memory_order_relaxed);
+        _ctx->accept(_aux, this);
+        return;
+    }
     auto p = std::make_unique<Peer>(*this, aux, _id_cntr++);
     p->set_hwm(_hwm, _hwm_timeout);
-    _peers.push_back(std::move(p));
+    p->set_coalescing(_coalescing);
+    if (_dispatch_pool) p->set_dispatch_pool(_dispatch_pool, _max_inflight);
+    auto id = p->get_id();
+    _peers.emplace(id, std::move(p));
     _ctx->accept(_aux, this);
 }
 
 
 void BridgeTCPServer::on_timeout() noexcept {
     std::vector< std::unique_ptr<Peer> > _peer_to_delete;
+    std::vector< std::unique_ptr<Rejected> > _rejected_to_delete;
     {
         std::lock_guard _(_mx);
         if (_send_mine_channels_flag) {
-            _send_mine_channels_flag = true;
-            for (const auto &x: _peers) {
+            _send_mine_channels_flag = false;
+            //the list is calculated and serialized once for all peers
+            std::vector<const IListener *> bridges;
+            bridges.reserve(_peers.size());
+            for (const auto &[id, x]: _peers) bridges.push_back(x.get());
+            _shared_channels.update(*IBridgeAPI::from_bus(_bus.get_handle()), bridges);
+            BridgeTCPCommon::serialize(_shared_channels);
+            for (const auto &[id, x]: _peers) {
                 if (!x->disabled()) {
-                    x->send_mine_channels();
+                    x->send_mine_channels(_shared_channels);
                 }
             }
         }
-        if (_lost_peers_flag) {
-            _peers.erase(std::remove_if(_peers.begin(), _peers.end(), [&](auto &peer){
-                if (peer->is_lost()) {
-                    _peer_to_delete.push_back(std::move(peer));
-                    return true;
+        //rejected connections are closed outside of their callbacks
+        for (auto &r: _rejected) {
+            if (r->is_done()) _rejected_to_delete.push_back(std::move(r));
+        }
+        std::erase(_rejected, nullptr);
+        std::vector<unsigned int> lost;
+        {
+            std::lock_guard _(_lost_mx);
+            std::swap(lost, _lost_peers);
+        }
+        std::vector<unsigned int> busy;
+        for (auto id: lost) {
+            auto iter = _peers.find(id);
+            if (iter != _peers.end()) {
+                //the session is being resumed, removed once handover is done
+                if (iter->second->_handovers) {
+                    busy.push_back(id);
+                    continue;
                 }
-                return false;
-            }), _peers.end());
-            _lost_peers_flag = false;
+                unregister_session_lk(iter->second.get());
+                _peer_to_delete.push_back(std::move(iter->second));
+                _peers.erase(iter);
+            }
+        }
+        if (!busy.empty()) {
+            std::lock_guard _(_lost_mx);
+            _lost_peers.insert(_lost_peers.end(), busy.begin(), busy.end());
         }
     }
 }
 
+BridgeTCPServer::Rejected::Rejected(BridgeTCPServer &owner, ConnHandle aux, std::string_view response)
+    :_owner(owner),_aux(aux) {
+    auto &ctx = _owner._ctx;
+    ctx->send(_aux, response);
+    ctx->send(_aux, std::string_view());     //shutdown the output
+    ctx->set_timeout(_aux, std::chrono::steady_clock::now() + reject_drain_timeout, this);
+    ctx->receive(_aux, this);
+}
+
+BridgeTCPServer::Rejected::~Rejected() {
+    _owner._ctx->destroy(_aux);
+}
+
+void BridgeTCPServer::Rejected::receive_complete(std::string_view data) noexcept {
+    //the request is discarded until the client closes the connection
+    if (data.empty()) finish();
+    else _owner._ctx->receive(_aux, this);
+}
+
+void BridgeTCPServer::Rejected::on_timeout() noexcept {
+    finish();
+}
+
+void BridgeTCPServer::Rejected::finish() {
+    if (_done.exchange(true)) return;
+    _owner._ctx->set_timeout(_owner._aux, std::chrono::steady_clock::time_point::min(), &_owner);
+}
+
 BridgeTCPServer::Peer::Peer(BridgeTCPServer &owner, ConnHandle aux, unsigned int id)
     :BridgeTCPCommon(owner._bus, false)
     ,_id(id)
@@ -110,8 +198,9 @@ void BridgeTCPServer::Peer::initial_handshake() {
 bool BridgeTCPServer::Peer::check_dead() {
     if (_activity_check) {
         if (_ping_sent) return true;
-        BridgeTCPCommon::output_message(ws::Message{"",ws::Type::ping});
-        _ping_sent = true;
+        //nothing received since last check, idle peer doesn't need output buffers
+        release_idle_buffers();
+        send_ping_frame();
     } else {
         _ping_sent = false;
     }
@@ -121,7 +210,8 @@ bool BridgeTCPServer::Peer::check_dead() {
 
 void BridgeTCPServer::Peer::lost_connection() {
     if (_owner._session_timeout) {
-        _ctx->set_timeout(_aux, std::chrono::system_clock::now()+std::chrono::seconds(_owner._session_timeout), this);
+        _disconnected = true;
+        _ctx->set_timeout(_aux, std::chrono::steady_clock::now()+std::chrono::seconds(_owner._session_timeout), this);
     } else {
         _owner.on_peer_lost(*this);
         close();
@@ -131,11 +221,9 @@ void BridgeTCPServer::Peer::lost_connection() {
 template<typename Fn>
 void BridgeTCPServer::call_with_peer(unsigned int id, Fn &&fn) {
     std::lock_guard _(_mx);
-    auto iter = std::find_if(_peers.begin(), _peers.end(), [&](const auto &x) {
-        return x->get_id() == id;
-    });
+    auto iter = _peers.find(id);
     if (iter != _peers.end()) {
-        fn(iter->get());
+        fn(iter->second.get());
     }
 }
 
@@ -144,33 +232,67 @@ void BridgeTCPServer::call_with_peer(unsigned int id, Fn &&fn) {
 
 
 void BridgeTCPServer::send_ping() {
-    std::lock_guard _(_mx);
-    _peers.erase(std::remove_if(
-            _peers.begin(), _peers.end(), [&](const auto &p) {
-        Peer &x = *p;
-        return x.check_dead();
-    }),_peers.end());
-
+    //dead peers are removed in on_timeout(), which also waits for running handovers
+    std::vector<unsigned int> dead;
+    {
+        std::lock_guard _(_mx);
+        for (const auto &[id, x]: _peers) {
+            if (x->check_dead()) dead.push_back(id);
+        }
+    }
+    if (dead.empty()) return;
+    {
+        std::lock_guard _(_lost_mx);
+        _lost_peers.insert(_lost_peers.end(), dead.begin(), dead.end());
+    }
+    _ctx->set_timeout(_aux, std::chrono::steady_clock::time_point::min(), this);
 }
 
 void BridgeTCPServer::set_hwm(std::size_t sz, std::size_t timeout_ms) {
     std::lock_guard _(_mx);
     _hwm = sz;
     _hwm_timeout = timeout_ms;
-    for (auto &x: _peers) {
+    for (auto &[id, x]: _peers) {
         x->set_hwm(sz,timeout_ms);
     }
 }
 
+void BridgeTCPServer::set_coalescing(const CoalescingPolicy &policy) {
+    std::lock_guard _(_mx);
+    _coalescing = policy;
+    for (auto &[id, x]: _peers) {
+        x->set_coalescing(policy);
+    }
+}
+
+void BridgeTCPServer::set_dispatch_pool(std::shared_ptr<INetContext> workers, std::size_t max_inflight) {
+    std::lock_guard _(_mx);
+    _dispatch_pool = std::move(workers);
+    _max_inflight = max_inflight;
+    for (auto &[id, x]: _peers) {
+        x->set_dispatch_pool(_dispatch_pool, max_inflight);
+    }
+}
+
 void BridgeTCPServer::Peer::close() {
     _lost = true;
-    _owner.lost_connection();
+    _owner.lost_connection(_id);
 }
 
-void BridgeTCPServer::lost_connection() {
-    std::lock_guard _(_mx);
-    _lost_peers_flag = true;
-    _ctx->set_timeout(_aux, std::chrono::system_clock::time_point::min(), this);
+void BridgeTCPServer::lost_connection(unsigned int id) {
+    //server lock is not needed, peers are removed in on_timeout()
+    {
+        std::lock_guard _(_lost_mx);
+        _lost_peers.push_back(id);
+    }
+    _ctx->set_timeout(_aux, std::chrono::steady_clock::time_point::min(), this);
+}
+
+void BridgeTCPServer::unregister_session_lk(const Peer *peer) {
+    auto sid = peer->get_session_id();
+    if (sid.empty()) return;
+    auto iter = _sessions.find(sid);
+    if (iter != _sessions.end() && iter->second == peer) _sessions.erase(iter);
 }
 
 void BridgeTCPServer::Peer::receive_complete(std::string_view data) noexcept {
@@ -186,10 +308,6 @@ void BridgeTCPServer::Peer::receive_complete(std::string_view data) noexcept {
             std::string_view header_data = t.substr(0,p);
             std::string_view extra = t.substr(p+4);
             if (websocket_handshake(header_data, extra)) {
-                if (!_session_id.empty() && _owner.handover(this, _aux, _session_id)) {
-                    close();
-                    return;
-                }
                 _input_data.clear();
                 if (!extra.empty()) {
                     start_peer();
@@ -271,24 +389,45 @@ bool BridgeTCPServer::Peer::websocket_handshake(const std::string_view &data, co
         resp << ws::calculate_ws_accept(rs.key) << "\r\n\r\n";
         if (rs.sessionid.size() >= 32) {
             _session_id.append(rs.sessionid);
+            //connection is taken by the original peer of the session
+            if (_owner.handover(this, _aux, _session_id, resp.view())) {
+                _destroyed = true;
+                return false;
+            }
         }
 
     }
-    _output_msg_sp.push_back(_output_data.size());
-    auto v = resp.view();
-    std::copy(v.begin(), v.end(), std::back_inserter(_output_data));
+    push_frame(resp.view());
     flush_buffer();
     return !rs.key.empty();
 }
 
-void BridgeTCPServer::Peer::reconnect(ConnHandle aux) {
-    _ctx->destroy(aux);
-    _aux = aux;
+void BridgeTCPServer::Peer::reconnect(ConnHandle aux, std::string_view response) {
+    ConnHandle old;
+    {
+        std::lock_guard _(_mx);
+        old = std::exchange(_aux, aux);
+        //timer of delayed flush is canceled with the old connection
+        _flush_scheduled = false;
+        _output_cursor = 0; //last output incomplete message will be send again
+        _output_allowed = false;
+        //handshake response goes before messages waiting from previous connection
+        _output.prepend(response);
+        if (_output_frames_head) _output_frames[--_output_frames_head] = response.size();
+        else _output_frames.insert(_output_frames.begin(), response.size());
+    }
+    //outside of the peer's lock (and the server's lock, see handover()), destroy waits
+    //for callbacks of the old connection
+    _ctx->destroy(old);
     _input_data.clear();
+    _ws_parser.reset();
+    _activity_check = false;
+    _ping_sent = false;
+    _disconnected = false;
     read_from_connection();
-    send(ChannelReset{});
+    resync_channels();
     _ctx->ready_to_send(_aux, this);
-
+    start_keepalive();
 }
 
 void BridgeTCPServer::Peer::on_timeout() noexcept {
@@ -300,25 +439,139 @@ void BridgeTCPServer::Peer::on_timeout() noexcept {
 void BridgeTCPServer::Peer::start_peer() {
     _handshake = false;
     initial_handshake();
+    start_keepalive();
+}
+
+void BridgeTCPServer::Peer::send_ping_frame() {
+    //payload carries time of sending, it is returned in pong
+    auto ts = std::chrono::steady_clock::now().time_since_epoch().count();
+    char buff[sizeof(ts)];
+    std::memcpy(buff, &ts, sizeof(ts));
+    BridgeTCPCommon::output_message(ws::Message{std::string_view(buff, sizeof(buff)), ws::Type::ping});
+    _ping_sent = true;
+}
+
+void BridgeTCPServer::Peer::on_pong(std::string_view payload) {
+    std::chrono::steady_clock::rep ts;
+    if (payload.size() != sizeof(ts)) return;   //not our ping
+    std::memcpy(&ts, payload.data(), sizeof(ts));
+    auto sent = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(ts));
+    auto rtt = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - sent);
+    if (rtt.count() < 0) return;
+    _rtt.store(rtt, std::memory_order_relaxed);
+    //exponential moving average, alpha = 1/8
+    auto srtt = _srtt.load(std::memory_order_relaxed);
+    _srtt.store(srtt.count()?srtt + (rtt - srtt) / 8:rtt, std::memory_order_relaxed);
+}
+
+BridgeTCPServer::PeerStats BridgeTCPServer::Peer::get_stats() const {
+    return {_id, _rtt.load(std::memory_order_relaxed), _srtt.load(std::memory_order_relaxed)};
+}
+
+void BridgeTCPServer::Peer::start_keepalive() {
+    auto interval = _owner._keepalive.load();
+    std::lock_guard _(_mx);
+    ++_keepalive_gen;
+    if (_keepalive_timer) _ctx->cancel_timer(std::exchange(_keepalive_timer, 0));
+    if (interval.count() == 0) return;
+    //golden ratio sequence spreads peers evenly over the interval
+    constexpr double phi = 0.6180339887498949;
+    double phase = std::fmod(_id * phi, 1.0);
+    arm_keepalive(std::chrono::steady_clock::now()
+            + std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval * phase));
+}
+
+void BridgeTCPServer::Peer::arm_keepalive(std::chrono::steady_clock::time_point tp) {
+    _keepalive_timer = _ctx->set_timer(_aux, tp, [this, gen = _keepalive_gen]{keepalive(gen);});
+}
+
+void BridgeTCPServer::Peer::keepalive(unsigned int gen) noexcept {
+    auto interval = _owner._keepalive.load();
+    //no response since the last ping
+    bool dead = !_disconnected && _activity_check && _ping_sent;
+    {
+        std::lock_guard _(_mx);
+        if (gen != _keepalive_gen) return;     //timer was replaced
+        _keepalive_timer = 0;
+        if (interval.count() == 0) return;
+        if (!dead) arm_keepalive(std::chrono::steady_clock::now() + interval);
+    }
+    if (dead) {
+        //server lock is not needed, the peer is removed later
+        _owner.on_peer_lost(*this);
+        close();
+        return;
+    }
+    //disconnected peer waits for resume of the session, session timeout applies
+    if (_disconnected) return;
+    //nothing received for whole interval, idle peer doesn't need output buffers
+    if (_activity_check) release_idle_buffers();
+    _activity_check = true;
+    send_ping_frame();
+}
+
+void BridgeTCPServer::set_keepalive(std::chrono::milliseconds interval) {
+    _keepalive.store(interval);
+    std::lock_guard _(_mx);
+    for (auto &[id, x]: _peers) {
+        if (!x->disabled()) x->start_keepalive();
+    }
+}
+
+std::vector<BridgeTCPServer::PeerStats> BridgeTCPServer::get_peer_stats() {
+    std::vector<PeerStats> ret;
+    std::lock_guard _(_mx);
+    for (const auto &[id, x]: _peers) {
+        if (!x->disabled() && !x->is_lost()) ret.push_back(x->get_stats());
+    }
+    return ret;
 }
 
 void BridgeTCPServer::set_session_timeout(std::size_t timeout_sec) {
     _session_timeout = timeout_sec;
 }
 
+void BridgeTCPServer::set_connection_limit(std::size_t max_connections) {
+    std::lock_guard _(_mx);
+    _max_connections = max_connections;
+}
+
+void BridgeTCPServer::set_accept_rate(std::size_t per_second, std::size_t burst) {
+    std::lock_guard _(_mx);
+    _accept_rate = per_second;
+    _accept_burst = std::max<std::size_t>(burst, 1);
+    _accept_tokens = static_cast<double>(_accept_burst);
+    _accept_tokens_tp = std::chrono::steady_clock::now();
+}
+
 void BridgeTCPServer::on_peer_connect(BridgeTCPCommon &) {}
 void BridgeTCPServer::on_peer_lost(BridgeTCPCommon &) {}
 
-bool BridgeTCPServer::handover(Peer *peer, ConnHandle handle, std::string_view session_id) {
+bool BridgeTCPServer::handover(Peer *peer, ConnHandle handle, std::string_view session_id, std::string_view response) {
+    Peer *target;
+    {
+        std::lock_guard _(_mx);
+        auto [iter, inserted] = _sessions.try_emplace(session_id, peer);
+        if (inserted || iter->second == peer) return false;
+        if (iter->second->is_lost()) {
+            //the original peer is gone, this peer continues the session
+            _sessions.erase(iter);
+            _sessions.emplace(session_id, peer);
+            return false;
+        }
+        //the peer is not removed while the handover is running
+        target = iter->second;
+        ++target->_handovers;
+    }
+    //callbacks of the old connection can lock the server, so reconnect
+    //must be called without the lock
+    target->reconnect(handle, response);
     std::lock_guard _(_mx);
-    auto iter = std::find_if(_peers.begin(), _peers.end(), [&](const auto &p) {
-        return p->get_session_id() == session_id;
-    });
-    if (iter != _peers.end() && iter->get() != peer && !iter->get()->is_lost()) {
-        (*iter)->reconnect(handle);
-        return true;
+    //removal of the peer lost meanwhile has been postponed
+    if (--target->_handovers == 0 && target->is_lost()) {
+        _ctx->set_timeout(_aux, std::chrono::steady_clock::time_point::min(), this);
     }
-    return false;
+    return true;
 }
 
 void BridgeTCPServer::set_http_server(std::unique_ptr<IHttpServer> &srv) {
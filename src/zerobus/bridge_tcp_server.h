@@ -7,6 +7,7 @@
 #include "bridge_tcp_common.h"
 
 #include <functional>
+#include <unordered_map>
 namespace zerobus {
 
 class BridgeTCPServer: public IMonitor, public IServer {
@@ -17,9 +18,9 @@ public:
      * @param bus local end of the bus
      * @param ctx network context
      * @param address_port address and port to bind. You can use * to bind on all interfaces (*:port)
-     * @param auth_cfg optional - information about peer authentication.
+     * @param opts socket options applied to accepted connections
      */
-    BridgeTCPServer(Bus bus, std::shared_ptr<INetContext> ctx, std::string address_port);
+    BridgeTCPServer(Bus bus, std::shared_ptr<INetContext> ctx, std::string address_port, const SocketOptions &opts = {});
     ///Construct server
     /**
      * @param bus local end of the bus
@@ -44,8 +45,9 @@ public:
     /**
      * @param ctx network context
      * @param address_port address and port or ws:// string
+     * @param opts socket options applied to accepted connections
      */
-    void bind(std::shared_ptr<INetContext> ctx, std::string address_port);
+    void bind(std::shared_ptr<INetContext> ctx, std::string address_port, const SocketOptions &opts = {});
 
 
     ///sets http server
@@ -83,18 +85,42 @@ public:
     template<std::invocable<ConnHandle,std::shared_ptr<INetContext> ,std::string_view , std::string_view> Fn>
     std::unique_ptr<IHttpServer> set_http_server_fn(Fn &&fn);
 
-    ///server doesn't send pings automatically - this function enforces ping on all peers
+    ///enforces ping on all peers now
     /**
-     * You should call this function repeatedly in steady interval, for example 1 minute.
-     * However it is not recommended to implement short ping. Removing stall connections
-     * can cause loosing of messages in case of temporary break of a connection (for example
-     * lost signal or disconnected cable). Connection is kept active even if there is
-     * no activity.
+     * Without keepalive (see set_keepalive()), you should call this function repeatedly
+     * in steady interval, for example 1 minute. However it is not recommended to implement
+     * short ping. Removing stall connections can cause loosing of messages in case of
+     * temporary break of a connection (for example lost signal or disconnected cable).
+     * Connection is kept active even if there is no activity.
      *
      * @note browser's websocket still can send and receive pings.
      */
     void send_ping();
 
+    ///send pings automatically
+    /**
+     * Every peer has own timer, so pings of many peers are spread evenly over the interval
+     * instead of being sent at once. A peer which doesn't respond to the ping
+     * until next one is due is removed. Pongs are used to measure round trip time
+     * (see get_peer_stats())
+     *
+     * @param interval interval of pings. Zero disables keepalive (default)
+     */
+    void set_keepalive(std::chrono::milliseconds interval);
+
+    ///statistics of a connected peer
+    struct PeerStats {
+        ///id of the peer
+        unsigned int id;
+        ///round trip time measured by the last ping (zero if not measured yet)
+        std::chrono::microseconds rtt;
+        ///smoothed round trip time
+        std::chrono::microseconds srtt;
+    };
+
+    ///retrieve statistics of connected peers
+    std::vector<PeerStats> get_peer_stats();
+
     ///set high water mark
     /**
      * @param hwm specified high water mark limit for total buffered data in bytes. Default is
@@ -107,8 +133,46 @@ public:
      */
     void set_hwm(std::size_t hwm, std::size_t timeout_ms);
 
+    ///set coalescing policy of connected and future peers
+    /**
+     * @param policy new policy
+     * @see BridgeTCPCommon::set_coalescing
+     */
+    void set_coalescing(const CoalescingPolicy &policy);
+
+    ///offload processing of received messages of connected and future peers to a worker pool
+    /**
+     * @param workers context which threads process the messages
+     * @param max_inflight maximum size of received messages waiting to processing per peer
+     * @see BridgeTCPCommon::set_dispatch_pool
+     */
+    void set_dispatch_pool(std::shared_ptr<INetContext> workers, std::size_t max_inflight = 1024*1024);
+
     void set_session_timeout(std::size_t timeout_sec);
 
+    ///limit count of connected peers
+    /**
+     * @param max_connections maximum count of peers. When the limit is reached,
+     * new connections are rejected with HTTP 503 before any peer is created.
+     * Zero means unlimited (default)
+     */
+    void set_connection_limit(std::size_t max_connections);
+
+    ///limit rate of accepted connections
+    /**
+     * Limits mass reconnect (for example after restart of the server). Connections
+     * above the limit are rejected with HTTP 503 and Retry-After header, the clients
+     * try to connect again later.
+     *
+     * @param per_second average count of accepted connections per second. Zero
+     * means unlimited (default)
+     * @param burst count of connections which can be accepted at once
+     */
+    void set_accept_rate(std::size_t per_second, std::size_t burst);
+
+    ///retrieve count of connections rejected by limits
+    std::size_t get_rejected_count() const {return _rejected_count.load(std::memory_order_relaxed);}
+
 protected:
 
     ///called when peer is connected
@@ -139,17 +203,27 @@ protected:
         virtual void on_timeout() noexcept override;
 
         bool check_dead();
+        void start_keepalive();
         unsigned int get_id() const {return _id;}
         std::string_view get_session_id() const {return _session_id;}
-        bool is_lost() const {return _lost;}
+        bool is_lost() const {return _lost.load(std::memory_order_relaxed);}
+        PeerStats get_stats() const;
         bool disabled() const {return  _handshake;}
         virtual void close() override;
-        void reconnect(ConnHandle aux);
+        void reconnect(ConnHandle aux, std::string_view response);
+
+        friend class BridgeTCPServer;
 
     protected:
-        bool _activity_check = false;
-        bool _ping_sent = false;
-        bool _lost = false;
+        std::atomic<bool> _activity_check = false;
+        std::atomic<bool> _ping_sent = false;
+        std::atomic<bool> _lost = false;
+        std::atomic<bool> _disconnected = false;    //waiting to resume the session
+        std::atomic<std::chrono::microseconds> _rtt = {};
+        std::atomic<std::chrono::microseconds> _srtt = {};
+        unsigned int _keepalive_gen = 0;            //invalidates armed keepalive timer
+        unsigned int _handovers = 0;                //running handovers to this peer (guarded by server's _mx)
+        TimerID _keepalive_timer = 0;
         unsigned int _id;
         std::string _session_id;
 
@@ -160,6 +234,11 @@ protected:
             std::string_view sessionid;
         };
 
+        virtual void on_pong(std::string_view payload) override;
+        void send_ping_frame();
+        void keepalive(unsigned int gen) noexcept;
+        void arm_keepalive(std::chrono::steady_clock::time_point tp);
+
         bool websocket_handshake(const std::string_view &data, const std::string_view &extra);
         ParseResult parse_websocket_header(std::string_view data);
         void start_peer();
@@ -169,33 +248,79 @@ protected:
     };
 
 
+    ///connection rejected by the limits
+    /**
+     * The response is sent and the output is shut down. The connection is closed after
+     * the client closes its side (or after a short drain), because closing a socket
+     * with unread request resets the connection and the client can lose the response
+     */
+    class Rejected: public IPeer {
+    public:
+
+        Rejected(BridgeTCPServer &owner, ConnHandle aux, std::string_view response);
+        Rejected(const Rejected &) = delete;
+        Rejected &operator=(const Rejected &) = delete;
+        ~Rejected();
+        virtual void receive_complete(std::string_view data) noexcept override;
+        virtual void clear_to_send() noexcept override {}
+        virtual void on_timeout() noexcept override;
+        bool is_done() const {return _done.load(std::memory_order_relaxed);}
+
+    protected:
+        BridgeTCPServer &_owner;
+        ConnHandle _aux;
+        std::atomic<bool> _done = false;
+
+        void finish();
+    };
+
+    ///how long is rejected connection drained before it is closed
+    static constexpr auto reject_drain_timeout = std::chrono::seconds(1);
+
     Bus _bus;
     std::shared_ptr<INetContext> _ctx;
     ConnHandle  _aux = 0;
     std::string _path;
     std::mutex _mx;
-    std::vector<std::unique_ptr<Peer> > _peers;
-    std::chrono::system_clock::time_point _next_ping = {};
+    std::unordered_map<unsigned int, std::unique_ptr<Peer> > _peers;   //peers by id
+    std::unordered_map<std::string_view, Peer *> _sessions;            //session owners by session id
+    std::mutex _lost_mx;                    //protects _lost_peers, never locked before _mx
+    std::vector<unsigned int> _lost_peers;  //ids of lost peers, removed in on_timeout()
+    std::vector<std::unique_ptr<Rejected> > _rejected;   //rejected connections being drained, removed in on_timeout()
+    std::chrono::steady_clock::time_point _next_ping = {};
+    std::atomic<std::chrono::milliseconds> _keepalive = {};
     std::size_t _hwm = 1024*1024;
     std::size_t _hwm_timeout = 1000;    //1 second
+    CoalescingPolicy _coalescing = {};
+    std::shared_ptr<INetContext> _dispatch_pool;
+    std::size_t _max_inflight = 0;
     std::size_t _session_timeout = 0;
+    std::size_t _max_connections = 0;
+    std::size_t _accept_rate = 0;
+    std::size_t _accept_burst = 0;
+    double _accept_tokens = 0;
+    std::chrono::steady_clock::time_point _accept_tokens_tp = {};
+    std::atomic<std::size_t> _rejected_count = {0};
     unsigned int _id_cntr = 1;
     bool _send_mine_channels_flag = false;
-    bool _lost_peers_flag = false;
+    AbstractBridge::SharedChannels _shared_channels = {};  //last list sent to peers
     bool _bound = false;
     std::atomic<IHttpServer *> _http_server = {};
 
 
-    void lost_connection();
+    void lost_connection(unsigned int id);
+    void unregister_session_lk(const Peer *peer);
+    bool accept_allowed_lk();
     ///try to handover the session
     /**
      * @param handle connection handle
      * @param session_id session id
+     * @param response handshake response, which is sent by original peer instance
      * @retval true connection has been handed over to original peer instance. You should close this
      * peer
      * @retval false connection has not been handed over, continue in this peer
      */
-    bool handover(Peer *peer, ConnHandle handle, std::string_view session_id);
+    bool handover(Peer *peer, ConnHandle handle, std::string_view session_id, std::string_view response);
 
 
     template<typename Fn>
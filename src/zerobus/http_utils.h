@@ -47,7 +47,7 @@ public:
         _ctx.destroy(_conn);
     }
 
-    using Clock = std::chrono::system_clock;
+    using Clock = std::chrono::steady_clock;
     using TimePoint = Clock::time_point;
     using Duration = Clock::duration;
 
@@ -660,6 +660,37 @@ inline constexpr OutputIt url_decode(InputIt beg, InputIt end, OutputIt result)
     return result;
 }
 
+///Awaitable which moves the coroutine to dispatcher's thread
+/**
+ * @code
+ * co_await resume_on(*ctx);
+ * //continues on dispatcher's thread
+ * @endcode
+ *
+ * Use it to run CPU work next to connections of the context instead of
+ * blocking the thread which resumed the coroutine
+ */
+class resume_on {
+public:
+    ///construct awaitable
+    /**
+     * @param ctx network context
+     * @param defer use INetContext::defer() instead of post(). When awaited on
+     * dispatcher's thread, the coroutine continues on the same thread after
+     * the current callback returns
+     */
+    resume_on(INetContext &ctx, bool defer = false):_ctx(ctx),_defer(defer) {}
+    static constexpr bool await_ready() noexcept {return false;}
+    void await_suspend(std::coroutine_handle<> h) {
+        SimpleAction fn([h]{h.resume();});
+        if (_defer) _ctx.defer(fn); else _ctx.post(fn);
+    }
+    static constexpr void await_resume() noexcept {}
+protected:
+    INetContext &_ctx;
+    bool _defer;
+};
+
 class coroutine {
 public:
     class promise_type {
@@ -20,12 +20,14 @@ struct LocalBus::TLSMsgQueueItem { // @suppress("Miss copy constructor or assign
     std::conditional_t<ref, const PTargetMapItem &, PTargetMapItem> channel;
     std::conditional_t<ref, const Message &, Message> message;
     IListener *listener;
+    std::conditional_t<ref, const std::shared_ptr<FanoutPool> &, std::shared_ptr<FanoutPool> > fanout;
 
     operator TLSMsgQueueItem<false>() const {
-        return {channel,  message, listener};
+        return {channel,  message, listener, fanout};
     }
 
     void execute() const noexcept {
+        if (channel->broadcast(fanout, channel, listener, message)) return;
         channel->broadcast(listener, message);
     }
 };
@@ -388,6 +390,7 @@ thread_local LocalBus::TLState LocalBus::TLState::_tls_state = {};
 
 bool LocalBus::forward_message_internal(IListener *listener,  const Message &msg) {
     PTargetMapItem ch;
+    std::shared_ptr<FanoutPool> fanout;
     ChannelID chanid = msg.get_channel();
 
     do{
@@ -406,6 +409,7 @@ bool LocalBus::forward_message_internal(IListener *listener,  const Message &msg
             auto own = citer->second->get_owner();
             if (own == listener || own == nullptr) {
                 ch = citer->second;
+                fanout = _fanout;
                 break;
             }
         }
@@ -424,7 +428,7 @@ bool LocalBus::forward_message_internal(IListener *listener,  const Message &msg
     } while (false);
 
     //process channel outside of lock (has own lock)
-    TLState::_tls_state.enqueue_msg({ch, msg, listener});
+    TLState::_tls_state.enqueue_msg({ch, msg, listener, fanout});
     return true;
 }
 
@@ -501,6 +505,24 @@ LocalBus::ChannelList LocalBus::get_active_channels(const IListener *listener,Ch
     return storage.get_channels();
 }
 
+LocalBus::ChannelList LocalBus::get_active_channels(ChannelListStorage &storage, std::span<const IListener * const>,
+                                                   std::vector<std::pair<const IListener *, std::size_t> > &exclusive) const {
+    //exclusive listeners are collected in the same pass, the listeners are not needed
+    std::lock_guard _(*this);
+    storage.clear();
+    exclusive.clear();
+    for (const auto &[k,v]: _channels) {
+        const IListener *lsn;
+        if (v->can_export_any(lsn)) {
+            if (lsn) exclusive.emplace_back(lsn, storage._channels.size());
+            storage._channels.push_back(k);
+            storage._locks.emplace_back(v, nullptr);
+        }
+    }
+    std::sort(exclusive.begin(), exclusive.end());
+    return storage.get_channels();
+}
+
 LocalBus::ChannelList LocalBus::get_subscribed_channels(const IListener *listener, ChannelListStorage &storage) const {
     std::lock_guard _(*this);
     storage.clear();
@@ -538,8 +560,59 @@ LocalBus::ChanDef::~ChanDef() {
 
 void LocalBus::ChanDef::broadcast(const IListener *lsn, const Message &msg) const {
     std::shared_lock _(_mx);
-    for (const auto &l: _listeners) {
-        if (l != lsn) l->on_message(msg, false);
+    auto deliver = [&]{
+        for (const auto &l: _listeners) {
+            if (l != lsn) l->on_message(msg, false);
+        }
+    };
+    if (_listeners.size() > 1) {
+        //bridges share serialized message
+        BroadcastScope scope(msg);
+        deliver();
+    } else {
+        deliver();
+    }
+}
+
+bool LocalBus::ChanDef::broadcast(const std::shared_ptr<FanoutPool> &pool, const std::shared_ptr<ITargetDef> &self, const IListener *lsn, const Message &msg) const {
+    auto small = [&]{return !pool || _listeners.size() <= pool->get_threshold();};
+    std::shared_ptr<FanoutPool> unused;     //released after locks, destructor waits for workers
+    std::shared_lock _(_mx);
+    if (_fanout_pending == 0 && small()) return false;
+    std::lock_guard lk(_fanout_mx);
+    //pending jobs must be delivered first, so the message goes to the same pool,
+    //even if the channel is small now or the pool has been replaced
+    if (_fanout_pending == 0) {
+        if (small()) return false;
+        _fanout_pool = pool;
+    }
+    _fanout_pool->queue(std::static_pointer_cast<const ChanDef>(self), msg, lsn, _listeners);
+    if (_fanout_pending == 0) unused = std::move(_fanout_pool);  //nothing queued (sender is the only listener)
+    return true;
+}
+
+void LocalBus::ChanDef::fanout_done() const {
+    std::shared_ptr<FanoutPool> pool;
+    {
+        std::lock_guard _(_fanout_mx);
+        if (--_fanout_pending == 0) pool = std::move(_fanout_pool);
+    }
+    //pool can be released here, after the lock
+}
+
+void LocalBus::ChanDef::deliver(const std::vector<IListener *> &listeners, const Message &msg) const {
+    std::shared_lock _(_mx);
+    //listener could unsubscribe after the message was queued
+    auto deliver = [&]{
+        for (IListener *l: listeners) {
+            if (std::binary_search(_listeners.begin(), _listeners.end(), l)) l->on_message(msg, false);
+        }
+    };
+    if (listeners.size() > 1) {
+        BroadcastScope scope(msg);
+        deliver();
+    } else {
+        deliver();
     }
 }
 
@@ -578,6 +651,15 @@ bool LocalBus::ChanDef::can_export(const IListener *lsn) const {
     return _listeners.size() > 1 || _listeners[0] != lsn;
 }
 
+bool LocalBus::ChanDef::can_export_any(const IListener *&exclusive) const {
+    std::shared_lock _(_mx);
+    exclusive = nullptr;
+    if (_owner) return false; //group is not exportable
+    if (_listeners.empty()) return false;   //don't export empty channels
+    if (_listeners.size() == 1) exclusive = _listeners[0];
+    return true;
+}
+
 ChannelID LocalBus::ChanDef::get_id() const {
     return _name; //no lock is needed (it is immutable)
 }
@@ -586,6 +668,85 @@ Bus LocalBus::create() {
     return Bus(std::make_shared<LocalBus>());
 }
 
+Bus LocalBus::create(const FanoutConfig &cfg) {
+    auto bus = std::make_shared<LocalBus>();
+    bus->set_fanout(cfg);
+    return Bus(std::move(bus));
+}
+
+void LocalBus::set_fanout(const FanoutConfig &cfg) {
+    std::shared_ptr<FanoutPool> pool;
+    if (cfg.threshold) pool = std::make_shared<FanoutPool>(cfg);
+    std::lock_guard _(*this);
+    std::swap(_fanout, pool);
+}
+
+LocalBus::FanoutPool::FanoutPool(const FanoutConfig &cfg)
+    :_threshold(cfg.threshold) {
+    unsigned int cnt = std::max(cfg.threads, 1U);
+    for (unsigned int i = 0; i < cnt; ++i) {
+        auto w = std::make_shared<Worker>();
+        //worker holds own state, because the pool can be destroyed by own worker
+        w->thr = std::thread([w]{worker(*w);});
+        _workers.push_back(std::move(w));
+    }
+}
+
+LocalBus::FanoutPool::~FanoutPool() {
+    for (auto &w: _workers) {
+        std::lock_guard _(w->mx);
+        w->stop = true;
+        w->cond.notify_all();
+    }
+    for (auto &w: _workers) {
+        if (w->thr.get_id() == std::this_thread::get_id()) w->thr.detach();
+        else w->thr.join();
+    }
+}
+
+void LocalBus::FanoutPool::queue(std::shared_ptr<const ChanDef> chan, const Message &msg, const IListener *sender, std::span<IListener * const> listeners) {
+    auto n = _workers.size();
+    std::vector<std::vector<IListener *> > split(n);
+    for (IListener *l: listeners) {
+        if (l == sender) continue;
+        //listener is always served by the same worker to keep order of its messages
+        auto h = (static_cast<std::uint64_t>(reinterpret_cast<std::uintptr_t>(l)) >> 4) * 0x9E3779B97F4A7C15ULL;
+        split[static_cast<std::size_t>(h >> 32) % n].push_back(l);
+    }
+    auto m = std::make_shared<const Message>(msg);
+    for (std::size_t i = 0; i < n; ++i) {
+        if (split[i].empty()) continue;
+        ++chan->_fanout_pending;
+        auto &w = *_workers[i];
+        std::lock_guard _(w.mx);
+        w.jobs.push_back({chan, m, std::move(split[i])});
+        w.cond.notify_one();
+    }
+}
+
+void LocalBus::FanoutPool::worker(Worker &w) noexcept {
+    std::unique_lock lk(w.mx);
+    while (true) {
+        w.cond.wait(lk, [&]{return w.stop || !w.jobs.empty();});
+        if (w.jobs.empty()) break;  //stop after all jobs are delivered
+        Job job = std::move(w.jobs.front());
+        w.jobs.pop_front();
+        lk.unlock();
+        run_job(job);
+        lk.lock();
+    }
+}
+
+void LocalBus::FanoutPool::run_job(const Job &job) noexcept {
+    //messages sent by listeners are queued the same way as on the publisher thread
+    auto &tls = TLState::_tls_state;
+    tls._running = true;
+    job.chan->deliver(job.listeners, *job.msg);
+    job.chan->fanout_done();
+    tls.run_msg_queue();
+    tls._running = false;
+}
+
 bool LocalBus::is_channel(ChannelID id) const {
     std::lock_guard _(*this);
     auto iter = _channels.find(id);
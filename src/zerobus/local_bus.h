@@ -10,6 +10,8 @@
 #include <memory_resource>
 #include <deque>
 #include <shared_mutex>
+#include <condition_variable>
+#include <thread>
 
 namespace zerobus {
 
@@ -26,6 +28,14 @@ class LocalBus: public IBridgeAPI,
                       public std::enable_shared_from_this<LocalBus> {
 public:
 
+    ///configuration of parallel fan-out
+    struct FanoutConfig {
+        ///broadcast to a channel with more listeners than this is done by the pool (0 - disabled)
+        std::size_t threshold = 0;
+        ///count of worker threads
+        unsigned int threads = std::thread::hardware_concurrency();
+    };
+
     LocalBus();
 
     virtual bool subscribe(IListener *listener, ChannelID channel) override;
@@ -34,6 +44,8 @@ public:
     virtual bool send_message(IListener *listener, ChannelID channel, MessageContent msg, ConversationID cid) override;
     virtual bool dispatch_message(IListener *listener, const Message &msg, bool subscribe_return_path) override;
     virtual ChannelList get_active_channels(const IListener *listener, ChannelListStorage &storage) const override;
+    virtual ChannelList get_active_channels(ChannelListStorage &storage, std::span<const IListener * const> listeners,
+                                            std::vector<std::pair<const IListener *, std::size_t> > &exclusive) const override;
     virtual ChannelList get_subscribed_channels(const IListener *listener, ChannelListStorage &storage) const override;
     virtual void register_monitor(IMonitor *mon) override;
     virtual void unregister_monitor(const IMonitor *mon) override;
@@ -52,6 +64,25 @@ public:
 
     ///Create local message broker;
     static Bus create();
+    ///Create local message broker with parallel fan-out
+    /**
+     * @param cfg fan-out configuration
+     * @see set_fanout
+     */
+    static Bus create(const FanoutConfig &cfg);
+
+    ///set parallel fan-out
+    /**
+     * Broadcast to a channel with many listeners is split by listeners to worker threads.
+     * Every listener is always served by the same worker, so each listener receives
+     * messages of the channel in order. The sending function returns once the message
+     * is queued.
+     *
+     * @param cfg new configuration. It can be changed while messages are sent. A channel
+     * which has messages queued in the previous pool keeps using that pool until they
+     * are delivered, so the order per listener is kept
+     */
+    void set_fanout(const FanoutConfig &cfg);
 
     void lock() const;
     void unlock() const;
@@ -63,10 +94,25 @@ protected:
     template<typename T>
     using mvector = std::vector<T, std::pmr::polymorphic_allocator<T> >;
 
+    class FanoutPool;
+
     class ITargetDef {
     public:
         virtual ~ITargetDef() = default;
         virtual void broadcast(const IListener *lsn, const Message &msg) const = 0;
+        ///broadcast using fan-out pool
+        /**
+         * @param pool current pool (can be nullptr)
+         * @param self shared pointer to this object
+         * @param lsn sender
+         * @param msg message
+         * @retval true message has been queued
+         * @retval false message must be broadcast by broadcast()
+         */
+        virtual bool broadcast(const std::shared_ptr<FanoutPool> &pool, const std::shared_ptr<ITargetDef> &self, const IListener *lsn, const Message &msg) const {
+            (void)pool; (void)self; (void)lsn; (void)msg;
+            return false;
+        }
 
     };
 
@@ -105,6 +151,12 @@ protected:
         bool remove_listener(IListener *lsn);
         ///determines whether channel can be exported seen from perspective or listener
         bool can_export(const IListener *lsn) const;
+        ///determines whether channel can be exported and whether it has only one listener
+        /**
+         * @param exclusive receives the only listener, or nullptr if there are more listeners
+         * @return true if the channel can be exported (to any listener except exclusive)
+         */
+        bool can_export_any(const IListener *&exclusive) const;
         ///retrieve id
         ChannelID get_id() const;
 
@@ -113,6 +165,11 @@ protected:
         void set_owner(IListener *owner) {_owner = owner;}
 
         virtual void broadcast(const IListener *lsn, const Message &msg) const override;
+        virtual bool broadcast(const std::shared_ptr<FanoutPool> &pool, const std::shared_ptr<ITargetDef> &self, const IListener *lsn, const Message &msg) const override;
+        ///deliver message queued by the pool to listeners which are still subscribed
+        void deliver(const std::vector<IListener *> &listeners, const Message &msg) const;
+        ///called by the pool when a queued job is done
+        void fanout_done() const;
 
         bool has(const IListener *lsn) const;
     protected:
@@ -120,6 +177,50 @@ protected:
         IListener *_owner = {}; //owner of group;
         mvector<IListener *> _listeners; //list of listeners. Nullptr are skipped
         mutable std::shared_mutex _mx;
+        mutable std::mutex _fanout_mx;                              //protects _fanout_pool and changes of _fanout_pending
+        mutable std::shared_ptr<FanoutPool> _fanout_pool;           //pool which has queued jobs of this channel
+        mutable std::atomic<unsigned int> _fanout_pending = {0};   //queued jobs, they must be delivered before next messages
+
+        friend class FanoutPool;
+    };
+
+    ///worker threads of parallel fan-out
+    class FanoutPool {
+    public:
+        FanoutPool(const FanoutConfig &cfg);
+        ///delivers queued messages and stops workers
+        ~FanoutPool();
+        FanoutPool(const FanoutPool &) = delete;
+        FanoutPool &operator=(const FanoutPool &) = delete;
+
+        std::size_t get_threshold() const {return _threshold;}
+        ///queue message to listeners, one job per worker
+        /**
+         * @param chan channel
+         * @param msg message
+         * @param sender sender, it is skipped
+         * @param listeners listeners of the channel
+         */
+        void queue(std::shared_ptr<const ChanDef> chan, const Message &msg, const IListener *sender, std::span<IListener * const> listeners);
+
+    protected:
+        struct Job {
+            std::shared_ptr<const ChanDef> chan;
+            std::shared_ptr<const Message> msg;
+            std::vector<IListener *> listeners;
+        };
+        struct Worker {
+            std::mutex mx;
+            std::condition_variable cond;
+            std::deque<Job> jobs;
+            bool stop = false;
+            std::thread thr;
+        };
+        std::size_t _threshold;
+        std::vector<std::shared_ptr<Worker> > _workers;
+
+        static void worker(Worker &w) noexcept;
+        static void run_job(const Job &job) noexcept;
     };
 
     struct BackPathItem { // @suppress("Miss copy constructor or assignment operator")
@@ -195,6 +296,7 @@ protected:
     std::string _cur_serial;            //current serial id
     IListener *_serial_source = {};     //listener which sets _cur_serial
     mutable bool _channels_change = false;
+    std::shared_ptr<FanoutPool> _fanout;    //pool of parallel fan-out (nullptr - disabled)
     mutable unsigned int _recursion = 0;
     ///erase mailbox
     /**
@@ -4,9 +4,11 @@
 #include <string_view>
 #include <memory>
 #include <chrono>
+#include <cstdint>
 #include <functional>
 #include <source_location>
 #include <stop_token>
+#include <vector>
 
 namespace zerobus {
 
@@ -17,7 +19,17 @@ class IPeer;
 class IServer;
 
 ///Identification of connection (server socket)
-using ConnHandle = unsigned int;
+/**
+ * The handle is opaque. It contains a generation counter, so a handle
+ * of a destroyed connection never refers to a connection created later
+ */
+using ConnHandle = std::uint64_t;
+
+///Value which doesn't identify any connection
+constexpr ConnHandle no_connection = static_cast<ConnHandle>(-1);
+
+///Identification of a timer
+using TimerID = std::uint64_t;
 
 enum class SpecialConnection {
     /** not actual connection - you can use for on_timer feature */
@@ -40,10 +52,44 @@ struct PipePair {
     ConnHandle write;
 };
 
+///Options applied to the socket of a connection
+/**
+ * Options related to TCP are ignored for unix sockets. Zero means system default
+ */
+struct SocketOptions {
+    ///disable Nagle's algorithm (TCP_NODELAY)
+    bool nodelay = true;
+    ///coalesce data sent from callbacks of the connection
+    /**
+     * Data sent while a callback of the connection is running are sent with
+     * MSG_MORE. The kernel pushes them out when the callback returns, so
+     * a burst of small messages is sent in full segments.
+     * (Linux only)
+     */
+    bool cork = false;
+    ///enable TCP keepalive
+    bool keepalive = false;
+    ///size of send buffer in bytes (SO_SNDBUF)
+    int send_buffer = 0;
+    ///size of receive buffer in bytes (SO_RCVBUF)
+    int recv_buffer = 0;
+    ///idle time in seconds before keepalive probes are sent (TCP_KEEPIDLE)
+    int keepalive_idle = 0;
+    ///interval in seconds between keepalive probes (TCP_KEEPINTVL)
+    int keepalive_interval = 0;
+    ///count of unanswered probes before connection is dropped (TCP_KEEPCNT)
+    int keepalive_count = 0;
+    ///time in microseconds to busy poll the device queue on blocking receive (SO_BUSY_POLL, Linux only)
+    int busy_poll = 0;
+};
+
 class SimpleAction { // @suppress("Miss copy constructor or assignment operator")
 public:
     static constexpr std::size_t _max_lambda_size = sizeof(void *) * 7;
+    ///construct empty action
+    SimpleAction() = default;
     template<std::invocable<> Fn>
+    requires(!std::is_same_v<std::decay_t<Fn>, SimpleAction>)
     SimpleAction(Fn &&fn) {
         using TFn = std::decay_t<Fn>;
         static_assert(sizeof(TFn) <= _max_lambda_size && std::is_trivially_copy_constructible_v<TFn>);
@@ -59,6 +105,9 @@ public:
         _run_fn(this);
     }
 
+    ///returns true if action is not empty
+    explicit operator bool() const {return _run_fn != nullptr;}
+
 protected:
     void (* _run_fn)(SimpleAction *) = {};
     char _space[_max_lambda_size] = {};
@@ -73,7 +122,9 @@ public:
 
     ///connects peer to an address
     /**
-     * @param address_port address:port of target
+     * @param address_port address:port of target. Use unix:/path or unix:@name
+     * (abstract namespace) to connect unix socket
+     * @param opts socket options. They are kept for reconnect()
      * @return if connection is successful (still pending to connect but valid),
      * return handle to the connection.
      * @exception std::system_error when connection cannot be established
@@ -81,18 +132,21 @@ public:
      @note you should create IPeer for the result
      *
      */
-    virtual ConnHandle connect(std::string address_port) = 0;
+    virtual ConnHandle connect(std::string address_port, const SocketOptions &opts = {}) = 0;
 
     ///creates server
     /**
-     * @param address_port address:port where open port
+     * @param address_port address:port where open port. Use unix:/path or unix:@name
+     * (abstract namespace) to listen on unix socket. Stale socket file
+     * is replaced and it is removed when the server is destroyed
+     * @param opts socket options applied to accepted connections
      * @return if connection is successful (still pending to connect but valid),
      * return handle to the connection.
      * @exception std::system_error when connection cannot be established
      *
      * @note you should create IServer for the result
      */
-    virtual ConnHandle create_server(std::string address_port) = 0;
+    virtual ConnHandle create_server(std::string address_port, const SocketOptions &opts = {}) = 0;
 
     ///create pipe
     /**
@@ -145,6 +199,21 @@ public:
      * @param peer pointer to peer, which receives callback, when receive is successful
      */
     virtual void receive(ConnHandle connection, std::span<char> buffer, IPeer *peer) = 0;
+    ///start receiving data into a buffer managed by the context
+    /**
+     * The context keeps a buffer for each connection. Its size follows observed
+     * reads, it grows when reads fill it and shrinks when reads are small
+     * for a while. While data are available, the context keeps reading and calling
+     * the peer (as long as the peer requests next receive from the callback)
+     * until the fairness budget is exhausted.
+     *
+     * @param connection connection handle
+     * @param peer pointer to peer, which receives callback, when receive is successful
+     *
+     * @note data passed to receive_complete() are valid only until the callback
+     * returns or until receive() is called again.
+     */
+    virtual void receive(ConnHandle connection, IPeer *peer) = 0;
     ///Send a data
     /**
      * @param connection connection handle
@@ -157,6 +226,33 @@ public:
      * need to requst callback_on_send_available
      */
     virtual std::size_t send(ConnHandle connection, std::string_view data) = 0;
+    ///Send a data composed from multiple segments
+    /**
+     * Segments are sent in order as one continuous stream using single system call
+     * (scatter-gather), so caller doesn't need to concatenate them.
+     *
+     * @param connection connection handle
+     * @param data segments to send. If total size of all segments is zero, it
+     * causes sending EOF, which closes connection.
+     * @return count of bytes written in total. If the value is less than total size
+     * of the segments, the rest must be sent later. Meaning of zero is the same
+     * as in case of send()
+     */
+    virtual std::size_t send(ConnHandle connection, std::span<const std::string_view> data) = 0;
+    ///Send a data, which are kept alive by an owner object
+    /**
+     * Works as send(), but the context is allowed to transmit the data without
+     * copying them (zero copy). In this case, the context holds the owner until
+     * the kernel reports, that data are no longer needed. The caller must not
+     * modify the data while the owner is held.
+     *
+     * @param connection connection handle
+     * @param data segments to send.
+     * @param owner object which keeps data alive. It is released by the context
+     * later, its destructor must not call the context.
+     * @return count of bytes written (see send())
+     */
+    virtual std::size_t send(ConnHandle connection, std::span<const std::string_view> data, std::shared_ptr<const void> owner) = 0;
     ///notifies context that peer is ready to send data
     /**
      * Result of this call is calling function clear_to_send(), when send is possible.
@@ -172,6 +268,42 @@ public:
      */
     virtual void ready_to_send(ConnHandle connection, IPeer *peer) = 0;
 
+    ///write data through the write queue of the connection
+    /**
+     * Data are written immediately as much as possible, the rest is stored
+     * in the queue managed by the context and written when the connection becomes
+     * writable. The caller doesn't need to wait for clear_to_send().
+     *
+     * @param connection connection handle
+     * @param data segments to write. Data are copied
+     * @retval true data written or queued
+     * @retval false connection is closed or writing failed. Data are dropped
+     *
+     * @note don't combine with send() on the same connection, unless the queue is empty
+     */
+    virtual bool write(ConnHandle connection, std::span<const std::string_view> data) = 0;
+
+    ///write data through the write queue of the connection without copying
+    /**
+     * @param connection connection handle
+     * @param data segments to write
+     * @param owner object which keeps data alive until they are written
+     * @retval true data written or queued
+     * @retval false connection is closed or writing failed. Data are dropped
+     */
+    virtual bool write(ConnHandle connection, std::span<const std::string_view> data, std::shared_ptr<const void> owner) = 0;
+
+    ///retrieve count of bytes waiting in the write queue
+    virtual std::size_t get_queued_bytes(ConnHandle connection) const = 0;
+
+    ///request notification when the write queue is flushed
+    /**
+     * @param connection connection handle
+     * @param peer its clear_to_send() is called once the write queue is empty, or
+     * when writing failed (then next write() returns false)
+     */
+    virtual void wait_for_flush(ConnHandle connection, IPeer *peer) = 0;
+
 
     ///request to accept next connection
     /**
@@ -207,19 +339,72 @@ public:
      */
     virtual void enqueue(SimpleAction fn) = 0;
 
+    ///Run a function on dispatcher's thread
+    /**
+     * The function is never executed inside of the call, even if it is called
+     * from dispatcher's thread. Same as enqueue()
+     *
+     * @param fn function to execute
+     */
+    virtual void post(SimpleAction fn) = 0;
+
+    ///Run a function on current dispatcher's thread once the current callback returns
+    /**
+     * If called from dispatcher's thread, the function is executed by the same thread
+     * before it waits for next events, so other threads are not woken up and data
+     * touched by the callback are still in the cache of the CPU. Otherwise it
+     * is same as post()
+     *
+     * @param fn function to execute
+     */
+    virtual void defer(SimpleAction fn) = 0;
+
+    ///Run a function immediately if called from dispatcher's thread, otherwise post it
+    /**
+     * @param fn function to execute
+     */
+    virtual void dispatch(SimpleAction fn) = 0;
+
+    ///Determines, whether current thread is dispatcher's thread of this context
+    virtual bool on_loop() const = 0;
+
 
     ///sets timeout at given time
     /**
-     * @param tp timeout point
+     * @param tp timeout point (monotonic clock)
      * @param p peer or server object
      *
      * If a timeout is set, it works as clear_timeout + set_timeout
      */
-    virtual void set_timeout(ConnHandle connection, std::chrono::system_clock::time_point tp, IPeerServerCommon *p) = 0;
+    virtual void set_timeout(ConnHandle connection, std::chrono::steady_clock::time_point tp, IPeerServerCommon *p) = 0;
 
     ///Clear existing timeout
     virtual void clear_timeout(ConnHandle connection) = 0;
 
+    ///Sets a timer
+    /**
+     * Unlike set_timeout(), there can be many timers for a single connection
+     * and the timer doesn't need a connection at all.
+     *
+     * @param connection connection which owns the timer. The timer is canceled
+     * when the connection is destroyed. Its action is called as a callback of the
+     * connection, so destroy() waits for its completion. Use no_connection
+     * if the timer doesn't belong to any connection
+     * @param tp time point when action is called (monotonic clock)
+     * @param action action to call
+     * @return id of the timer, which can be used to cancel the timer. Function
+     * returns 0 if the timer was not set (invalid connection or tp is time_point::max())
+     */
+    virtual TimerID set_timer(ConnHandle connection, std::chrono::steady_clock::time_point tp, SimpleAction action) = 0;
+
+    ///Cancels the timer
+    /**
+     * @param id id of the timer
+     * @retval true timer canceled
+     * @retval false timer not found, it was already fired or canceled
+     */
+    virtual bool cancel_timer(TimerID id) = 0;
+
     ///Determines, whether current execution is made in a callback
     /**
      * @retval true we are currently in callback, we cannot destroy the connection
@@ -286,8 +471,55 @@ public:
 using ErrorCallback = std::function<void(std::string_view, std::source_location)>;
 
 
+///Configuration of network context
+struct NetContextConfig {
+    ///count of IO threads
+    int iothreads = 1;
+    ///error callback (for logging purpose), can be empty
+    ErrorCallback error_callback = {};
+    ///register sockets as edge triggered (Linux)
+    /** When enabled, every socket is registered once and its readiness is cached,
+     * so repeated receive() and ready_to_send() don't need a system call.
+     * When disabled, sockets are re-armed as one-shot after every operation
+     */
+    bool edge_triggered = true;
+    ///maximum bytes read from a single connection before other connections are served
+    std::size_t read_budget = 256*1024;
+    ///minimal size of data sent with owner to use zero copy transmission. Zero disables zero copy
+    /**
+     * Zero copy avoids copying data to the kernel, but the kernel must notify
+     * completion of each transmission, which is expensive for small messages.
+     * It is only used for data sent with owner. If the kernel copies data
+     * anyway (for example on loopback), zero copy is disabled for the connection.
+     */
+    std::size_t zerocopy_threshold = 0;
+    ///access mode of unix socket file created by create_server() (for example 0660). Zero keeps mode given by umask
+    unsigned int unix_socket_mode = 0;
+    ///maximum connections accepted on a single readiness event of a server (Linux)
+    /** The server must request next accept from on_accept(), otherwise only one
+     * connection is accepted */
+    unsigned int accept_batch = 64;
+    ///how long are resolved host names cached (Linux)
+    std::chrono::seconds dns_cache_ttl = std::chrono::seconds(60);
+    ///how long is failed resolution cached (Linux)
+    /** During this time, connections to the same host are reported as lost without asking DNS */
+    std::chrono::seconds dns_negative_ttl = std::chrono::seconds(5);
+    ///maximum count of threads resolving host names in parallel (Linux)
+    /** A slow DNS server occupies one thread only, other hosts are resolved by the remaining threads */
+    unsigned int dns_threads = 4;
+    ///how long an IO thread polls for events before it goes to sleep (Linux). Zero disables busy polling
+    /** Busy polling avoids the wake-up latency of a sleeping thread for the price
+     * of CPU time. TCP sockets which don't set SocketOptions::busy_poll get SO_BUSY_POLL
+     * with the same budget. If the process is not permitted to set it, the failure
+     * is reported through the error callback and the socket is used without it */
+    std::chrono::microseconds busy_poll = {};
+    ///CPU cores for IO threads (Linux). Thread N is pinned to cpu_affinity[N % size]. Empty disables pinning
+    std::vector<int> cpu_affinity = {};
+};
+
 std::shared_ptr<INetContext> make_network_context(int iothreads = 1);
 std::shared_ptr<INetContext> make_network_context(ErrorCallback errcb, int iothreads = 1);
+std::shared_ptr<INetContext> make_network_context(const NetContextConfig &cfg);
 
 
 ///creates server which calls a user callback with data required to create a new peer
@@ -1,14 +1,25 @@
 #include "network_linux.h"
 
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <limits>
 #include <utility>
 
 #include <arpa/inet.h>
 #include <stdexcept>
 #include <sys/eventfd.h>
 #include <sys/socket.h>
-#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <linux/errqueue.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
 #include <sys/un.h>
 #include <netdb.h>
+#include <pthread.h>
+#include <sched.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fcntl.h>
 #include <map>
 #include <signal.h>
@@ -21,7 +32,7 @@ extern char **environ;
 namespace zerobus {
 
 
-std::string sockaddr_to_string(const sockaddr* addr) {
+std::string sockaddr_to_string(const sockaddr* addr, socklen_t slen) {
     char host[NI_MAXHOST] = {0};
     char port[NI_MAXSERV] = {0};
 
@@ -46,7 +57,15 @@ std::string sockaddr_to_string(const sockaddr* addr) {
 
         case AF_UNIX: {  // Unix socket
             const sockaddr_un* unix_addr = reinterpret_cast<const sockaddr_un*>(addr);
-            return "unix:" + std::string(unix_addr->sun_path);
+            constexpr std::size_t path_ofs = offsetof(sockaddr_un, sun_path);
+            //unnamed socket (typical for the client side) has no path at all
+            if (slen <= path_ofs) return "unix:";
+            std::size_t len = std::min<std::size_t>(slen - path_ofs, sizeof(unix_addr->sun_path));
+            if (unix_addr->sun_path[0] == 0) {
+                //abstract namespace, the name is not terminated, it can contain zeroes
+                return "unix:@" + std::string(unix_addr->sun_path + 1, len - 1);
+            }
+            return "unix:" + std::string(unix_addr->sun_path, strnlen(unix_addr->sun_path, len));
         }
 
         default:
@@ -59,107 +78,220 @@ static void default_log_function(std::string_view, std::source_location ) {
     //empty
 }
 
-NetContext::NetContext(ErrorCallback ecb)
-    :_ecb(std::move(ecb))
-    ,_tmset(TimeoutSet::allocator_type(&_pool))
+NetContext::NetContext(const NetContextConfig &cfg)
+    :_ecb(cfg.error_callback?cfg.error_callback:ErrorCallback(&default_log_function))
+    ,_edge_triggered(cfg.edge_triggered)
+    ,_read_budget(cfg.read_budget)
+    ,_zerocopy_threshold(cfg.zerocopy_threshold)
+    ,_unix_socket_mode(cfg.unix_socket_mode)
+    ,_accept_batch(std::max(cfg.accept_batch, 1U))
+    ,_busy_poll(cfg.busy_poll)
+    ,_resolver(cfg.dns_cache_ttl, cfg.dns_negative_ttl, cfg.dns_threads)
  {
+    _timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC|TFD_NONBLOCK);
+    if (_timerfd < 0) throw std::system_error(errno, std::system_category(), "timerfd_create failed");
+    _epoll.add(_timerfd, EPOLLIN|EPOLLET, timer_ident);
+    _task_efd = eventfd(0, EFD_CLOEXEC|EFD_NONBLOCK);
+    if (_task_efd < 0) throw std::system_error(errno, std::system_category(), "eventfd failed");
+    _epoll.add(_task_efd, EPOLLIN|EPOLLET, task_ident);
 }
 
-NetContext::NetContext(): NetContext(&default_log_function) {}
-
-
+NetContext::NetContext(): NetContext(NetContextConfig{}) {}
 
-std::chrono::system_clock::time_point NetContext::get_epoll_timeout_lk() {
-    if (!_tmset.empty()) {
-        return _tmset.begin()->first;
-    }
-    return std::chrono::system_clock::time_point::max();
+NetContext::~NetContext() {
+    _resolver.stop();
+    ::close(_timerfd);
+    ::close(_task_efd);
+    auto t = _tasks.exchange(nullptr);
+    while (t) delete std::exchange(t, t->_next);
 }
 
+
 NetContext::SocketInfo *NetContext::alloc_socket_lk() {
-    while (_first_free_socket_ident >= _sockets.size()) {
-       _sockets.push_back(std::make_unique<SocketInfo>());
-       _sockets.back()->_ident = static_cast<ConnHandle>(_sockets.size());
-   }
-   SocketInfo *nfo = _sockets[_first_free_socket_ident].get();
-   std::swap(nfo->_ident,_first_free_socket_ident);
-   return nfo;
+    if (_first_free_socket == no_free_socket) {
+        //allocate new block and put its slots to the free list (in order)
+        auto first = static_cast<std::uint32_t>(_sockets.size() * socket_block_size);
+        _sockets.push_back(std::make_unique<SocketBlock>());
+        auto &blk = *_sockets.back();
+        for (std::uint32_t i = 0; i < socket_block_size - 1; ++i) blk[i]._next_free = first + i + 1;
+        _first_free_socket = first;
+    }
+    auto index = _first_free_socket;
+    SocketInfo *nfo = &socket_at(index);
+    _first_free_socket = std::exchange(nfo->_next_free, no_free_socket);
+    nfo->_ident = make_handle(index, nfo->_generation);
+    return nfo;
 }
 
 void NetContext::free_socket_lk(ConnHandle id) {
-    SocketInfo *nfo = _sockets[id].get();
+    auto index = handle_index(id);
+    SocketInfo *nfo = &socket_at(index);
+    auto gen = nfo->_generation + 1;
     std::destroy_at(nfo);
     std::construct_at(nfo);
-    nfo->_ident = _first_free_socket_ident;
-    _first_free_socket_ident = id;
+    //stale handles of this slot are no longer valid
+    nfo->_generation = gen?gen:1;
+    nfo->_next_free = _first_free_socket;
+    _first_free_socket = index;
 }
 
 NetContext::SocketInfo *NetContext::socket_by_ident(ConnHandle id) {
-    if (id >= _sockets.size()) return nullptr;
-    auto r = _sockets[id].get();
+    auto index = handle_index(id);
+    if (index >= _sockets.size() * socket_block_size) return nullptr;
+    auto r = &socket_at(index);
+    return r->_ident == id?r:nullptr;
+}
+
+const NetContext::SocketInfo *NetContext::socket_by_ident(ConnHandle id) const {
+    auto index = handle_index(id);
+    if (index >= _sockets.size() * socket_block_size) return nullptr;
+    auto r = &socket_at(index);
     return r->_ident == id?r:nullptr;
 }
 
 
+static thread_local int current_callback_cntr = 0;
+static thread_local const NetContext *current_reactor = nullptr;
+//tasks deferred by callbacks running on this thread (see defer())
+static thread_local std::vector<SimpleAction> deferred_tasks;
+
+bool NetContext::run_tasks(const std::stop_token &tkn) {
+    std::vector<SimpleAction> deferred;
+    while (true) {
+        std::swap(deferred, deferred_tasks);
+        //stack is reversed to execute tasks in order of posting
+        TaskNode *lst = nullptr;
+        TaskNode *t = _tasks.exchange(nullptr, std::memory_order_acquire);
+        while (t) {
+            auto n = std::exchange(t, t->_next);
+            n->_next = lst;
+            lst = n;
+        }
+        if (deferred.empty() && !lst) return true;
+        for (auto &x: deferred) {
+            x();
+        }
+        deferred.clear();
+        while (lst) {
+            auto n = std::exchange(lst, lst->_next);
+            n->_fn();
+            delete n;
+        }
+        if (tkn.stop_requested()) return false;
+    }
+}
+
 void NetContext::run_worker(std::stop_token tkn, int efd)  {
     std::unique_lock lk(_mx);
     std::stop_callback __(tkn, [&]{
         eventfd_write(efd, 1);
     });
 
-    std::vector<SimpleAction> actions;
+    std::vector<ConnHandle> ready;
 
     _epoll.add(efd, EPOLLIN, -1);
+    current_reactor = this;
 
     while (!tkn.stop_requested()) {
-        auto timeout = std::chrono::system_clock::time_point::max();
-        int needfd = -1;
-        bool timeout_thread = false;
-        if (_cur_timer_thread.compare_exchange_strong(needfd, efd)) {
-            timeout = get_epoll_timeout_lk();
-            timeout_thread= true;
-        }
+        //process sockets with cached readiness first, they don't need epoll
+        process_ready_list_lk(lk, ready);
         lk.unlock();
-        auto res = _epoll.wait(timeout);
+        bool cont = run_tasks(tkn);
         lk.lock();
-        if (timeout_thread) {
-            _cur_timer_thread = -1;
+        if (!cont) break;
+        //if there are still ready sockets, just poll to be fair to other sockets
+        bool poll_only = !_ready_list.empty();
+        std::optional<WaitRes> res;
+        if (!poll_only && _busy_poll.count()) {
+            lk.unlock();
+            res = spin_wait(tkn);
+            lk.lock();
+            //spinning was interrupted by work which doesn't come through epoll
+            if (!res && (!_ready_list.empty() || _tasks.load(std::memory_order_relaxed))) continue;
         }
         if (!res) {
-            auto now = std::chrono::system_clock::now();
-            while (!_tmset.empty()) {
-                auto iter = _tmset.begin();
-                if (iter->first > now) break;
-                ConnHandle id = iter->second;
-                _tmset.erase(iter);
-                SocketInfo *nfo = socket_by_ident(id);
-                if (nfo && nfo->_timeout_cb) {
-                    auto cb = std::exchange(nfo->_timeout_cb, nullptr);
-                    nfo->invoke_cb(lk, _cond, [&]{cb->on_timeout();});
-                }
+            int needfd = -1;
+            bool wait_thread = !poll_only && _cur_wait_thread.compare_exchange_strong(needfd, efd);
+            if (!poll_only) _sleep_count.fetch_add(1, std::memory_order_relaxed);
+            lk.unlock();
+            res = _epoll.wait(poll_only?0:-1);
+            lk.lock();
+            if (wait_thread) {
+                _cur_wait_thread = -1;
             }
-        } else {
+        }
+        if (res) {
             auto &e = *res;
-            if (e.ident != static_cast<ConnHandle>(-1)) {
+            if (e.ident == timer_ident) {
+                process_timers_lk(lk);
+            } else if (e.ident == task_ident) {
+                //tasks are executed at the beginning of next cycle
+                eventfd_t dummy;
+                eventfd_read(_task_efd, &dummy);
+            } else if (e.ident != static_cast<ConnHandle>(-1)) {
                 process_event_lk(lk, e);
             } else {
                 eventfd_t dummy;
                 eventfd_read(efd, &dummy);
             }
         }
-        std::swap(actions, _actions);
-        while (!actions.empty()) {
-            lk.unlock();
-            for (auto &x: actions) {
-                x();
-                if (tkn.stop_requested()) return;
-            }
-            actions.clear();
-            lk.lock();
-            std::swap(actions, _actions);
+    }
+    current_reactor = nullptr;
+}
+
+std::optional<NetContext::WaitRes> NetContext::spin_wait(const std::stop_token &tkn) {
+    auto deadline = std::chrono::steady_clock::now() + _busy_poll;
+    do {
+        auto res = _epoll.wait(0);
+        if (res) {
+            _spin_hit_count.fetch_add(1, std::memory_order_relaxed);
+            return res;
+        }
+        _spin_count.fetch_add(1, std::memory_order_relaxed);
+        if (_ready_signal.load(std::memory_order_relaxed) || _tasks.load(std::memory_order_relaxed)) break;
+    } while (!tkn.stop_requested() && std::chrono::steady_clock::now() < deadline);
+    return {};
+}
+
+void NetContext::process_ready_list_lk(std::unique_lock<std::mutex> &lk, std::vector<ConnHandle> &tmp) {
+    if (_ready_list.empty()) return;
+    std::swap(tmp, _ready_list);
+    _ready_signal.store(false, std::memory_order_relaxed);
+    for (ConnHandle id: tmp) {
+        auto ctx = socket_by_ident(id);
+        if (!ctx || !ctx->_in_ready_list) continue;
+        ctx->_in_ready_list = false;
+        process_ready_lk(lk, ctx);
+    }
+    tmp.clear();
+}
+
+void NetContext::request_lk(SocketInfo *ctx) {
+    if (ctx->_flags & ctx->_ready) {
+        if (!ctx->_in_ready_list) {
+            ctx->_in_ready_list = true;
+            _ready_list.push_back(ctx->_ident);
+            _ready_signal.store(true, std::memory_order_relaxed);
+            //reactor thread processes the list before it returns to epoll
+            if (current_reactor != this) wakeup_lk();
         }
+    } else {
+        apply_flags_lk(ctx);
     }
+}
 
+void NetContext::wakeup_lk() {
+    int fd = _cur_wait_thread;
+    if (fd >= 0) {
+        _wakeup_count.fetch_add(1, std::memory_order_relaxed);
+        eventfd_write(fd, 1);
+    }
+}
+
+int NetContext::initial_events(bool listen) const {
+    if (!_edge_triggered) return 0;
+    if (listen) return EPOLLIN|EPOLLET;
+    return EPOLLIN|EPOLLOUT|EPOLLRDHUP|EPOLLET;
 }
 
 void NetContext::receive(ConnHandle ident, std::span<char> buffer, IPeer *peer) {
@@ -168,15 +300,48 @@ void NetContext::receive(ConnHandle ident, std::span<char> buffer, IPeer *peer)
     if (!ctx) return;
     ctx->_flags |= EPOLLIN;
     ctx->_recv_buffer = buffer;
+    ctx->_use_own_buffer = false;
+    ctx->_recv_cb = peer;
+    request_lk(ctx);
+}
+
+void NetContext::receive(ConnHandle ident, IPeer *peer) {
+    std::lock_guard _(_mx);
+    auto ctx = socket_by_ident(ident);
+    if (!ctx) return;
+    ctx->_flags |= EPOLLIN;
+    ctx->_recv_buffer = {};
+    ctx->_use_own_buffer = true;
     ctx->_recv_cb = peer;
-    apply_flags_lk(ctx);
+    request_lk(ctx);
 }
 
 std::size_t NetContext::send(ConnHandle ident, std::string_view data) {
+    return send(ident, std::span<const std::string_view>(&data, 1));
+}
+
+std::size_t NetContext::send(ConnHandle ident, std::span<const std::string_view> data) {
+    return send(ident, data, nullptr);
+}
+
+std::size_t NetContext::send(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) {
+    //segments above this count are left for next send
+    constexpr std::size_t max_segments = 64;
+    iovec iov[max_segments];
+    std::size_t cnt = 0;
+    std::size_t total = 0;
+    for (const auto &seg: data) {
+        if (seg.empty()) continue;
+        if (cnt == max_segments) break;
+        iov[cnt].iov_base = const_cast<char *>(seg.data());
+        iov[cnt].iov_len = seg.size();
+        total += seg.size();
+        ++cnt;
+    }
     std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx) return 0;
-    if (data.empty()) {
+    if (total == 0) {
         if (ctx->_socket_is_pipe) {
             if (ctx->_socket >= 0) {
                 _epoll.del(ctx->_socket);
@@ -188,33 +353,299 @@ std::size_t NetContext::send(ConnHandle ident, std::string_view data) {
         }
         return 0;
     } else {
-        int s;
+        ssize_t s;
+        if (ctx->_socket < 0) return 0;     //connection failed
+        _send_count.fetch_add(1, std::memory_order_relaxed);
+        int more = 0;
+        if (ctx->_options.cork && ctx->_cb_call_cntr) {
+            //inside callback of this connection, data are pushed when the callback returns
+            more = MSG_MORE;
+            ctx->_corked = true;
+        }
         if (ctx->_socket_is_pipe) {
-            s = ::write(ctx->_socket, data.data(), data.size());
+            s = ::writev(ctx->_socket, iov, static_cast<int>(cnt));
         } else {
-            s = ::send(ctx->_socket, data.data(), data.size(), MSG_DONTWAIT);
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = cnt;
+            bool zerocopy = owner && _zerocopy_threshold && total >= _zerocopy_threshold
+                            && ctx->_zerocopy != ZeroCopy::disabled;
+            if (zerocopy && ctx->_zerocopy == ZeroCopy::unknown) {
+                int one = 1;
+                bool ok = setsockopt(ctx->_socket, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one)) == 0;
+                ctx->_zerocopy = ok?ZeroCopy::enabled:ZeroCopy::disabled;
+                zerocopy = ok;
+            }
+            if (zerocopy) {
+                s = ::sendmsg(ctx->_socket, &msg, MSG_DONTWAIT|MSG_NOSIGNAL|MSG_ZEROCOPY|more);
+                if (s >= 0) {
+                    //every successful call is counted, even if it sent only a part
+                    ctx->_zerocopy_pending.push_back({ctx->_zerocopy_seq++, std::move(owner)});
+                    _zerocopy_count.fetch_add(1, std::memory_order_relaxed);
+                } else if (errno == ENOBUFS) {
+                    //out of memory for pinning pages, send by copying
+                    s = ::sendmsg(ctx->_socket, &msg, MSG_DONTWAIT|MSG_NOSIGNAL|more);
+                }
+            } else {
+                s = ::sendmsg(ctx->_socket, &msg, MSG_DONTWAIT|MSG_NOSIGNAL|more);
+            }
         }
         if (s < 0) {
             int e = errno;
             s = 0;
-            if (e != EWOULDBLOCK && e != EPIPE && e != ECONNRESET) {
+            if (e == EWOULDBLOCK) {
+                ctx->_ready &= ~EPOLLOUT;
+            } else if (e != EPIPE && e != ECONNRESET) {
                 report_error(std::system_error(e, std::system_category()), "send");
             }
+        } else if (static_cast<std::size_t>(s) < total) {
+            ctx->_ready &= ~EPOLLOUT;   //output buffer is full
+        }
+        return static_cast<std::size_t>(s);
+    }
+}
+
+void NetContext::apply_socket_options(SocketInfo *sock, const SocketOptions &opts, bool tcp) {
+    //failure to set an option is reported, but the connection is still usable
+    auto set = [&](int level, int name, int value, std::string_view action) {
+        if (setsockopt(sock->_socket, level, name, &value, sizeof(value)) == -1) {
+            report_error(std::system_error(errno, std::system_category()), action);
         }
-        return s;
+    };
+    if (opts.send_buffer) set(SOL_SOCKET, SO_SNDBUF, opts.send_buffer, "SO_SNDBUF");
+    if (opts.recv_buffer) set(SOL_SOCKET, SO_RCVBUF, opts.recv_buffer, "SO_RCVBUF");
+    if (opts.busy_poll) {
+        set(SOL_SOCKET, SO_BUSY_POLL, opts.busy_poll, "SO_BUSY_POLL");
+    } else if (tcp && _busy_poll.count()) {
+        //default of busy poll mode (value above net.core.busy_read needs CAP_NET_ADMIN)
+        int value = static_cast<int>(std::min<std::chrono::microseconds::rep>(_busy_poll.count(), std::numeric_limits<int>::max()));
+        set(SOL_SOCKET, SO_BUSY_POLL, value, "SO_BUSY_POLL");
+    }
+    sock->_options = opts;
+    if (tcp) {
+        if (opts.nodelay) set(IPPROTO_TCP, TCP_NODELAY, 1, "TCP_NODELAY");
+        if (opts.keepalive) {
+            set(SOL_SOCKET, SO_KEEPALIVE, 1, "SO_KEEPALIVE");
+            if (opts.keepalive_idle) set(IPPROTO_TCP, TCP_KEEPIDLE, opts.keepalive_idle, "TCP_KEEPIDLE");
+            if (opts.keepalive_interval) set(IPPROTO_TCP, TCP_KEEPINTVL, opts.keepalive_interval, "TCP_KEEPINTVL");
+            if (opts.keepalive_count) set(IPPROTO_TCP, TCP_KEEPCNT, opts.keepalive_count, "TCP_KEEPCNT");
+        }
+    } else {
+        sock->_options.cork = false;    //MSG_MORE has no meaning for unix sockets
     }
 }
 
+ssize_t NetContext::write_segments_lk(SocketInfo *ctx, std::span<const std::string_view> data) {
+    constexpr std::size_t max_segments = 64;
+    iovec iov[max_segments];
+    std::size_t cnt = 0;
+    std::size_t total = 0;
+    for (const auto &seg: data) {
+        if (cnt == max_segments) break;
+        iov[cnt].iov_base = const_cast<char *>(seg.data());
+        iov[cnt].iov_len = seg.size();
+        total += seg.size();
+        ++cnt;
+    }
+    if (total == 0) return 0;
+    ssize_t s;
+    _send_count.fetch_add(1, std::memory_order_relaxed);
+    if (ctx->_socket_is_pipe) {
+        s = ::writev(ctx->_socket, iov, static_cast<int>(cnt));
+    } else {
+        msghdr msg = {};
+        msg.msg_iov = iov;
+        msg.msg_iovlen = cnt;
+        s = ::sendmsg(ctx->_socket, &msg, MSG_DONTWAIT|MSG_NOSIGNAL);
+    }
+    if (s < 0) {
+        int e = errno;
+        if (e != EWOULDBLOCK) {
+            if (e != EPIPE && e != ECONNRESET) {
+                report_error(std::system_error(e, std::system_category()), "write");
+            }
+            return -1;
+        }
+        s = 0;
+    }
+    if (static_cast<std::size_t>(s) < total) ctx->_ready &= ~EPOLLOUT;   //output buffer is full
+    return s;
+}
+
+bool NetContext::flush_queue_lk(SocketInfo *ctx) {
+    constexpr std::size_t max_segments = 64;
+    std::string_view segs[max_segments];
+    while (!ctx->_write_queue.empty()) {
+        auto cnt = ctx->_write_queue.gather(segs);
+        auto s = write_segments_lk(ctx, {segs, cnt});
+        if (s < 0) return false;
+        if (s == 0) break;
+        ctx->_write_queue.consume(static_cast<std::size_t>(s));
+    }
+    return true;
+}
+
+void NetContext::write_failed_lk(SocketInfo *ctx) {
+    ctx->_write_error = true;
+    ctx->_write_queue.clear();
+    //waiting peer is notified through the ready list
+    ctx->_ready |= EPOLLOUT;
+    if (ctx->_flush_cb) ctx->_flags |= EPOLLOUT;
+    request_lk(ctx);
+}
+
+bool NetContext::write(ConnHandle ident, std::span<const std::string_view> data) {
+    return write(ident, data, nullptr);
+}
+
+bool NetContext::write(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) {
+    std::lock_guard _(_mx);
+    auto ctx = socket_by_ident(ident);
+    if (!ctx || ctx->_write_error) return false;
+    std::size_t skip = 0;
+    if (ctx->_write_queue.empty() && ctx->_socket >= 0) {
+        //try to write directly, like send(), the socket doesn't need to be known as writable
+        auto s = write_segments_lk(ctx, data);
+        if (s < 0) {
+            write_failed_lk(ctx);
+            return false;
+        }
+        skip = static_cast<std::size_t>(s);
+    }
+    for (const auto &seg: data) {
+        if (skip >= seg.size()) {
+            skip -= seg.size();
+            continue;
+        }
+        auto part = seg.substr(skip);
+        skip = 0;
+        if (owner) ctx->_write_queue.append(part, owner);
+        else ctx->_write_queue.append(part);
+    }
+    if (!ctx->_write_queue.empty()) {
+        ctx->_flags |= EPOLLOUT;
+        request_lk(ctx);
+    }
+    return true;
+}
+
+std::size_t NetContext::get_queued_bytes(ConnHandle ident) const {
+    std::lock_guard _(_mx);
+    auto ctx = socket_by_ident(ident);
+    return ctx?ctx->_write_queue.size():0;
+}
+
+void NetContext::wait_for_flush(ConnHandle ident, IPeer *peer) {
+    std::lock_guard _(_mx);
+    auto ctx = socket_by_ident(ident);
+    if (!ctx) return;
+    ctx->_flush_cb = peer;
+    ctx->_flags |= EPOLLOUT;
+    if (ctx->_write_error) ctx->_ready |= EPOLLOUT;
+    request_lk(ctx);
+}
+
 void NetContext::ready_to_send(ConnHandle ident, IPeer *peer) {
     std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx) return;
     ctx->_flags |= EPOLLOUT;
     ctx->_send_cb = peer;
-    apply_flags_lk(ctx);
+    request_lk(ctx);
 }
 
-ConnHandle NetContext::create_server(std::string address_port) {
+///parse unix socket address
+/**
+ * @param address address in form unix:/path or unix:@name (abstract namespace)
+ * @param addr receives socket address
+ * @param len receives length of the address
+ * @retval true address is unix socket address
+ * @retval false not unix socket address
+ */
+static bool parse_unix_address(std::string_view address, sockaddr_un &addr, socklen_t &len) {
+    if (address.substr(0, 5) != "unix:") return false;
+    address = address.substr(5);
+    if (address.empty() || address.size() >= sizeof(addr.sun_path)) {
+        throw std::invalid_argument("Invalid unix socket path (empty or too long)");
+    }
+    addr = {};
+    addr.sun_family = AF_UNIX;
+    std::copy(address.begin(), address.end(), addr.sun_path);
+    if (address.front() == '@') {
+        addr.sun_path[0] = 0;   //abstract socket, name is not zero terminated
+        len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + address.size());
+    } else {
+        len = static_cast<socklen_t>(offsetof(sockaddr_un, sun_path) + address.size() + 1);
+    }
+    return true;
+}
+
+static int connect_unix(const sockaddr_un &addr, socklen_t len) {
+    int sockfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (sockfd == -1) {
+        throw std::system_error(errno, std::generic_category(), "Failed to create socket");
+    }
+    if (connect(sockfd, reinterpret_cast<const sockaddr *>(&addr), len) == -1 && errno != EINPROGRESS) {
+        int e = errno;
+        close(sockfd);
+        throw std::system_error(e, std::generic_category(), "Failed to connect");
+    }
+    return sockfd;
+}
+
+///bind unix socket, removes stale socket file
+static void bind_unix(int fd, const sockaddr_un &addr, socklen_t len) {
+    auto saddr = reinterpret_cast<const sockaddr *>(&addr);
+    if (bind(fd, saddr, len) == 0) return;
+    int e = errno;
+    if (e == EADDRINUSE && addr.sun_path[0] != 0) {
+        //socket file exists, remove it, if nobody listens on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool stale = probe >= 0 && connect(probe, saddr, len) == -1 && errno == ECONNREFUSED;
+        if (probe >= 0) close(probe);
+        struct stat st;
+        if (stale && lstat(addr.sun_path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+            ::unlink(addr.sun_path);
+            if (bind(fd, saddr, len) == 0) return;
+            e = errno;
+        }
+    }
+    throw std::system_error(e, std::generic_category(), "Failed to bind to address");
+}
+
+ConnHandle NetContext::create_server(std::string address_port, const SocketOptions &opts) {
+    sockaddr_un uaddr;
+    socklen_t ulen;
+    if (parse_unix_address(address_port, uaddr, ulen)) {
+        int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (listen_fd == -1) {
+            throw std::system_error(errno, std::generic_category(), "Failed to create socket");
+        }
+        std::string path;
+        try {
+            bind_unix(listen_fd, uaddr, ulen);
+            if (uaddr.sun_path[0] != 0) {
+                path = uaddr.sun_path;
+                if (_unix_socket_mode && ::chmod(path.c_str(), _unix_socket_mode) == -1) {
+                    throw std::system_error(errno, std::generic_category(), "Failed to set permissions");
+                }
+            }
+            if (listen(listen_fd, SOMAXCONN) == -1) {
+                throw std::system_error(errno, std::generic_category(), "Failed to listen on socket");
+            }
+        } catch (...) {
+            close(listen_fd);
+            if (!path.empty()) ::unlink(path.c_str());
+            throw;
+        }
+        std::lock_guard _(_mx);
+        SocketInfo *nfo = alloc_socket_lk();
+        nfo->_socket = listen_fd;
+        nfo->_unix_path = std::move(path);
+        nfo->_options = opts;
+        _epoll.add(listen_fd, initial_events(true), nfo->_ident);
+        return nfo->_ident;
+    }
     size_t port_pos = address_port.rfind(':');
     if (port_pos == std::string::npos) {
         throw std::invalid_argument("Invalid address format (missing port)");
@@ -250,7 +681,7 @@ ConnHandle NetContext::create_server(std::string address_port) {
     int listen_fd = -1;
 
     for (struct addrinfo* p = res; p != nullptr; p = p->ai_next) {
-        listen_fd = socket(p->ai_family, p->ai_socktype, p->ai_protocol);
+        listen_fd = socket(p->ai_family, p->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, p->ai_protocol);
         if (listen_fd == -1) {
             continue;
         }
@@ -277,6 +708,11 @@ ConnHandle NetContext::create_server(std::string address_port) {
         throw std::system_error(errno, std::generic_category(), "Failed to bind to address");
     }
 
+    if (opts.recv_buffer) {
+        //window scale is negotiated during handshake, so the size must be known before accept
+        setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &opts.recv_buffer, sizeof(opts.recv_buffer));
+    }
+
     if (listen(listen_fd, SOMAXCONN) == -1) {
         close(listen_fd);
         throw std::system_error(errno, std::generic_category(), "Failed to listen on socket");
@@ -285,7 +721,8 @@ ConnHandle NetContext::create_server(std::string address_port) {
     std::lock_guard _(_mx);
     SocketInfo *nfo = alloc_socket_lk();
     nfo->_socket = listen_fd;
-    _epoll.add(listen_fd, 0, nfo->_ident);
+    nfo->_options = opts;
+    _epoll.add(listen_fd, initial_events(true), nfo->_ident);
     return nfo->_ident;
 
 }
@@ -296,7 +733,7 @@ void NetContext::accept(ConnHandle ident, IServer *server) {
     if (!ctx) return;
     ctx->_flags |= EPOLLIN;
     ctx->_accept_cb = server;
-    apply_flags_lk(ctx);
+    if (!ctx->_in_accept_loop) request_lk(ctx);
 }
 
 void NetContext::destroy(ConnHandle ident) {
@@ -308,43 +745,35 @@ void NetContext::destroy(ConnHandle ident) {
         _epoll.del(ctx->_socket);
         ::close(ctx->_socket);
     }
-    _tmset.erase({ctx->_tmtp, ident});
+    if (!ctx->_unix_path.empty()) ::unlink(ctx->_unix_path.c_str());
+    _timers.cancel(ctx->_timeout_timer);
+    for (auto id: ctx->_timers) _timers.cancel(id);
     free_socket_lk(ident);
 }
 
 
-static int connect_peer(std::string address_port) {
+///split host:port
+static void split_host_port(const std::string &address_port, std::string &host, std::string &port) {
     size_t port_pos = address_port.rfind(':');
     if (port_pos == std::string::npos) {
         throw std::invalid_argument("Invalid address format (missing port)");
     }
-
-    std::string host = address_port.substr(0, port_pos);
-    std::string port = address_port.substr(port_pos + 1);
-
-    struct addrinfo hints = {};
-    struct addrinfo* res;
-
-    hints.ai_family = AF_UNSPEC;       // IPv4 nebo IPv6
-    hints.ai_socktype = SOCK_STREAM;   // TCP
-    hints.ai_flags = AI_NUMERICSERV;   // Očekáváme numerický port
-
+    host = address_port.substr(0, port_pos);
+    port = address_port.substr(port_pos + 1);
     if (host.front() == '[' && host.back() == ']') {
         host = host.substr(1, host.size() - 2);
     }
+}
 
-    int status = getaddrinfo(host.c_str(), port.c_str(), &hints, &res);
-    if (status != 0) {
-        throw std::invalid_argument("Invalid address or port: " + std::string(gai_strerror(status)));
-    }
-
+///create socket and start connecting to the first usable address
+static int connect_addresses(const Resolver::Result &res) {
     int sockfd = -1;
-    for (struct addrinfo* p = res; p != nullptr; p = p->ai_next) {
-        sockfd = socket(p->ai_family, p->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, p->ai_protocol);
+    for (const auto &a: res.addresses) {
+        sockfd = socket(a.family, a.socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, a.protocol);
         if (sockfd == -1) {
             continue;
         }
-        if (connect(sockfd, p->ai_addr, p->ai_addrlen) == -1) {
+        if (connect(sockfd, reinterpret_cast<const sockaddr *>(&a.addr), a.len) == -1) {
             if (errno != EINPROGRESS && errno != EWOULDBLOCK) {
                 close(sockfd);
                 sockfd = -1;
@@ -353,39 +782,139 @@ static int connect_peer(std::string address_port) {
         }
         break;
     }
-
-    freeaddrinfo(res);
-
     if (sockfd == -1) {
         throw std::system_error(errno, std::generic_category(), "Failed to connect");
     }
     return sockfd;
 }
 
+///start connecting without blocking
+/**
+ * @param address_port address
+ * @param host receives host, if the address must be resolved
+ * @param port receives port, if the address must be resolved
+ * @param tcp receives true for TCP connection
+ * @param failed receives cached failed resolution
+ * @return connected socket, or -1 if the address must be resolved or the resolution
+ * failed recently (failed is set)
+ * @exception std::invalid_argument invalid address
+ */
+static int connect_peer(Resolver &resolver, const std::string &address_port,
+                        std::string &host, std::string &port, bool &tcp,
+                        Resolver::ResultPtr &failed) {
+    sockaddr_un uaddr;
+    socklen_t ulen;
+    tcp = false;
+    if (parse_unix_address(address_port, uaddr, ulen)) return connect_unix(uaddr, ulen);
+    tcp = true;
+    split_host_port(address_port, host, port);
+    auto res = resolver.lookup(host, port);
+    if (!res) return -1;
+    if (res->error) {
+        failed = std::move(res);
+        return -1;
+    }
+    return connect_addresses(*res);
+}
+
+void NetContext::attach_socket_lk(SocketInfo *ctx, int fd, bool tcp) {
+    ctx->_socket = fd;
+    apply_socket_options(ctx, ctx->_options, tcp);
+    _epoll.add(fd, initial_events(false), ctx->_ident);
+    apply_flags_lk(ctx);    //operations requested while the address was being resolved
+}
+
+void NetContext::start_resolve_lk(SocketInfo *ctx, const std::string &host, const std::string &port) {
+    auto id = ++_resolve_counter;
+    ConnHandle ident = ctx->_ident;
+    ctx->_resolve_id = id;
+    _resolver.resolve(host, port, [this, ident, id](const Resolver::ResultPtr &res){
+        on_resolved(ident, id, res);
+    });
+}
+
+void NetContext::on_resolved(ConnHandle ident, std::uint64_t resolve_id, const Resolver::ResultPtr &res) {
+    std::lock_guard _(_mx);
+    auto ctx = socket_by_ident(ident);
+    //connection was destroyed or reconnected meanwhile
+    if (!ctx || ctx->_resolve_id != resolve_id) return;
+    ctx->_resolve_id = 0;
+    try {
+        if (res->error) {
+            throw std::invalid_argument("Invalid address or port: " + res->error_message());
+        }
+        attach_socket_lk(ctx, connect_addresses(*res), true);
+    } catch (...) {
+        _ecb("connect", std::source_location::current());
+        connect_failed_lk(ctx);
+    }
+}
+
+void NetContext::connect_failed_lk(SocketInfo *ctx) {
+    //connection has no socket, pending operations report lost connection
+    ctx->_hangup = true;
+    ctx->_ready |= EPOLLIN|EPOLLOUT;
+    request_lk(ctx);
+}
+
+void NetContext::start_connect_lk(SocketInfo *ctx, int fd, bool tcp, const std::string &host,
+                                  const std::string &port, const Resolver::ResultPtr &failed) {
+    if (fd >= 0) {
+        attach_socket_lk(ctx, fd, tcp);
+    } else if (failed) {
+        //reported the same way as a failure of the fresh resolution
+        report_error(std::invalid_argument("Invalid address or port: " + failed->error_message()), "connect");
+        connect_failed_lk(ctx);
+    } else {
+        start_resolve_lk(ctx, host, port);
+    }
+}
+
 
-ConnHandle NetContext::connect(std::string address_port)  {
+ConnHandle NetContext::connect(std::string address_port, const SocketOptions &opts)  {
 
-    int sockfd = connect_peer(address_port);
+    bool tcp;
+    std::string host, port;
+    Resolver::ResultPtr failed;
+    int sockfd = connect_peer(_resolver, address_port, host, port, tcp, failed);
     std::lock_guard _(_mx);
     SocketInfo *nfo = alloc_socket_lk();
-    nfo->_socket = sockfd;
-    _epoll.add(sockfd, 0, nfo->_ident);
+    nfo->_options = opts;
+    start_connect_lk(nfo, sockfd, tcp, host, port, failed);
     return nfo->_ident;
 }
 
  void NetContext::reconnect(ConnHandle ident, std::string address_port) {
+     //resolution doesn't block, so the lock is not needed
+     bool tcp;
+     std::string host, port;
+     Resolver::ResultPtr failed;
+     auto newfd = connect_peer(_resolver, address_port, host, port, tcp, failed);
      std::lock_guard _(_mx);
      auto ctx = socket_by_ident(ident);
-     if (!ctx) return;
-     auto newfd = connect_peer(std::move(address_port));
+     if (!ctx) {
+         if (newfd >= 0) ::close(newfd);
+         return;
+     }
      if (ctx->_socket >= 0) {
          _epoll.del(ctx->_socket);
          ::close(ctx->_socket);
+         ctx->_socket = -1;
      }
-     ctx->_socket = newfd;
-     _epoll.add(ctx->_socket, 0, ident);
+     ctx->_corked = false;
+     ctx->_hangup = false;
+     ctx->_resolve_id = 0;
+     ctx->_write_queue.clear();
+     ctx->_write_error = false;
      ctx->_flags = 0;
      ctx->_cur_flags = 0;
+     ctx->_ready = 0;
+     ctx->_oneshot = false;
+     //completions of the old socket never come, new socket decides zero copy again
+     ctx->_zerocopy = ZeroCopy::unknown;
+     ctx->_zerocopy_seq = 0;
+     ctx->_zerocopy_pending.clear();
+     start_connect_lk(ctx, newfd, tcp, host, port, failed);
  }
 
 
@@ -411,30 +940,179 @@ void NetContext::run(std::stop_token tkn) {
 
 
 
-void NetContext::set_timeout(ConnHandle ident, std::chrono::system_clock::time_point tp, IPeerServerCommon *p) {
+void NetContext::set_timeout(ConnHandle ident, std::chrono::steady_clock::time_point tp, IPeerServerCommon *p) {
     std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx) return;
-    auto top = get_epoll_timeout_lk();
-    _tmset.erase({ctx->_tmtp, ident});
+    _timers.cancel(ctx->_timeout_timer);
     ctx->_timeout_cb = p;
-    ctx->_tmtp = tp;
-    _tmset.insert({ctx->_tmtp, ident});
-    bool ntf = top > tp;
-    if (ntf && _cur_timer_thread >= 0) {
-        eventfd_write(_cur_timer_thread, 1);
-    }
+    ctx->_timeout_timer = _timers.arm(tp, {ident, {}});
+    update_timerfd_lk();
 }
 
 void NetContext::clear_timeout(ConnHandle ident) {
     std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx) return;
-    _tmset.erase({ctx->_tmtp, ident});
+    _timers.cancel(std::exchange(ctx->_timeout_timer, TimerID{}));
+    ctx->_timeout_cb = nullptr;
+}
 
+TimerID NetContext::set_timer(ConnHandle ident, std::chrono::steady_clock::time_point tp, SimpleAction action) {
+    std::lock_guard _(_mx);
+    SocketInfo *ctx = nullptr;
+    if (ident != no_connection) {
+        ctx = socket_by_ident(ident);
+        if (!ctx) return {};
+    }
+    auto id = _timers.arm(tp, {ident, action});
+    if (id == Timers::invalid_id) return {};
+    if (ctx) ctx->_timers.push_back(id);
+    update_timerfd_lk();
+    return id;
 }
 
-static thread_local int current_callback_cntr = 0;
+bool NetContext::cancel_timer(TimerID id) {
+    std::lock_guard _(_mx);
+    auto t = _timers.get(id);
+    if (!t || !t->_action) return false;    //connection timeouts are not canceled here
+    if (t->_ident != no_connection) {
+        auto ctx = socket_by_ident(t->_ident);
+        if (ctx) std::erase(ctx->_timers, id);
+    }
+    return _timers.cancel(id);
+}
+
+void NetContext::update_timerfd_lk() {
+    auto tp = _timers.next_expiration();
+    if (tp >= _timerfd_tp) return;
+    _timerfd_tp = tp;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(tp.time_since_epoch()).count();
+    itimerspec its = {};
+    its.it_value.tv_sec = ns / 1000000000;
+    its.it_value.tv_nsec = ns % 1000000000;
+    if (its.it_value.tv_sec <= 0 && its.it_value.tv_nsec <= 0) its.it_value.tv_nsec = 1; //zero disarms the timer
+    if (timerfd_settime(_timerfd, TFD_TIMER_ABSTIME, &its, nullptr) < 0) {
+        report_error(std::system_error(errno, std::system_category()), "timerfd_settime");
+    }
+}
+
+void NetContext::release_buffer_lk(SocketInfo *ctx) {
+    auto &buff = ctx->_own_buffer;
+    if (buff.capacity() == 0) return;
+    if (_buffer_pool.size() < max_pooled_buffers && buff.capacity() <= max_read_buffer) {
+        _buffer_pool.push_back(std::move(buff));
+    }
+    buff = {};
+}
+
+ssize_t NetContext::read_lk(SocketInfo *ctx, std::string_view &data) {
+    ssize_t r;
+    std::size_t capacity;
+    if (ctx->_socket < 0) return 0;     //connection failed (or closed pipe)
+    _recv_count.fetch_add(1, std::memory_order_relaxed);
+    if (!ctx->_use_own_buffer) {
+        auto buffer = ctx->_recv_buffer;
+        capacity = buffer.size();
+        if (ctx->_socket_is_pipe) {
+            r = ::read(ctx->_socket, buffer.data(), buffer.size());
+        } else {
+            r = ::recv(ctx->_socket, buffer.data(), buffer.size(), MSG_DONTWAIT);
+        }
+        if (r > 0) data = std::string_view(buffer.data(), r);
+    } else {
+        //data which doesn't fit to the buffer are read to the spill area
+        //and appended, so the peer always receives one contiguous block
+        static thread_local char spill[65536];
+        if (ctx->_own_buffer_size == 0) ctx->_own_buffer_size = min_read_buffer;
+        auto &buff = ctx->_own_buffer;
+        if (buff.capacity() == 0 && !_buffer_pool.empty()) {
+            //idle connections don't hold a buffer, it is borrowed for the read
+            buff = std::move(_buffer_pool.back());
+            _buffer_pool.pop_back();
+        }
+        std::size_t bsize = ctx->_own_buffer_size;
+        buff.resize(bsize);
+        iovec iov[2] = {{buff.data(), bsize},{spill, sizeof(spill)}};
+        capacity = bsize + sizeof(spill);
+        if (ctx->_socket_is_pipe) {
+            r = ::readv(ctx->_socket, iov, 2);
+        } else {
+            msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = 2;
+            r = ::recvmsg(ctx->_socket, &msg, MSG_DONTWAIT);
+        }
+        if (r > 0) {
+            auto sz = static_cast<std::size_t>(r);
+            if (sz >= bsize) {
+                //buffer was filled, grow it for next read
+                buff.insert(buff.end(), spill, spill + (sz - bsize));
+                ctx->_own_buffer_size = std::min(max_read_buffer, std::bit_ceil(sz + 1));
+                ctx->_small_reads = 0;
+            } else if (sz < bsize / 4 && bsize > min_read_buffer) {
+                if (++ctx->_small_reads >= shrink_after_reads) {
+                    ctx->_own_buffer_size = bsize / 2;
+                    ctx->_small_reads = 0;
+                    buff.resize(ctx->_own_buffer_size);
+                    buff.shrink_to_fit();
+                }
+            } else {
+                ctx->_small_reads = 0;
+            }
+            data = std::string_view(buff.data(), sz);
+        }
+    }
+    if (r < 0) {
+        int e = errno;
+        if (e == EWOULDBLOCK) {
+            ctx->_ready &= ~EPOLLIN;    //spurious readiness, wait for next event
+        } else {
+            report_error(std::system_error(e, std::system_category()), "receive");
+            r = 0; //any error - close connection
+        }
+    } else if (r > 0 && static_cast<std::size_t>(r) < capacity && !ctx->_hangup) {
+        //short read - input is drained, next data arrival generates new edge
+        //(unless the peer already closed the connection - EOF must be read yet)
+        ctx->_ready &= ~EPOLLIN;
+    }
+    return r;
+}
+
+bool NetContext::process_zerocopy_lk(SocketInfo *ctx) {
+    while (true) {
+        char control[CMSG_SPACE(sizeof(sock_extended_err)) + 64];
+        msghdr msg = {};
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (::recvmsg(ctx->_socket, &msg, MSG_ERRQUEUE|MSG_DONTWAIT) < 0) break;
+        for (cmsghdr *cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            if (!((cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                    || (cm->cmsg_level == SOL_IPV6 && cm->cmsg_type == IPV6_RECVERR))) continue;
+            auto serr = reinterpret_cast<const sock_extended_err *>(CMSG_DATA(cm));
+            if (serr->ee_origin != SO_EE_ORIGIN_ZEROCOPY) continue;
+            //notification reports range of completed sends [ee_info, ee_data]
+            while (!ctx->_zerocopy_pending.empty()) {
+                auto seq = ctx->_zerocopy_pending.front()._seq;
+                if (static_cast<std::int32_t>(seq - serr->ee_data) > 0) break;
+                ctx->_zerocopy_pending.pop_front();
+            }
+            if (serr->ee_code & SO_EE_CODE_ZEROCOPY_COPIED) {
+                //kernel had to copy the data, zero copy is just overhead here
+                ctx->_zerocopy = ZeroCopy::disabled;
+            }
+        }
+    }
+    //check whether there is also an error on socket
+    int err = 0;
+    socklen_t len = sizeof(err);
+    getsockopt(ctx->_socket, SOL_SOCKET, SO_ERROR, &err, &len);
+    if (err) {
+        report_error(std::system_error(err, std::system_category()), "send");
+        return false;
+    }
+    return true;
+}
 
 template<typename Fn>
 void NetContext::SocketInfo::invoke_cb(std::unique_lock<std::mutex> &lk, std::condition_variable &cond, Fn &&fn) {
@@ -445,80 +1123,201 @@ void NetContext::SocketInfo::invoke_cb(std::unique_lock<std::mutex> &lk, std::co
     lk.lock();
     --current_callback_cntr;
     if (--_cb_call_cntr == 0) {
+        if (_corked) {
+            //data sent with MSG_MORE during the callback - push them now
+            _corked = false;
+            int zero = 0;
+            if (_socket >= 0) setsockopt(_socket, IPPROTO_TCP, TCP_CORK, &zero, sizeof(zero));
+        }
         cond.notify_all();
     }
 }
 
+void NetContext::process_timers_lk(std::unique_lock<std::mutex> &lk) {
+    std::uint64_t dummy;
+    std::ignore = ::read(_timerfd, &dummy, sizeof(dummy));
+    _timerfd_tp = std::chrono::steady_clock::time_point::max();
+    _timers.advance(std::chrono::steady_clock::now());
+    while (auto t = _timers.pop_expired()) {
+        auto &nfo = t->payload;
+        if (nfo._ident == no_connection) {
+            ++current_callback_cntr;
+            lk.unlock();
+            nfo._action();
+            lk.lock();
+            --current_callback_cntr;
+            continue;
+        }
+        auto ctx = socket_by_ident(nfo._ident);
+        if (!ctx) continue;
+        if (nfo._action) {
+            std::erase(ctx->_timers, t->id);
+            ctx->invoke_cb(lk, _cond, nfo._action);
+        } else if (ctx->_timeout_timer == t->id) {
+            ctx->_timeout_timer = {};
+            auto cb = std::exchange(ctx->_timeout_cb, nullptr);
+            if (cb) ctx->invoke_cb(lk, _cond, [&]{cb->on_timeout();});
+        }
+    }
+    update_timerfd_lk();
+}
+
 void NetContext::process_event_lk(std::unique_lock<std::mutex> &lk, const WaitRes &e) {
     auto ctx = socket_by_ident(e.ident);
     if (!ctx) return;
-    ctx->_cur_flags = 0;
-    if (e.events & EPOLLIN) {
+    int ready = 0;
+    auto events = e.events;
+    //EPOLLERR is also signaled by completion of zero copy send
+    if ((events & EPOLLERR) && !ctx->_zerocopy_pending.empty()) {
+        if (process_zerocopy_lk(ctx)) events &= ~EPOLLERR;
+    }
+    //errors and hangups are reported through the operation, which fails
+    if (events & (EPOLLIN|EPOLLRDHUP|EPOLLHUP|EPOLLERR)) ready |= EPOLLIN;
+    if (events & (EPOLLRDHUP|EPOLLHUP|EPOLLERR)) ctx->_hangup = true;
+    if (events & (EPOLLOUT|EPOLLHUP|EPOLLERR)) ready |= EPOLLOUT;
+    if (edge_triggered(ctx)) {
+        ctx->_ready |= ready;
+        process_ready_lk(lk, ctx);
+    } else {
+        ctx->_cur_flags = 0;
+        ctx->_ready = ready;
+        process_ready_lk(lk, ctx);
+        ctx->_ready = 0;
+        apply_flags_lk(ctx);
+    }
+}
+
+void NetContext::process_ready_lk(std::unique_lock<std::mutex> &lk, SocketInfo *ctx) {
+    if (ctx->_ready & ctx->_flags & EPOLLIN) {
         if (ctx->_accept_cb) {
-            ctx->_flags &= ~EPOLLIN;
-            auto srv = std::exchange(ctx->_accept_cb, nullptr);
-            sockaddr_storage saddr_stor;
-            socklen_t slen = sizeof(saddr_stor);
-            sockaddr *saddr = reinterpret_cast<sockaddr *>(&saddr_stor);
-            auto n = accept4(ctx->_socket, saddr, &slen, SOCK_CLOEXEC|SOCK_NONBLOCK);
-            if (n >= 0) {
+            //drain the backlog while the server requests next connection from on_accept(),
+            //up to the batch limit (then the server is rescheduled through ready list)
+            ConnHandle ident = ctx->_ident;
+            ctx->_in_accept_loop = true;
+            for (unsigned int i = 0; i < _accept_batch; ++i) {
+                sockaddr_storage saddr_stor;
+                socklen_t slen = sizeof(saddr_stor);
+                sockaddr *saddr = reinterpret_cast<sockaddr *>(&saddr_stor);
+                _recv_count.fetch_add(1, std::memory_order_relaxed);
+                auto n = accept4(ctx->_socket, saddr, &slen, SOCK_CLOEXEC|SOCK_NONBLOCK);
+                if (n < 0) {
+                    //keep accept request pending, wait for next connection
+                    int e = errno;
+                    ctx->_ready &= ~EPOLLIN;
+                    if (e != EWOULDBLOCK) {
+                        report_error(std::system_error(e, std::system_category()), "accept");
+                    }
+                    break;
+                }
+                ctx->_flags &= ~EPOLLIN;
+                auto srv = std::exchange(ctx->_accept_cb, nullptr);
                 SocketInfo *nfo = alloc_socket_lk();
-                ctx = socket_by_ident(e.ident); //reallocation of socket list, we must find ctx again
                 nfo->_socket = n;
-                _epoll.add(n,0, nfo->_ident);;
-
-                ctx->invoke_cb(lk, _cond, [&]{if (srv) srv->on_accept(nfo->_ident, sockaddr_to_string(saddr));});
-            } else {
-                report_error(std::system_error(errno, std::system_category()), "accept");
+                apply_socket_options(nfo, ctx->_options, saddr->sa_family != AF_UNIX);
+                _epoll.add(n, initial_events(false), nfo->_ident);
+                ConnHandle nid = nfo->_ident;
+                ctx->invoke_cb(lk, _cond, [&]{srv->on_accept(nid, sockaddr_to_string(saddr, slen));});
+                if (ctx->_ident != ident || !ctx->_accept_cb || !(ctx->_ready & ctx->_flags & EPOLLIN)) break;
             }
-        }
-        if (ctx->_recv_cb) {
-            int r;
-            if (ctx->_socket_is_pipe) {
-                r = ::read(ctx->_socket, ctx->_recv_buffer.data(), ctx->_recv_buffer.size());
-            } else {
-                r = ::recv(ctx->_socket, ctx->_recv_buffer.data(), ctx->_recv_buffer.size(), MSG_DONTWAIT);
+            if (ctx->_ident == ident) {
+                ctx->_in_accept_loop = false;
+                if (ctx->_accept_cb) request_lk(ctx);
             }
-            if (r < 0) {
-                report_error(std::system_error(errno, std::system_category()), "receive");
-                 r = 0; //any error - close connection
+        } else if (ctx->_recv_cb) {
+            //drain the input until it is empty, the peer stops reading,
+            //or the budget is exhausted (then connection is rescheduled through ready list)
+            //in one-shot mode, special connections can be blocking, so only one read is made
+            std::size_t budget = edge_triggered(ctx)?_read_budget:0;
+            ConnHandle ident = ctx->_ident;
+            while (true) {
+                std::string_view data;
+                auto r = read_lk(ctx, data);
+                if (r < 0) break;
+                auto peer = std::exchange(ctx->_recv_cb, nullptr);
+                ctx->_flags &= ~EPOLLIN;
+                ctx->invoke_cb(lk, _cond, [&]{peer->receive_complete(data);});
+                auto sz = static_cast<std::size_t>(r);
+                if (sz == 0 || sz >= budget || ctx->_ident != ident
+                        || !ctx->_recv_cb || !(ctx->_ready & ctx->_flags & EPOLLIN)) break;
+                budget -= sz;
             }
-            auto peer = std::exchange(ctx->_recv_cb, nullptr);
-            ctx->_flags &= ~EPOLLIN;
-            ctx->invoke_cb(lk, _cond, [&]{peer->receive_complete(std::string_view(ctx->_recv_buffer.data(), r));});
+            //data were consumed by the callback, the buffer returns to the pool, unless
+            //other thread runs a callback of this connection - it can hold data read to the
+            //buffer after the peer requested next receive. Read and start of its callback
+            //are done under the lock, so no running callback means no read in flight
+            if (ctx->_ident == ident && ctx->_cb_call_cntr == 0) release_buffer_lk(ctx);
         }
     }
-    if (e.events & EPOLLOUT) {
-        ctx->_flags &= ~EPOLLOUT;
-        auto peer = std::exchange(ctx->_send_cb, nullptr);
-        if (peer) ctx->invoke_cb(lk, _cond, [&]{peer->clear_to_send();});
+    if (ctx->_ready & ctx->_flags & EPOLLOUT) {
+        //write queue is flushed before the peers are notified
+        if (!ctx->_write_queue.empty() && !flush_queue_lk(ctx)) {
+            ctx->_write_error = true;
+            ctx->_write_queue.clear();
+        }
+        if (ctx->_write_queue.empty()) {
+            ctx->_flags &= ~EPOLLOUT;
+            ConnHandle ident = ctx->_ident;
+            auto fpeer = std::exchange(ctx->_flush_cb, nullptr);
+            if (fpeer) ctx->invoke_cb(lk, _cond, [&]{fpeer->clear_to_send();});
+            if (ctx->_ident != ident) return;
+            auto peer = std::exchange(ctx->_send_cb, nullptr);
+            if (peer) ctx->invoke_cb(lk, _cond, [&]{peer->clear_to_send();});
+        }
     }
-    apply_flags_lk(ctx);
-
 }
 
 
 
 void NetContext::enqueue(SimpleAction fn) {
-    std::lock_guard _(_mx);
-    _actions.push_back(std::move(fn));
-    if (_cur_timer_thread >= 0) {
-        eventfd_write(_cur_timer_thread, 1);
+    post(std::move(fn));
+}
+
+void NetContext::post(SimpleAction fn) {
+    auto n = new TaskNode{nullptr, std::move(fn)};
+    auto head = _tasks.load(std::memory_order_relaxed);
+    do {
+        n->_next = head;
+    } while (!_tasks.compare_exchange_weak(head, n, std::memory_order_release, std::memory_order_relaxed));
+    //only the task which made the queue non-empty wakes a thread, it collects all tasks
+    if (!head && current_reactor != this) {
+        _wakeup_count.fetch_add(1, std::memory_order_relaxed);
+        eventfd_write(_task_efd, 1);
     }
 }
 
+void NetContext::defer(SimpleAction fn) {
+    if (current_reactor == this) deferred_tasks.push_back(std::move(fn));
+    else post(std::move(fn));
+}
+
+void NetContext::dispatch(SimpleAction fn) {
+    if (current_reactor == this) fn();
+    else post(std::move(fn));
+}
+
+bool NetContext::on_loop() const {
+    return current_reactor == this;
+}
+
 static int dup_fd(int fd) {
     int r =  fcntl(fd,F_DUPFD_CLOEXEC, 0);
     if (r < 0) throw std::system_error(errno, std::system_category());
     return r;
 }
 
+//opens new file description of the descriptor, so its status flags are not shared
+static int reopen_nonblock(int fd, int fl) {
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+    return ::open(path, (fl & (O_ACCMODE|O_APPEND)) | O_NONBLOCK | O_CLOEXEC);
+}
+
 ConnHandle NetContext::connect(SpecialConnection type, const void *arg) {
     std::lock_guard _(_mx);
     SocketInfo *ctx =alloc_socket_lk();
     switch (type) {
         default:
-        case SpecialConnection::null: break;
+        case SpecialConnection::null: return ctx->_ident;
         case SpecialConnection::descriptor:
             ctx->_socket = dup_fd(*reinterpret_cast<const int *>(arg));
             ctx->_socket_is_pipe = true;
@@ -539,7 +1338,22 @@ ConnHandle NetContext::connect(SpecialConnection type, const void *arg) {
             ctx->_socket_is_pipe = true;
             break;
     }
-    _epoll.add(ctx->_socket, 0, ctx->_ident);
+    if (_edge_triggered && ctx->_socket_is_pipe) {
+        //cached readiness can be stale, so operations must not block. Sockets use
+        //MSG_DONTWAIT. O_NONBLOCK set on the duplicate would change the caller's
+        //descriptor, so a blocking descriptor is reopened, or armed in one-shot mode
+        int fl = fcntl(ctx->_socket, F_GETFL);
+        if (fl >= 0 && !(fl & O_NONBLOCK)) {
+            int fd = reopen_nonblock(ctx->_socket, fl);
+            if (fd >= 0) {
+                ::close(ctx->_socket);
+                ctx->_socket = fd;
+            } else {
+                ctx->_oneshot = true;
+            }
+        }
+    }
+    _epoll.add(ctx->_socket, ctx->_oneshot?0:initial_events(false), ctx->_ident);
     return ctx->_ident;
 }
 
@@ -548,17 +1362,20 @@ PipePair NetContext::create_pipe() {
     ConnHandle conhndl[2];
     int p = pipe2(fds,O_CLOEXEC|O_NONBLOCK);
     if (p < 0) throw std::system_error(errno, std::system_category());
+    std::lock_guard _(_mx);
     for (int i = 0; i < 2; ++i) {
         auto ctx = alloc_socket_lk();
         ctx->_socket = fds[i];
         ctx->_socket_is_pipe = true;
-        _epoll.add(ctx->_socket, 0, ctx->_ident);
+        _epoll.add(ctx->_socket, initial_events(false), ctx->_ident);
         conhndl[i] = ctx->_ident;
     }
     return {conhndl[0], conhndl[1]};
 }
 
 void NetContext::apply_flags_lk(SocketInfo *ctx) noexcept {
+    //edge triggered socket is registered for all events
+    if (edge_triggered(ctx) || ctx->_socket < 0) return;
     if (ctx->_flags != ctx->_cur_flags) {
         _epoll.mod(ctx->_socket, ctx->_flags|EPOLLONESHOT, ctx->_ident);
         ctx->_cur_flags = ctx->_flags;
@@ -566,14 +1383,29 @@ void NetContext::apply_flags_lk(SocketInfo *ctx) noexcept {
 }
 
 
-std::shared_ptr<INetContext> make_network_context(int iothreads) {
-    auto p = std::make_shared<NetThreadedContext>(iothreads);
+std::shared_ptr<INetContext> make_network_context(const NetContextConfig &cfg) {
+    auto p = std::make_shared<NetThreadedContext>(cfg);
     p->start();
     return p;
 }
 
+std::shared_ptr<INetContext> make_network_context(int iothreads) {
+    return make_network_context(NetContextConfig{.iothreads = iothreads});
+}
+
+std::shared_ptr<INetContext> make_network_context(ErrorCallback errcb, int iothreads) {
+    return make_network_context(NetContextConfig{.iothreads = iothreads, .error_callback = std::move(errcb)});
+}
+
 NetThreadedContext::NetThreadedContext(int threads)
-    :_threads(threads)
+    :NetThreadedContext(NetContextConfig{.iothreads = threads})
+{
+}
+
+NetThreadedContext::NetThreadedContext(const NetContextConfig &cfg)
+    :NetContext(cfg)
+    ,_threads(cfg.iothreads)
+    ,_cpu_affinity(cfg.cpu_affinity)
 {
 }
 
@@ -587,8 +1419,21 @@ NetThreadedContext::~NetThreadedContext() {
 }
 
 void NetThreadedContext::start() {
-    for (auto &t: _threads) {
-        t = run_thread();
+    for (std::size_t i = 0; i < _threads.size(); ++i) {
+        if (_cpu_affinity.empty()) {
+            _threads[i] = run_thread();
+            continue;
+        }
+        //the thread pins itself before it enters the loop, so no event is processed on other cpu
+        int cpu = _cpu_affinity[i % _cpu_affinity.size()];
+        _threads[i] = std::jthread([this, cpu](std::stop_token tkn){
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            int r = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+            if (r) report_error(std::system_error(r, std::system_category()), "pthread_setaffinity_np");
+            run(std::move(tkn));
+        });
     }
 }
 
@@ -606,6 +1451,90 @@ bool NetContext::in_calback() const {
     return current_callback_cntr != 0;
 }
 
+NetContextStats NetContext::get_stats() const {
+    return {
+        _epoll.get_wait_count(),
+        _epoll.get_ctl_count(),
+        _recv_count.load(std::memory_order_relaxed),
+        _send_count.load(std::memory_order_relaxed),
+        _wakeup_count.load(std::memory_order_relaxed),
+        _zerocopy_count.load(std::memory_order_relaxed),
+        _spin_count.load(std::memory_order_relaxed),
+        _spin_hit_count.load(std::memory_order_relaxed),
+        _sleep_count.load(std::memory_order_relaxed)
+    };
+}
+
+
+//SIGCHLD is received by a handler, which writes to pipes of all monitors.
+//Blocking the signal and reading it through signalfd is unreliable, because
+//the signal can be delivered to (and discarded by) any thread which doesn't block it
+class SigChldHandler {
+public:
+    static constexpr unsigned int max_monitors = 16;
+
+    //registers write end of the pipe, the first monitor installs the handler
+    static void add(int fd) {
+        std::lock_guard _(_mx);
+        auto iter = std::find(std::begin(_pipes), std::end(_pipes), -1);
+        if (iter == std::end(_pipes)) throw std::length_error("Too many process monitors");
+        if (_refcnt == 0) {
+            struct sigaction sa = {};
+            sigaction(SIGCHLD, nullptr, &_prev);
+            sa.sa_sigaction = &handler;
+            sa.sa_flags = SA_RESTART | SA_SIGINFO | (chained()?(_prev.sa_flags & SA_NOCLDSTOP):SA_NOCLDSTOP);
+            sigemptyset(&sa.sa_mask);
+            if (sigaction(SIGCHLD, &sa, nullptr) < 0) throw std::system_error(errno, std::system_category());
+        }
+        ++_refcnt;
+        iter->store(fd);
+    }
+
+    //unregisters the pipe, the last monitor restores previous handler, unless it was replaced
+    static void remove(int fd) {
+        std::lock_guard _(_mx);
+        auto iter = std::find(std::begin(_pipes), std::end(_pipes), fd);
+        if (iter == std::end(_pipes)) return;
+        iter->store(-1);
+        if (--_refcnt == 0) {
+            struct sigaction cur = {};
+            sigaction(SIGCHLD, nullptr, &cur);
+            if ((cur.sa_flags & SA_SIGINFO) && cur.sa_sigaction == &handler) {
+                sigaction(SIGCHLD, &_prev, nullptr);
+            }
+        }
+        //the handler running in other thread can still use the descriptor
+        while (_running.load() != 0) std::this_thread::yield();
+    }
+
+protected:
+    static inline std::mutex _mx;
+    static inline std::atomic<int> _pipes[max_monitors] = {-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1};
+    static inline std::atomic<int> _running = 0;
+    static inline unsigned int _refcnt = 0;
+    static inline struct sigaction _prev = {};
+
+    static bool chained() {
+        if (_prev.sa_flags & SA_SIGINFO) return _prev.sa_sigaction != nullptr;
+        return _prev.sa_handler != SIG_DFL && _prev.sa_handler != SIG_IGN;
+    }
+
+    static void handler(int sig, siginfo_t *info, void *uctx) {
+        int e = errno;
+        ++_running;
+        char c = 0;
+        for (auto &p: _pipes) {
+            int fd = p.load();
+            if (fd >= 0) std::ignore = ::write(fd, &c, 1);
+        }
+        --_running;
+        errno = e;
+        //handler of the application
+        if (!chained()) return;
+        if (_prev.sa_flags & SA_SIGINFO) _prev.sa_sigaction(sig, info, uctx);
+        else _prev.sa_handler(sig);
+    }
+};
 
 class ProcessMonitorPeer: public IPeer {
 public:
@@ -636,18 +1565,25 @@ public:
 
     ProcessMonitorPeer(std::shared_ptr<INetContext> ctx)
         :_ctx(std::move(ctx)) {
-        sigset_t ss;
-        sigemptyset(&ss);
-        sigaddset(&ss, SIGCHLD);
-        sigprocmask(SIG_BLOCK, &ss, NULL);
-        int fd = signalfd(-1, &ss, SFD_CLOEXEC|SFD_NONBLOCK);
-        if (fd == -1) std::system_error(errno, std::system_category());
-        _sigfd = _ctx->connect(SpecialConnection::descriptor, &fd);
-        ::close(fd);
-        _ctx->receive(_sigfd, {reinterpret_cast<char *>(&_buffer),sizeof(_buffer)}, this);
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC|O_NONBLOCK) < 0) throw std::system_error(errno, std::system_category());
+        try {
+            _sigfd = _ctx->connect(SpecialConnection::descriptor, &fds[0]);
+            ::close(fds[0]);
+            SigChldHandler::add(fds[1]);
+        } catch (...) {
+            if (_sigfd != no_connection) _ctx->destroy(_sigfd);
+            else ::close(fds[0]);
+            ::close(fds[1]);
+            throw;
+        }
+        _sigwr = fds[1];
+        _ctx->receive(_sigfd, {_buffer, sizeof(_buffer)}, this);
     }
 
     ~ProcessMonitorPeer() {
+        SigChldHandler::remove(_sigwr);
+        ::close(_sigwr);
         _ctx->destroy(_sigfd);
     }
 
@@ -672,7 +1608,7 @@ public:
             f.first(f.second);
         }
         _fns.clear();
-        _ctx->receive(_sigfd, {reinterpret_cast<char *>(&_buffer),sizeof(_buffer)}, this);
+        _ctx->receive(_sigfd, {_buffer, sizeof(_buffer)}, this);
         if (_pmap.empty()) {
             me = std::move(_me);
         }
@@ -715,8 +1651,9 @@ protected:
     std::mutex _mx;
     std::shared_ptr<INetContext> _ctx;
     std::shared_ptr<ProcessMonitorPeer> _me;
-    ConnHandle _sigfd;
-    signalfd_siginfo _buffer;
+    ConnHandle _sigfd = no_connection;
+    int _sigwr = -1;                    //write end of the pipe, signaled by SigChldHandler
+    char _buffer[64];
     std::unordered_map<int, ProcessInfo> _pmap;
     std::vector<std::pair<std::function<void(int)>, int > > _fns;
 };
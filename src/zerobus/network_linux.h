@@ -2,11 +2,15 @@
 #include "network.h"
 #include "network_linux_epollpp.h"
 #include "cluster_alloc.h"
+#include "timer_wheel.h"
+#include "resolver_linux.h"
+#include "output_queue.h"
+#include <array>
 #include <condition_variable>
+#include <deque>
 #include <memory>
 #include <memory_resource>
 #include <thread>
-#include <set>
 #include <source_location>
 
 
@@ -14,27 +18,60 @@ namespace zerobus {
 
 class NetContext;
 
+///Counters of system calls made by the context
+struct NetContextStats {
+    std::uint64_t epoll_wait = 0;   ///<count of epoll_wait
+    std::uint64_t epoll_ctl = 0;    ///<count of epoll_ctl (add, mod, del)
+    std::uint64_t recv = 0;         ///<count of recv/read/accept
+    std::uint64_t send = 0;         ///<count of send/write
+    std::uint64_t wakeup = 0;       ///<count of writes to eventfd to wake up a thread
+    std::uint64_t zerocopy = 0;     ///<count of sends made with MSG_ZEROCOPY
+    std::uint64_t spin = 0;         ///<count of empty polls made while busy polling
+    std::uint64_t spin_hit = 0;     ///<count of events received while busy polling
+    std::uint64_t sleep = 0;        ///<count of waits which put an IO thread to sleep
+};
 
 
 class NetContext: public INetContext, public std::enable_shared_from_this<NetContext> {
 public:
 
 
-    explicit NetContext(ErrorCallback ecb);
+    explicit NetContext(const NetContextConfig &cfg);
     NetContext();
-    virtual ConnHandle connect(std::string address) override;
+    ~NetContext();
+    NetContext(const NetContext &) = delete;
+    NetContext &operator=(const NetContext &) = delete;
+    virtual ConnHandle connect(std::string address, const SocketOptions &opts = {}) override;
     virtual ConnHandle connect(SpecialConnection type, const void *arg = nullptr) override;
     virtual PipePair create_pipe() override;
     virtual void reconnect(ConnHandle ident, std::string address_port) override;
     ///start receiving data
     virtual void receive(ConnHandle ident, std::span<char> buffer, IPeer *peer) override;
+    ///start receiving data to the buffer managed by the context
+    virtual void receive(ConnHandle ident, IPeer *peer) override;
     ///send data
     virtual std::size_t send(ConnHandle ident, std::string_view data) override;
+    ///send data composed from multiple segments
+    virtual std::size_t send(ConnHandle ident, std::span<const std::string_view> data) override;
+    ///send data kept alive by the owner, zero copy can be used
+    virtual std::size_t send(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) override;
 
     virtual void ready_to_send(ConnHandle ident, IPeer *peer) override;
 
+    ///write data through the write queue
+
+    virtual bool write(ConnHandle ident, std::span<const std::string_view> data) override;
+
+    ///write data through the write queue without copying
+
+    virtual bool write(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) override;
+
+    virtual std::size_t get_queued_bytes(ConnHandle ident) const override;
+
+    virtual void wait_for_flush(ConnHandle ident, IPeer *peer) override;
+
     ///creates server
-    virtual ConnHandle create_server(std::string address_port) override;
+    virtual ConnHandle create_server(std::string address_port, const SocketOptions &opts = {}) override;
 
     ///request to accept next connection
     virtual void accept(ConnHandle ident, IServer *server) override;
@@ -47,35 +84,103 @@ public:
 
     void run(std::stop_token tkn);
 
-    virtual void set_timeout(ConnHandle ident, std::chrono::system_clock::time_point tp, IPeerServerCommon *p) override;
+    virtual void set_timeout(ConnHandle ident, std::chrono::steady_clock::time_point tp, IPeerServerCommon *p) override;
 
     ///Clear existing timeout
     virtual void clear_timeout(ConnHandle ident) override;
 
+    virtual TimerID set_timer(ConnHandle ident, std::chrono::steady_clock::time_point tp, SimpleAction action) override;
+    virtual bool cancel_timer(TimerID id) override;
+
 
     virtual void enqueue(SimpleAction fn) override;
+    virtual void post(SimpleAction fn) override;
+    virtual void defer(SimpleAction fn) override;
+    virtual void dispatch(SimpleAction fn) override;
+    virtual bool on_loop() const override;
     virtual bool in_calback() const override;
+
+    ///retrieve counters of system calls
+    NetContextStats get_stats() const;
 protected:
 
+    ///initial and minimal size of buffer managed by the context
+    static constexpr std::size_t min_read_buffer = 4096;
+    ///maximal size of buffer managed by the context
+    static constexpr std::size_t max_read_buffer = 256*1024;
+    ///count of consecutive small reads needed to shrink the buffer
+    static constexpr unsigned int shrink_after_reads = 8;
+    ///maximum count of receive buffers kept in the pool
+    static constexpr std::size_t max_pooled_buffers = 64;
+
     using MyEPoll = EPoll<ConnHandle>;
     using WaitRes = MyEPoll::WaitRes;
-    using TimeoutInfo = std::pair<std::chrono::system_clock::time_point, ConnHandle>;
-    using TimeoutSet = std::set<TimeoutInfo,  std::less<TimeoutInfo>, std::pmr::polymorphic_allocator<TimeoutInfo> >;
 
+    ///ident of timerfd in epoll
+    static constexpr ConnHandle timer_ident = static_cast<ConnHandle>(-2);
+    static constexpr ConnHandle task_ident = static_cast<ConnHandle>(-3);
 
-    struct SocketInfo {
-        ConnHandle _ident = static_cast<ConnHandle>(-1);
+    struct TimerInfo {
+        ConnHandle _ident = no_connection;  //owner of the timer
+        SimpleAction _action = {};          //action, if empty, this is timeout of the connection
+    };
+
+    using Timers = TimerWheel<TimerInfo>;
+
+
+    ///zero copy send waiting for completion
+    struct ZeroCopyPending {
+        std::uint32_t _seq;                     //sequence number of send
+        std::shared_ptr<const void> _owner;     //owner of data
+    };
+
+    enum class ZeroCopy : char {
+        unknown,        //not tested yet
+        enabled,        //SO_ZEROCOPY is set
+        disabled        //not supported or kernel copies data
+    };
+
+    ///count of SocketInfo entries allocated at once
+    static constexpr std::uint32_t socket_block_size = 64;
+    ///marks end of the free list
+    static constexpr std::uint32_t no_free_socket = static_cast<std::uint32_t>(-1);
+
+    ///connection state, each entry occupies own cache lines
+    struct alignas(64) SocketInfo {
+        ConnHandle _ident = no_connection;      //handle of the connection (no_connection if free)
+        std::uint32_t _generation = 1;          //generation of the slot, incremented on every release
+        std::uint32_t _next_free = no_free_socket;  //next free slot (when slot is free)
         int _socket = -1;
         std::span<char> _recv_buffer;
-        int _flags = 0;
-        int _cur_flags = 0;
-        std::chrono::system_clock::time_point _tmtp = {};
+        std::vector<char> _own_buffer = {};     //buffer managed by the context (borrowed from pool while reading)
+        std::size_t _own_buffer_size = 0;       //current target size of _own_buffer
+        unsigned int _small_reads = 0;          //count of consecutive small reads
+        bool _use_own_buffer = false;           //receive to _own_buffer
+        int _flags = 0;                         //requested operations (EPOLLIN, EPOLLOUT)
+        int _cur_flags = 0;                     //currently armed flags (one-shot mode)
+        int _ready = 0;                         //cached readiness (edge triggered mode)
+        bool _in_ready_list = false;            //socket is in _ready_list
+        bool _in_accept_loop = false;           //accept loop takes next connection itself, no need to schedule
+        bool _hangup = false;                   //peer closed the connection, no more edge comes
+        std::uint64_t _resolve_id = 0;          //id of pending resolution of address (socket is not created yet)
+        OutputQueue _write_queue = {};          //data of write() waiting to be written
+        IPeer *_flush_cb = {};                  //callback object for wait_for_flush()
+        bool _write_error = false;              //write() failed, queue is dropped
+        TimerID _timeout_timer = {};            //timer of set_timeout()
+        std::vector<TimerID> _timers = {};      //timers owned by the connection
         IPeer *_recv_cb = {};
         IPeer *_send_cb = {};
         IServer *_accept_cb = {};
         IPeerServerCommon *_timeout_cb = {};
         int _cb_call_cntr = {};
         bool _socket_is_pipe = false;
+        bool _oneshot = false;                  //blocking descriptor, armed in one-shot mode in any mode
+        ZeroCopy _zerocopy = ZeroCopy::unknown;
+        std::uint32_t _zerocopy_seq = 0;        //sequence number of next zero copy send
+        std::deque<ZeroCopyPending> _zerocopy_pending = {};
+        std::string _unix_path = {};            //path of unix socket server (removed on destroy)
+        SocketOptions _options = {};            //options of the socket (inherited by accepted sockets)
+        bool _corked = false;                   //data was sent with MSG_MORE, push is needed
 
         ///invoke one of callbacks
         /**
@@ -87,32 +192,87 @@ protected:
         void invoke_cb(std::unique_lock<std::mutex> &lk, std::condition_variable &cond, Fn &&fn);
     };
 
-    using SocketList = std::vector<std::unique_ptr<SocketInfo>  >;
+    using SocketBlock = std::array<SocketInfo, socket_block_size>;
+    using SocketList = std::vector<std::unique_ptr<SocketBlock> >;
 
     mutable std::mutex _mx;
     ErrorCallback _ecb;
+    bool _edge_triggered;
+    std::size_t _read_budget;
+    std::size_t _zerocopy_threshold;
+    unsigned int _unix_socket_mode;
+    unsigned int _accept_batch;
+    std::chrono::microseconds _busy_poll;
     MyEPoll _epoll = {};
     SocketList _sockets = {};
-    ConnHandle _first_free_socket_ident = 0;
-    std::pmr::unsynchronized_pool_resource _pool;
-    TimeoutSet _tmset;
+    std::uint32_t _first_free_socket = no_free_socket;
+    Timers _timers;
+    int _timerfd = -1;
+    std::chrono::steady_clock::time_point _timerfd_tp = std::chrono::steady_clock::time_point::max();
     std::condition_variable _cond;
 
-    std::atomic<int> _cur_timer_thread = -1;
-    std::vector<SimpleAction > _actions;
+    std::atomic<int> _cur_wait_thread = -1;
+    struct TaskNode {
+        TaskNode *_next;
+        SimpleAction _fn;
+    };
+    std::atomic<TaskNode *> _tasks = {nullptr};     //posted tasks, lock-free stack (newest first)
+    int _task_efd = -1;                             //signaled when _tasks becomes non-empty
+    std::vector<ConnHandle> _ready_list;    //sockets with cached readiness to process
+    std::vector<std::vector<char> > _buffer_pool;   //receive buffers of idle connections
+    std::atomic<std::uint64_t> _recv_count = {0};
+    std::atomic<std::uint64_t> _send_count = {0};
+    std::atomic<std::uint64_t> _wakeup_count = {0};
+    std::atomic<std::uint64_t> _zerocopy_count = {0};
+    std::atomic<std::uint64_t> _spin_count = {0};
+    std::atomic<std::uint64_t> _spin_hit_count = {0};
+    std::atomic<std::uint64_t> _sleep_count = {0};
+    std::atomic<bool> _ready_signal = {false};  //_ready_list is not empty (checked while busy polling)
+    std::uint64_t _resolve_counter = 0;
+    Resolver _resolver;                     //must be last, its thread calls back the context
 
 
     void run_worker(std::stop_token tkn, int efd) ;
+    bool run_tasks(const std::stop_token &tkn);
+    std::optional<WaitRes> spin_wait(const std::stop_token &tkn);
+    static ConnHandle make_handle(std::uint32_t index, std::uint32_t generation) {
+        return (static_cast<ConnHandle>(generation) << 32) | index;
+    }
+    static std::uint32_t handle_index(ConnHandle id) {return static_cast<std::uint32_t>(id);}
+    SocketInfo &socket_at(std::uint32_t index) const {
+        return (*_sockets[index / socket_block_size])[index % socket_block_size];
+    }
     SocketInfo *alloc_socket_lk();
     void free_socket_lk(ConnHandle id);
     SocketInfo *socket_by_ident(ConnHandle id);
+    const SocketInfo *socket_by_ident(ConnHandle id) const;
     template<typename E> void report_error(E exception, std::string_view action, std::source_location loc = std::source_location::current());
 
 
     void process_event_lk(std::unique_lock<std::mutex> &lk, const  WaitRes &e);
-    std::chrono::system_clock::time_point get_epoll_timeout_lk();
+    void process_ready_lk(std::unique_lock<std::mutex> &lk, SocketInfo *ctx);
+    ssize_t read_lk(SocketInfo *ctx, std::string_view &data);
+    void release_buffer_lk(SocketInfo *ctx);
+    bool process_zerocopy_lk(SocketInfo *ctx);
+    void process_ready_list_lk(std::unique_lock<std::mutex> &lk, std::vector<ConnHandle> &tmp);
+    void request_lk(SocketInfo *ctx);
+    void wakeup_lk();
+    int initial_events(bool listen) const;
+    bool edge_triggered(const SocketInfo *ctx) const {return _edge_triggered && !ctx->_oneshot;}
+    void process_timers_lk(std::unique_lock<std::mutex> &lk);
+    void update_timerfd_lk();
 
     void apply_flags_lk(SocketInfo *sock) noexcept;
+    void apply_socket_options(SocketInfo *sock, const SocketOptions &opts, bool tcp);
+    void start_resolve_lk(SocketInfo *sock, const std::string &host, const std::string &port);
+    void on_resolved(ConnHandle ident, std::uint64_t resolve_id, const Resolver::ResultPtr &result);
+    void attach_socket_lk(SocketInfo *sock, int fd, bool tcp);
+    void start_connect_lk(SocketInfo *sock, int fd, bool tcp, const std::string &host,
+                          const std::string &port, const Resolver::ResultPtr &failed);
+    void connect_failed_lk(SocketInfo *sock);
+    ssize_t write_segments_lk(SocketInfo *sock, std::span<const std::string_view> data);
+    bool flush_queue_lk(SocketInfo *sock);
+    void write_failed_lk(SocketInfo *sock);
 };
 
 
@@ -120,11 +280,13 @@ class NetThreadedContext: public NetContext {
 public:
 
     NetThreadedContext(int threads);
+    NetThreadedContext(const NetContextConfig &cfg);
     ~NetThreadedContext();
     void start();
 
 protected:
     std::vector<std::jthread> _threads;
+    std::vector<int> _cpu_affinity;
 };
 
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <sys/epoll.h>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <optional>
 
 namespace zerobus {
@@ -50,16 +52,19 @@ public:
         epoll_event ev;
         ev.data.u64 = ident_to_event_data(ident);
         ev.events = events;
+        _ctl_count.fetch_add(1, std::memory_order_relaxed);
         check_res(epoll_ctl(_fd, EPOLL_CTL_ADD,fd,&ev));
     }
     void mod(int fd, int events, Ident ident) {
         epoll_event ev;
         ev.data.u64 = ident_to_event_data(ident);
         ev.events = events;
+        _ctl_count.fetch_add(1, std::memory_order_relaxed);
         check_res(epoll_ctl(_fd, EPOLL_CTL_MOD,fd,&ev));
     }
     void del(int fd) {
         epoll_event ev = {};
+        _ctl_count.fetch_add(1, std::memory_order_relaxed);
         check_res(epoll_ctl(_fd, EPOLL_CTL_DEL,fd,&ev));
     }
 
@@ -68,19 +73,15 @@ public:
         Ident ident;
     };
 
-    std::optional<WaitRes> wait(std::chrono::system_clock::time_point tp = std::chrono::system_clock::time_point::max()) {
-        int timeout = -1;
-        if (tp < std::chrono::system_clock::time_point::max()) {
-            auto now = std::chrono::system_clock::now();
-            if (tp < now) timeout = 0;
-            else {
-                std::int64_t d = std::chrono::duration_cast<std::chrono::milliseconds>(tp - now).count();
-                constexpr std::int64_t m = std::numeric_limits<int>::max();
-                timeout = static_cast<int>(std::min(m,d));
-            }
-        }
+    ///wait for event
+    /**
+     * @param timeout timeout in milliseconds, -1 = infinite
+     * @return event or no value on timeout
+     */
+    std::optional<WaitRes> wait(int timeout = -1) {
         while (true) {
             epoll_event ev;
+            _wait_count.fetch_add(1, std::memory_order_relaxed);
             int c = epoll_wait(_fd, &ev, 1, timeout);
             if (c == -1) {
                 int e = errno;
@@ -98,8 +99,15 @@ public:
 
 
 
+    ///count of epoll_ctl calls
+    std::uint64_t get_ctl_count() const {return _ctl_count.load(std::memory_order_relaxed);}
+    ///count of epoll_wait calls
+    std::uint64_t get_wait_count() const {return _wait_count.load(std::memory_order_relaxed);}
+
 protected:
     int _fd;
+    std::atomic<std::uint64_t> _ctl_count = {0};
+    std::atomic<std::uint64_t> _wait_count = {0};
 
     void check_res(int i) {
         if (i < 0) {
@@ -9,6 +9,7 @@
 namespace zerobus {
 
 static thread_local unsigned int callback_call_counter = 0;
+static thread_local const NetContextWin *current_loop = nullptr;
 
 class MsWSock {
 public:
@@ -106,6 +107,11 @@ std::shared_ptr<INetContext> make_network_context(ErrorCallback ecb, int iothrea
     return p;
 }
 
+std::shared_ptr<INetContext> make_network_context(const NetContextConfig &cfg) {
+    if (cfg.error_callback) return make_network_context(cfg.error_callback, cfg.iothreads);
+    return make_network_context(cfg.iothreads);
+}
+
 NetThreadedContext::NetThreadedContext(ErrorCallback ecb, int threads)
     :NetContextWin(std::move(ecb))
     ,_threads(threads)
@@ -156,7 +162,10 @@ std::string sockaddr_to_string(const sockaddr* addr) {
 }
 
 
-ConnHandle NetContextWin::create_server(std::string address_port) {
+ConnHandle NetContextWin::create_server(std::string address_port, const SocketOptions &opts) {
+    if (address_port.substr(0, 5) == "unix:") {
+        throw std::invalid_argument("Unix sockets are not supported on this platform");
+    }
     size_t port_pos = address_port.rfind(':');
     if (port_pos == std::string::npos) {
         throw std::invalid_argument("Invalid address format (missing port)");
@@ -224,6 +233,7 @@ ConnHandle NetContextWin::create_server(std::string address_port) {
     SocketInfo *nfo = alloc_socket_lk();
     nfo->_socket = listen_fd;
     nfo->_af = af;
+    nfo->_options = opts;
     CreateIoCompletionPort(reinterpret_cast<HANDLE>(nfo->_socket), _completion_port, nfo->_ident+key_offset,0)    ;
     return nfo->_ident;
 
@@ -231,19 +241,20 @@ ConnHandle NetContextWin::create_server(std::string address_port) {
 
 
 NetContextWin::SocketInfo *NetContextWin::alloc_socket_lk() {
-     while (_first_free_socket_ident >= _sockets.size()) {
-        _sockets.push_back(std::make_unique<SocketInfo>());        
-        _sockets.back()->_ident = static_cast<ConnHandle>(_sockets.size());
+    if (_first_free_socket == no_free_socket) {
+        _first_free_socket = static_cast<std::uint32_t>(_sockets.size());
+        _sockets.push_back(std::make_unique<SocketInfo>());
     }
-    SocketInfo *nfo = _sockets[_first_free_socket_ident].get();
-    std::swap(nfo->_ident,_first_free_socket_ident);
+    auto index = _first_free_socket;
+    SocketInfo *nfo = _sockets[index].get();
+    _first_free_socket = std::exchange(nfo->_next_free, no_free_socket);
+    nfo->_ident = make_handle(index, nfo->_generation);
     return nfo;
 }
 
 
 NetContextWin::NetContextWin(ErrorCallback ecb)
     :_ecb(std::move(ecb))
-    ,_tmset(TimeoutSet::allocator_type(&_pool))
  {
     _completion_port = CreateIoCompletionPort(INVALID_HANDLE_VALUE, NULL, 0, 0);    
 }
@@ -259,7 +270,26 @@ void setSocketNonBlocking(SOCKET sock) {
     std::ignore = ioctlsocket(sock, FIONBIO, &mode);
 }
 
-SOCKET NetContextWin::connect_peer(std::string address_port, DWORD key, OVERLAPPED *ovr) {
+//cork and busy poll are not available on this platform
+static void apply_socket_options(SOCKET sock, const SocketOptions &opts) {
+    auto set = [&](int level, int name, int value) {
+        std::ignore = setsockopt(sock, level, name, reinterpret_cast<const char *>(&value), sizeof(value));
+    };
+    if (opts.nodelay) set(IPPROTO_TCP, TCP_NODELAY, 1);
+    if (opts.send_buffer) set(SOL_SOCKET, SO_SNDBUF, opts.send_buffer);
+    if (opts.recv_buffer) set(SOL_SOCKET, SO_RCVBUF, opts.recv_buffer);
+    if (opts.keepalive) {
+        set(SOL_SOCKET, SO_KEEPALIVE, 1);
+        if (opts.keepalive_idle) set(IPPROTO_TCP, TCP_KEEPIDLE, opts.keepalive_idle);
+        if (opts.keepalive_interval) set(IPPROTO_TCP, TCP_KEEPINTVL, opts.keepalive_interval);
+        if (opts.keepalive_count) set(IPPROTO_TCP, TCP_KEEPCNT, opts.keepalive_count);
+    }
+}
+
+SOCKET NetContextWin::connect_peer(std::string address_port, ULONG_PTR key, OVERLAPPED *ovr) {
+    if (address_port.substr(0, 5) == "unix:") {
+        throw std::invalid_argument("Unix sockets are not supported on this platform");
+    }
     size_t port_pos = address_port.rfind(':');
     if (port_pos == std::string::npos) {
         throw std::invalid_argument("Invalid address format (missing port)");
@@ -323,28 +353,35 @@ SOCKET NetContextWin::connect_peer(std::string address_port, DWORD key, OVERLAPP
 
 
 void NetContextWin::free_socket_lk(ConnHandle id) {
-    SocketInfo *nfo = _sockets[id].get();
+    auto index = handle_index(id);
+    SocketInfo *nfo = _sockets[index].get();
     assert(nfo->_cb_call_cntr == 0);
+    //generation is taken from the handle, because reconnect swaps slots
+    auto gen = static_cast<std::uint32_t>(id >> 32) + 1;
     std::destroy_at(nfo);
     std::construct_at(nfo);
-    nfo->_ident = _first_free_socket_ident;
-    _first_free_socket_ident = id;
+    nfo->_generation = gen?gen:1;
+    nfo->_next_free = _first_free_socket;
+    _first_free_socket = index;
 }
 
 
 NetContextWin::SocketInfo *NetContextWin::socket_by_ident(ConnHandle id) {
-    if (id >= _sockets.size()) return nullptr;
-    auto r = _sockets[id].get();
+    auto index = handle_index(id);
+    if (index >= _sockets.size()) return nullptr;
+    auto r = _sockets[index].get();
     return r->_ident == id?r:nullptr;
 }
 
 
-ConnHandle NetContextWin::connect(std::string address_port)  {
+ConnHandle NetContextWin::connect(std::string address_port, const SocketOptions &opts)  {
     std::lock_guard _(_mx);
     auto ctx = alloc_socket_lk();
     try {
         SOCKET s =  connect_peer(std::move(address_port),ctx->_ident+key_offset,&ctx->_send_ovr);
         ctx->_socket = s;
+        ctx->_options = opts;
+        apply_socket_options(s, opts);
         ctx->_connecting = true;
         return ctx->_ident;
     } catch (...) {
@@ -369,12 +406,16 @@ ConnHandle NetContextWin::connect(std::string address_port)  {
         oldh = nctx->_ident;
         auto octx = socket_by_ident(ident);
         if (octx) {
-            std::swap(_sockets[oldh], _sockets[ident]);
+            nctx->_options = octx->_options;
+            apply_socket_options(nctx->_socket, nctx->_options);
+            std::swap(_sockets[handle_index(oldh)], _sockets[handle_index(ident)]);
             nctx->_connecting = true;
             nctx->_ident = ident;
             octx->_ident = oldh;
             nctx->_timeout_cb = octx->_timeout_cb;
-            nctx->_tmtp = octx->_tmtp;
+            nctx->_timeout_timer = std::exchange(octx->_timeout_timer, TimerID{});
+            nctx->_timers = std::move(octx->_timers);
+            octx->_timers.clear();
             nctx->_cb_call_cntr = octx->_cb_call_cntr;
             octx->_cb_call_cntr = 0;
         }
@@ -386,6 +427,7 @@ ConnHandle NetContextWin::connect(std::string address_port)  {
 
 void NetContextWin::run_worker(std::stop_token tkn)  {
     std::unique_lock lk(_mx);
+    current_loop = this;
     std::stop_callback __(tkn, [&]{
         PostQueuedCompletionStatus(_completion_port,0,key_exit,NULL);
     });
@@ -409,26 +451,15 @@ void NetContextWin::run_worker(std::stop_token tkn)  {
         res = GetQueuedCompletionStatus(_completion_port,&transfered, &key, &ovr, timeout);    
         lk.lock();
         _need_timeout_thread = true;
-        if (!res && ovr == NULL) { //timeout
-            auto now = std::chrono::system_clock::now();
-            while (!_tmset.empty()) {
-                auto iter = _tmset.begin();
-                if (iter->first > now) break;
-                ConnHandle id = iter->second;
-                _tmset.erase(iter);
-                SocketInfo *nfo = socket_by_ident(id);
-                if (nfo && nfo->_timeout_cb) {
-                    auto cb = std::exchange(nfo->_timeout_cb, nullptr);
-                    invoke_cb_lk(lk, id, [&]{cb->on_timeout();});
-                }
-            }
-        } else {
+        if (res || ovr != NULL) {
             if (key >= key_offset) {
                 auto err = GetLastError();
                 if (res) err = 0;
                 process_event_lk(lk, static_cast<ConnHandle>(key-key_offset), transfered, ovr, err);
             }
         }
+        //timers are checked after every wakeup, so they are not starved by busy connections
+        process_timers_lk(lk);
         std::swap(actions, _actions);
         while (!actions.empty()) {
             lk.unlock();
@@ -446,23 +477,42 @@ void NetContextWin::run_worker(std::stop_token tkn)  {
 
 DWORD NetContextWin::get_completion_timeout_lk()
 {
-    auto tp = get_completion_timeout_tp_lk();
-    if (tp == std::chrono::system_clock::time_point::max()) return INFINITE;
-    auto now = std::chrono::system_clock::now();
+    auto tp = _timers.next_expiration();
+    if (tp == std::chrono::steady_clock::time_point::max()) return INFINITE;
+    auto now = std::chrono::steady_clock::now();
     if (tp < now) return 0;
-    auto diff = std::chrono::duration_cast<std::chrono::milliseconds>(tp - now).count();
+    auto diff = std::chrono::ceil<std::chrono::milliseconds>(tp - now).count();
     if (diff > static_cast<decltype(diff)>(std::numeric_limits<DWORD>::max())) {
         return INFINITE-1;
     } 
     return static_cast<DWORD>(diff);
 }
 
-std::chrono::system_clock::time_point NetContextWin::get_completion_timeout_tp_lk()
+void NetContextWin::process_timers_lk(std::unique_lock<std::mutex> &lk)
 {
-    if (!_tmset.empty()) {
-        return _tmset.begin()->first;
+    if (_timers.next_expiration() > std::chrono::steady_clock::now()) return;
+    _timers.advance(std::chrono::steady_clock::now());
+    while (auto t = _timers.pop_expired()) {
+        auto &nfo = t->payload;
+        if (nfo._ident == no_connection) {
+            ++callback_call_counter;
+            lk.unlock();
+            nfo._action();
+            lk.lock();
+            --callback_call_counter;
+            continue;
+        }
+        SocketInfo *ctx = socket_by_ident(nfo._ident);
+        if (!ctx) continue;
+        if (nfo._action) {
+            std::erase(ctx->_timers, t->id);
+            invoke_cb_lk(lk, nfo._ident, nfo._action);
+        } else if (ctx->_timeout_timer == t->id) {
+            ctx->_timeout_timer = {};
+            auto cb = std::exchange(ctx->_timeout_cb, nullptr);
+            if (cb) invoke_cb_lk(lk, nfo._ident, [&]{cb->on_timeout();});
+        }
     }
-    return std::chrono::system_clock::time_point::max();
 }
 
 void NetContextWin::process_event_lk(std::unique_lock<std::mutex> &lk, ConnHandle h,  DWORD transfered, OVERLAPPED *ovr, DWORD error) {
@@ -541,6 +591,8 @@ void NetContextWin::process_event_lk(std::unique_lock<std::mutex> &lk, ConnHandl
                 nfo->_socket = ctx->_accept_socket;
                 ctx->_accept_socket = INVALID_SOCKET;
                 setSocketNonBlocking(nfo->_socket);
+                nfo->_options = ctx->_options;
+                apply_socket_options(nfo->_socket, nfo->_options);
                 nfo->_clear_to_send = true;
                 CreateIoCompletionPort(reinterpret_cast<HANDLE>(nfo->_socket), _completion_port, nfo->_ident+key_offset, 0);
                 invoke_cb_lk(lk, h, [&]{if (srv) srv->on_accept(nfo->_ident, adrname);});                                
@@ -554,6 +606,7 @@ void NetContextWin::process_event_lk(std::unique_lock<std::mutex> &lk, ConnHandl
             }
             auto srv = std::exchange(ctx->_recv_cb, nullptr);
             std::string_view buff = {ctx->_recv_buffer.data(),transfered};
+            if (ctx->_use_own_buffer) update_own_buffer_size(ctx, transfered);
             ctx->_recv_buffer = {};
             invoke_cb_lk(lk, h, [&]{if (srv) srv->receive_complete(buff);});
         }
@@ -561,11 +614,50 @@ void NetContextWin::process_event_lk(std::unique_lock<std::mutex> &lk, ConnHandl
 
 }
 
+void NetContextWin::update_own_buffer_size(SocketInfo *ctx, std::size_t transfered) {
+    //size of the buffer is updated after completion. As the data are still
+    //in the buffer, the buffer is only marked to be resized on next receive
+    ctx->_use_own_buffer = false;
+    std::size_t bsize = ctx->_own_buffer.size();
+    if (transfered >= bsize) {
+        ctx->_own_buffer_size = std::min(max_read_buffer, bsize * 2);
+        ctx->_small_reads = 0;
+    } else if (transfered < bsize / 4 && bsize > min_read_buffer) {
+        if (++ctx->_small_reads >= shrink_after_reads) {
+            ctx->_own_buffer_size = bsize / 2;
+            ctx->_small_reads = 0;
+        }
+    } else {
+        ctx->_small_reads = 0;
+    }
+}
+
+void NetContextWin::receive(ConnHandle ident, IPeer *peer) {
+    std::span<char> buffer;
+    {
+        std::lock_guard _(_mx);
+        auto ctx = socket_by_ident(ident);
+        if (!ctx || ctx->_recv_cb) return;
+        if (ctx->_own_buffer_size == 0) ctx->_own_buffer_size = min_read_buffer;
+        if (ctx->_own_buffer.size() != ctx->_own_buffer_size) {
+            ctx->_own_buffer.resize(ctx->_own_buffer_size);
+            ctx->_own_buffer.shrink_to_fit();
+        }
+        buffer = {ctx->_own_buffer.data(), ctx->_own_buffer.size()};
+    }
+    receive_impl(ident, buffer, peer, true);
+}
+
 void NetContextWin::receive(ConnHandle ident, std::span<char> buffer, IPeer *peer) {
+    receive_impl(ident, buffer, peer, false);
+}
+
+void NetContextWin::receive_impl(ConnHandle ident, std::span<char> buffer, IPeer *peer, bool own_buffer) {
      std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx || ctx->_recv_cb) return;
     ctx->_recv_buffer = buffer;
+    ctx->_use_own_buffer = own_buffer;
     ctx->_recv_cb = peer;
     ZeroMemory(&ctx->_recv_ovr, sizeof(OVERLAPPED));
 
@@ -599,6 +691,20 @@ void NetContextWin::receive(ConnHandle ident, std::span<char> buffer, IPeer *pee
     }
 }
 
+std::size_t NetContextWin::send(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void>) {
+    //zero copy is not supported, data are always copied
+    return send(ident, data);
+}
+
+std::size_t NetContextWin::send(ConnHandle ident, std::span<const std::string_view> data) {
+    if (data.size() == 1) return send(ident, data.front());
+    //overlapped send keeps only small portion of data, so segments are joined
+    static thread_local std::string tmp;
+    tmp.clear();
+    for (const auto &seg: data) tmp.append(seg);
+    return send(ident, std::string_view(tmp));
+}
+
 std::size_t NetContextWin::send(ConnHandle ident, std::string_view data) {
      std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
@@ -654,7 +760,10 @@ std::size_t NetContextWin::send(ConnHandle ident, std::string_view data) {
             }
         }        
     } else {
-        buf = {static_cast<ULONG>(data.size()), const_cast<char *>(data.data())};
+        //data must stay valid until the operation completes, so they are copied
+        std::copy(data.begin(), data.end(), ctx->_aux_buffer);
+        ctx->_to_send = static_cast<DWORD>(data.size());
+        buf = {static_cast<ULONG>(data.size()), ctx->_aux_buffer};
         rc = WSASend(ctx->_socket, &buf, 1, NULL, 0, &ctx->_send_ovr, NULL);    //send data in overlapped mode to generate clear_to_send signal
         if (rc == SOCKET_ERROR) {
             auto err = WSAGetLastError();
@@ -669,6 +778,82 @@ std::size_t NetContextWin::send(ConnHandle ident, std::string_view data) {
     return rcv + data.size(); 
 }
 
+bool NetContextWin::write(ConnHandle ident, std::span<const std::string_view> data) {
+    return write(ident, data, nullptr);
+}
+
+bool NetContextWin::write(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) {
+    std::lock_guard _(_mx);
+    auto ctx = socket_by_ident(ident);
+    if (!ctx || ctx->_write_error || ctx->_error) return false;
+    for (const auto &seg: data) {
+        if (owner) ctx->_write_queue.append(seg, owner);
+        else ctx->_write_queue.append(seg);
+    }
+    if (!ctx->_flushing && !ctx->_write_queue.empty()) {
+        //the queue is written from IO thread through the flusher
+        ctx->_flushing = true;
+        ctx->_flusher._owner = this;
+        ctx->_flusher._ident = ident;
+        ctx->_send_cb = &ctx->_flusher;
+        if (ctx->_clear_to_send) {
+            PostQueuedCompletionStatus(_completion_port,0,ident+key_offset,&ctx->_send_ovr);
+        }
+    }
+    return true;
+}
+
+void NetContextWin::flush_queue(ConnHandle ident) {
+    std::unique_lock lk(_mx);
+    while (true) {
+        auto ctx = socket_by_ident(ident);
+        if (!ctx) return;
+        if (ctx->_write_queue.empty()) {
+            ctx->_flushing = false;
+            auto peer = std::exchange(ctx->_flush_cb, nullptr);
+            lk.unlock();
+            if (peer) peer->clear_to_send();
+            return;
+        }
+        std::string_view seg;
+        ctx->_write_queue.gather({&seg, 1});
+        lk.unlock();
+        auto n = send(ident, seg);
+        lk.lock();
+        ctx = socket_by_ident(ident);
+        if (!ctx) return;
+        if (n == 0) {
+            ctx->_write_error = true;
+            ctx->_write_queue.clear();
+            continue;
+        }
+        ctx->_write_queue.consume(n);
+        if (!ctx->_clear_to_send && !ctx->_write_queue.empty()) {
+            //wait for completion of overlapped operation
+            ctx->_send_cb = &ctx->_flusher;
+            return;
+        }
+    }
+}
+
+std::size_t NetContextWin::get_queued_bytes(ConnHandle ident) const {
+    std::lock_guard _(_mx);
+    auto ctx = const_cast<NetContextWin *>(this)->socket_by_ident(ident);
+    return ctx?ctx->_write_queue.size():0;
+}
+
+void NetContextWin::wait_for_flush(ConnHandle ident, IPeer *peer) {
+    std::unique_lock lk(_mx);
+    auto ctx = socket_by_ident(ident);
+    if (!ctx) return;
+    if (ctx->_flushing) {
+        ctx->_flush_cb = peer;
+        return;
+    }
+    lk.unlock();
+    peer->clear_to_send();
+}
+
 void NetContextWin::ready_to_send(ConnHandle ident, IPeer *peer) {
     std::unique_lock lk(_mx);   
     auto ctx = socket_by_ident(ident); 
@@ -753,7 +938,9 @@ void NetContextWin::destroy(ConnHandle ident) {
     ctx->_recv_cb = nullptr;
     ctx->_send_cb = nullptr;
     ctx->_timeout_cb = nullptr;
-    _tmset.erase({ctx->_tmtp, ident});
+    _timers.cancel(std::exchange(ctx->_timeout_timer, TimerID{}));
+    for (auto id: ctx->_timers) _timers.cancel(id);
+    ctx->_timers.clear();
     if (!ctx->_destroy_on_cancel_read && !ctx->_destroy_on_cancel_write) free_socket_lk(ident);
 }
 
@@ -761,17 +948,15 @@ void NetContextWin::run(std::stop_token tkn) {
     run_worker(std::move(tkn));
 }
 
-void NetContextWin::set_timeout(ConnHandle ident, std::chrono::system_clock::time_point tp, IPeerServerCommon *p) {
+void NetContextWin::set_timeout(ConnHandle ident, std::chrono::steady_clock::time_point tp, IPeerServerCommon *p) {
     std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx) return;
-    auto top = get_completion_timeout_tp_lk();
-    _tmset.erase({ctx->_tmtp, ident});
+    auto top = _timers.next_expiration();
+    _timers.cancel(ctx->_timeout_timer);
     ctx->_timeout_cb = p;
-    ctx->_tmtp = tp;
-    _tmset.insert({ctx->_tmtp, ident});
-    bool ntf = top > tp;
-    if (ntf) {
+    ctx->_timeout_timer = _timers.arm(tp, {ident, {}});
+    if (top > tp) {
         PostQueuedCompletionStatus(_completion_port, 0, key_wakeup, NULL);
     }
 }
@@ -780,8 +965,36 @@ void NetContextWin::clear_timeout(ConnHandle ident) {
     std::lock_guard _(_mx);
     auto ctx = socket_by_ident(ident);
     if (!ctx) return;
-    _tmset.erase({ctx->_tmtp, ident});
+    _timers.cancel(std::exchange(ctx->_timeout_timer, TimerID{}));
+    ctx->_timeout_cb = nullptr;
+}
 
+TimerID NetContextWin::set_timer(ConnHandle ident, std::chrono::steady_clock::time_point tp, SimpleAction action) {
+    std::lock_guard _(_mx);
+    SocketInfo *ctx = nullptr;
+    if (ident != no_connection) {
+        ctx = socket_by_ident(ident);
+        if (!ctx) return {};
+    }
+    auto top = _timers.next_expiration();
+    auto id = _timers.arm(tp, {ident, action});
+    if (id == Timers::invalid_id) return {};
+    if (ctx) ctx->_timers.push_back(id);
+    if (top > tp) {
+        PostQueuedCompletionStatus(_completion_port, 0, key_wakeup, NULL);
+    }
+    return id;
+}
+
+bool NetContextWin::cancel_timer(TimerID id) {
+    std::lock_guard _(_mx);
+    auto t = _timers.get(id);
+    if (!t || !t->_action) return false;    //connection timeouts are not canceled here
+    if (t->_ident != no_connection) {
+        auto ctx = socket_by_ident(t->_ident);
+        if (ctx) std::erase(ctx->_timers, id);
+    }
+    return _timers.cancel(id);
 }
 
 void NetContextWin::enqueue(SimpleAction fn)
@@ -791,6 +1004,23 @@ void NetContextWin::enqueue(SimpleAction fn)
     PostQueuedCompletionStatus(_completion_port,0,key_wakeup,nullptr);
 }
 
+void NetContextWin::post(SimpleAction fn) {
+    enqueue(std::move(fn));
+}
+
+void NetContextWin::defer(SimpleAction fn) {
+    enqueue(std::move(fn));
+}
+
+void NetContextWin::dispatch(SimpleAction fn) {
+    if (current_loop == this) fn();
+    else enqueue(std::move(fn));
+}
+
+bool NetContextWin::on_loop() const {
+    return current_loop == this;
+}
+
 ConnHandle NetContextWin::connect(SpecialConnection type, const void *arg)
 {
     auto ctx = alloc_socket_lk();
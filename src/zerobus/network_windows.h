@@ -1,9 +1,10 @@
 #include "network.h"
+#include "timer_wheel.h"
+#include "output_queue.h"
 #include <condition_variable>
 #include <memory>
 #include <memory_resource>
 #include <thread>
-#include <set>
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <WinSock2.h>
@@ -22,19 +23,34 @@ public:
     NetContextWin(const NetContextWin &) = delete;
     NetContextWin &operator=(const NetContextWin &) = delete;
 
-    virtual ConnHandle connect(std::string address) override;
+    virtual ConnHandle connect(std::string address, const SocketOptions &opts = {}) override;
     virtual void reconnect(ConnHandle ident, std::string address_port) override;
     virtual void receive(ConnHandle ident, std::span<char> buffer, IPeer *peer) override;
+    virtual void receive(ConnHandle ident, IPeer *peer) override;
     virtual std::size_t send(ConnHandle ident, std::string_view data) override;
+    virtual std::size_t send(ConnHandle ident, std::span<const std::string_view> data) override;
+    virtual std::size_t send(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) override;
     virtual void ready_to_send(ConnHandle ident, IPeer *peer) override;
-    virtual ConnHandle create_server(std::string address_port) override;
+    ///write data through the write queue
+    virtual bool write(ConnHandle ident, std::span<const std::string_view> data) override;
+    ///write data through the write queue without copying
+    virtual bool write(ConnHandle ident, std::span<const std::string_view> data, std::shared_ptr<const void> owner) override;
+    virtual std::size_t get_queued_bytes(ConnHandle ident) const override;
+    virtual void wait_for_flush(ConnHandle ident, IPeer *peer) override;
+    virtual ConnHandle create_server(std::string address_port, const SocketOptions &opts = {}) override;
     virtual void accept(ConnHandle ident, IServer *server) override;
     virtual void destroy(ConnHandle ident) override;
     std::jthread run_thread();
     void run(std::stop_token tkn);
-    virtual void set_timeout(ConnHandle ident, std::chrono::system_clock::time_point tp, IPeerServerCommon *p) override;
+    virtual void set_timeout(ConnHandle ident, std::chrono::steady_clock::time_point tp, IPeerServerCommon *p) override;
     virtual void clear_timeout(ConnHandle ident) override;
+    virtual TimerID set_timer(ConnHandle ident, std::chrono::steady_clock::time_point tp, SimpleAction action) override;
+    virtual bool cancel_timer(TimerID id) override;
     virtual void enqueue(SimpleAction fn) override;
+    virtual void post(SimpleAction fn) override;
+    virtual void defer(SimpleAction fn) override;
+    virtual void dispatch(SimpleAction fn) override;
+    virtual bool on_loop() const override;
     virtual ConnHandle connect(SpecialConnection type, const void *arg = nullptr) override;
     virtual PipePair create_pipe() override;
     virtual bool in_calback() const override;
@@ -45,18 +61,49 @@ protected:
     static constexpr ULONG_PTR key_wakeup = 0;
     static constexpr ULONG_PTR key_exit = 1;
 
-    using TimeoutInfo = std::pair<std::chrono::system_clock::time_point, ConnHandle>;
-    using TimeoutSet = std::set<TimeoutInfo,  std::less<TimeoutInfo>,  std::pmr::polymorphic_allocator<TimeoutInfo> >;
+    struct TimerInfo {
+        ConnHandle _ident = no_connection;  //owner of the timer
+        SimpleAction _action = {};          //action, if empty, this is timeout of the connection
+    };
+
+    using Timers = TimerWheel<TimerInfo>;
+
+    ///initial and minimal size of buffer managed by the context
+    static constexpr std::size_t min_read_buffer = 4096;
+    ///maximal size of buffer managed by the context
+    static constexpr std::size_t max_read_buffer = 256*1024;
+    ///count of consecutive small reads needed to shrink the buffer
+    static constexpr unsigned int shrink_after_reads = 8;
+
+
+    ///writes the write queue, registered as send callback of the connection
+    class QueueFlusher: public IPeer {
+    public:
+        NetContextWin *_owner = nullptr;
+        ConnHandle _ident = static_cast<ConnHandle>(-1);
+        virtual void receive_complete(std::string_view) noexcept override {}
+        virtual void clear_to_send() noexcept override {_owner->flush_queue(_ident);}
+        virtual void on_timeout() noexcept override {}
+    };
 
+    ///marks end of the free list
+    static constexpr std::uint32_t no_free_socket = static_cast<std::uint32_t>(-1);
 
     struct SocketInfo {
         ConnHandle _ident = static_cast<ConnHandle>(-1);    //this connection handle
+        std::uint32_t _generation = 1;                      //generation of next handle of this slot
+        std::uint32_t _next_free = no_free_socket;          //next free slot (when slot is free)
         union {
             SOCKET _socket = INVALID_SOCKET;                    //associated socket
             HANDLE _pipe_handle;
         };
         std::span<char> _recv_buffer;                       //reference to receiving buffer
-        std::chrono::system_clock::time_point _tmtp = {};   //current scheduled timeout - function set_timeout()
+        std::vector<char> _own_buffer = {};                 //buffer managed by the context
+        std::size_t _own_buffer_size = 0;                   //requested size of _own_buffer
+        unsigned int _small_reads = 0;                      //count of consecutive small reads
+        bool _use_own_buffer = false;                       //current read uses _own_buffer
+        TimerID _timeout_timer = {};                        //current scheduled timeout - function set_timeout()
+        std::vector<TimerID> _timers = {};                  //timers owned by the connection
         IPeer *_recv_cb = {};                               //callback object for recv
         IPeer *_send_cb = {};                               //callback object for send
         IServer *_accept_cb = {};                           //callback object for accept
@@ -74,6 +121,12 @@ protected:
         bool _is_handle = false;
         bool _destroy_on_cancel_read = false;
         bool _destroy_on_cancel_write = false;
+        SocketOptions _options = {};                        //options of the socket (inherited by accepted sockets)
+        OutputQueue _write_queue = {};                      //data of write() waiting to be written
+        IPeer *_flush_cb = {};                              //callback object for wait_for_flush()
+        bool _write_error = false;                          //write() failed, queue is dropped
+        bool _flushing = false;                             //flusher is registered as send callback
+        QueueFlusher _flusher = {};                         //send callback which writes the queue
     };
     using SocketList = std::vector<std::unique_ptr<SocketInfo> >;
 
@@ -82,21 +135,27 @@ protected:
     ErrorCallback _ecb;
     HANDLE _completion_port;
     SocketList _sockets = {};
-    ConnHandle _first_free_socket_ident = 0;
-    std::pmr::unsynchronized_pool_resource _pool;
-    TimeoutSet _tmset;
+    std::uint32_t _first_free_socket = no_free_socket;
+    Timers _timers;
     std::condition_variable _cond;
     bool _need_timeout_thread = false;
     std::vector<SimpleAction> _actions;
 
 
+    static ConnHandle make_handle(std::uint32_t index, std::uint32_t generation) {
+        return (static_cast<ConnHandle>(generation) << 32) | index;
+    }
+    static std::uint32_t handle_index(ConnHandle id) {return static_cast<std::uint32_t>(id);}
     SocketInfo *alloc_socket_lk();
     void free_socket_lk(ConnHandle id);
     SocketInfo *socket_by_ident(ConnHandle id);
-    SOCKET connect_peer(std::string address_port, DWORD key, OVERLAPPED *ovr);
+    void flush_queue(ConnHandle id);
+    void receive_impl(ConnHandle ident, std::span<char> buffer, IPeer *peer, bool own_buffer);
+    static void update_own_buffer_size(SocketInfo *ctx, std::size_t transfered);
+    SOCKET connect_peer(std::string address_port, ULONG_PTR key, OVERLAPPED *ovr);
     void run_worker(std::stop_token tkn) ;
     DWORD get_completion_timeout_lk();
-    std::chrono::system_clock::time_point get_completion_timeout_tp_lk();
+    void process_timers_lk(std::unique_lock<std::mutex> &lk);
     void process_event_lk(std::unique_lock<std::mutex> &lk, ConnHandle h,  DWORD transfered, OVERLAPPED *ovr, DWORD error);
     template<typename E> void report_error(E exception, std::string_view action, std::source_location loc = std::source_location::current());
     void report_last_error(std::string_view action, std::source_location loc = std::source_location::current());
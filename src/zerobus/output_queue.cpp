@@ -0,0 +1,138 @@
+#include "output_queue.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+namespace zerobus {
+
+OutputQueue::OutputQueue(OutputQueue &&other) noexcept
+    :_ring(std::move(other._ring))
+    ,_head(std::exchange(other._head, 0))
+    ,_count(std::exchange(other._count, 0))
+    ,_size(std::exchange(other._size, 0))
+    ,_chunk(std::move(other._chunk))
+    ,_chunk_used(std::exchange(other._chunk_used, 0)) {}
+
+OutputQueue &OutputQueue::operator=(OutputQueue &&other) noexcept {
+    if (this != &other) {
+        _ring = std::move(other._ring);
+        _head = std::exchange(other._head, 0);
+        _count = std::exchange(other._count, 0);
+        _size = std::exchange(other._size, 0);
+        _chunk = std::move(other._chunk);
+        _chunk_used = std::exchange(other._chunk_used, 0);
+    }
+    return *this;
+}
+
+void OutputQueue::grow() {
+    //segments are moved to the beginning in order
+    std::vector<Segment> n(std::max<std::size_t>(8, _ring.size() * 2));
+    for (std::size_t i = 0; i < _count; ++i) n[i] = std::move(at(i));
+    _ring = std::move(n);
+    _head = 0;
+}
+
+void OutputQueue::push(Segment seg) {
+    if (_count == _ring.size()) grow();
+    _size += seg.size;
+    at(_count++) = std::move(seg);
+}
+
+void OutputQueue::prepend(std::string_view data) {
+    if (data.empty()) return;
+    auto buff = std::make_shared_for_overwrite<char[]>(data.size());
+    std::memcpy(buff.get(), data.data(), data.size());
+    if (_count == _ring.size()) grow();
+    _head = (_head + _ring.size() - 1) & (_ring.size() - 1);
+    ++_count;
+    _size += data.size();
+    at(0) = {buff.get(), data.size(), std::move(buff)};
+}
+
+void OutputQueue::append(std::string_view data) {
+    if (data.size() >= chunk_size) {
+        //large data has its own buffer
+        auto buff = std::make_shared_for_overwrite<char[]>(data.size());
+        std::memcpy(buff.get(), data.data(), data.size());
+        push({buff.get(), data.size(), std::move(buff)});
+        return;
+    }
+    while (!data.empty()) {
+        if (!_chunk || _chunk_used == chunk_size) {
+            _chunk = std::make_shared_for_overwrite<char[]>(chunk_size);
+            _chunk_used = 0;
+        }
+        auto part = std::min(data.size(), chunk_size - _chunk_used);
+        char *wr = _chunk.get() + _chunk_used;
+        std::memcpy(wr, data.data(), part);
+        _chunk_used += part;
+        data = data.substr(part);
+        if (_count) {
+            //extend the last segment, if it ends at the write position
+            auto &last = at(_count - 1);
+            if (last.data + last.size == wr && last.owner.get() == _chunk.get()) {
+                last.size += part;
+                _size += part;
+                continue;
+            }
+        }
+        push({wr, part, _chunk});
+    }
+}
+
+void OutputQueue::append(std::string_view data, std::shared_ptr<const void> owner) {
+    if (data.empty()) return;
+    push({data.data(), data.size(), std::move(owner)});
+}
+
+std::size_t OutputQueue::gather(std::span<std::string_view> out) const {
+    std::size_t cnt = std::min(out.size(), _count);
+    for (std::size_t i = 0; i < cnt; ++i) {
+        const auto &seg = at(i);
+        out[i] = std::string_view(seg.data, seg.size);
+    }
+    return cnt;
+}
+
+void OutputQueue::consume(std::size_t n) {
+    while (n && _count) {
+        auto &seg = at(0);
+        if (n < seg.size) {
+            seg.data += n;
+            seg.size -= n;
+            _size -= n;
+            return;
+        }
+        n -= seg.size;
+        _size -= seg.size;
+        seg.owner.reset();
+        _head = (_head + 1) & (_ring.size() - 1);
+        --_count;
+    }
+    //chunk is no longer referenced by any segment, reuse it from beginning
+    if (_count == 0 && _chunk && _chunk.use_count() == 1) _chunk_used = 0;
+}
+
+void OutputQueue::clear() {
+    while (_count) {
+        at(0).owner.reset();
+        _head = (_head + 1) & (_ring.size() - 1);
+        --_count;
+    }
+    _size = 0;
+    _head = 0;
+    _chunk_used = 0;
+    _chunk.reset();
+}
+
+void OutputQueue::release() {
+    if (_count) return;
+    std::vector<Segment>().swap(_ring);
+    _head = 0;
+    _chunk_used = 0;
+    _chunk.reset();
+}
+
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+namespace zerobus {
+
+///Queue of data waiting to be written to a connection
+/**
+ * Data are stored as segments in a ring, so removing written data from the
+ * front never moves the rest of the queue. Small writes are copied into shared
+ * chunks (one chunk holds many small writes). Large data can be queued without
+ * copying, when they are kept alive by an owner.
+ *
+ * The queue is not MT safe.
+ */
+class OutputQueue {
+public:
+
+    ///size of chunk used to store copied data
+    static constexpr std::size_t chunk_size = 16384;
+
+    OutputQueue() = default;
+    OutputQueue(OutputQueue &&other) noexcept;
+    OutputQueue &operator=(OutputQueue &&other) noexcept;
+
+    ///append copy of data
+    void append(std::string_view data);
+    ///append data without copying
+    /**
+     * @param data data to append
+     * @param owner object which keeps data alive. It is released when the data are written
+     */
+    void append(std::string_view data, std::shared_ptr<const void> owner);
+
+    ///insert copy of data before the first segment
+    /**
+     * @param data data to insert. The front segment must not be partially consumed
+     */
+    void prepend(std::string_view data);
+
+    ///retrieve segments from the front of the queue
+    /**
+     * @param out array which receives segments
+     * @return count of segments stored to the array
+     */
+    std::size_t gather(std::span<std::string_view> out) const;
+
+    ///remove written data from the front of the queue
+    /**
+     * @param n count of bytes written
+     */
+    void consume(std::size_t n);
+
+    ///total count of queued bytes
+    std::size_t size() const {return _size;}
+    ///determines whether queue is empty
+    bool empty() const {return _size == 0;}
+    ///count of segments
+    std::size_t segments() const {return _count;}
+
+    ///remove everything
+    void clear();
+
+    ///release memory kept for next writes, if the queue is empty
+    void release();
+
+protected:
+
+    struct Segment {
+        const char *data;
+        std::size_t size;
+        std::shared_ptr<const void> owner;
+    };
+
+    std::vector<Segment> _ring;         //capacity is always power of two
+    std::size_t _head = 0;              //index of first segment
+    std::size_t _count = 0;             //count of segments
+    std::size_t _size = 0;              //count of bytes
+    std::shared_ptr<char[]> _chunk;     //chunk where copied data are appended
+    std::size_t _chunk_used = 0;        //used space in the chunk
+
+    Segment &at(std::size_t idx) {return _ring[(_head + idx) & (_ring.size() - 1)];}
+    const Segment &at(std::size_t idx) const {return _ring[(_head + idx) & (_ring.size() - 1)];}
+    void push(Segment seg);
+    void grow();
+};
+
+}
@@ -0,0 +1,110 @@
+#include "resolver_linux.h"
+
+#include <algorithm>
+#include <cstring>
+#include <netdb.h>
+
+namespace zerobus {
+
+std::string Resolver::Result::error_message() const {
+    return gai_strerror(error);
+}
+
+Resolver::Resolver(std::chrono::seconds ttl, std::chrono::seconds negative_ttl, unsigned int max_threads)
+    :_ttl(ttl),_negative_ttl(negative_ttl),_max_threads(std::max(max_threads, 1U)) {}
+
+Resolver::~Resolver() {
+    stop();
+}
+
+void Resolver::stop() {
+    std::vector<std::jthread> thrs;
+    {
+        std::lock_guard _(_mx);
+        thrs = std::move(_threads);
+        _threads.clear();
+    }
+    for (auto &t: thrs) t.request_stop();
+    for (auto &t: thrs) t.join();
+}
+
+Resolver::ResultPtr Resolver::call_getaddrinfo(const Key &key, int flags) {
+    addrinfo hints = {};
+    addrinfo *res = nullptr;
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICSERV | flags;
+    auto result = std::make_shared<Result>();
+    result->error = getaddrinfo(key.first.c_str(), key.second.c_str(), &hints, &res);
+    if (result->error == 0) {
+        for (addrinfo *p = res; p != nullptr; p = p->ai_next) {
+            Address a = {};
+            std::memcpy(&a.addr, p->ai_addr, p->ai_addrlen);
+            a.len = p->ai_addrlen;
+            a.family = p->ai_family;
+            a.socktype = p->ai_socktype;
+            a.protocol = p->ai_protocol;
+            result->addresses.push_back(a);
+        }
+        freeaddrinfo(res);
+    }
+    return result;
+}
+
+Resolver::ResultPtr Resolver::lookup(const std::string &host, const std::string &port) {
+    Key key(host, port);
+    //numeric address is resolved without asking DNS
+    auto r = call_getaddrinfo(key, AI_NUMERICHOST);
+    if (r->error == 0) return r;
+    std::lock_guard _(_mx);
+    auto iter = _cache.find(key);
+    if (iter == _cache.end() || !iter->second.result) return nullptr;
+    if (iter->second.expires < std::chrono::steady_clock::now()) {
+        if (iter->second.waiting.empty()) _cache.erase(iter);
+        return nullptr;
+    }
+    return iter->second.result;
+}
+
+void Resolver::resolve(const std::string &host, const std::string &port, Callback cb) {
+    std::lock_guard _(_mx);
+    Key key(host, port);
+    auto &e = _cache[key];
+    bool new_lookup = e.waiting.empty();
+    e.waiting.push_back(std::move(cb));
+    if (!new_lookup) return;
+    _queue.push_back(key);
+    if (_idle == 0 && _threads.size() < _max_threads) {
+        _threads.emplace_back([this](std::stop_token tkn){worker(std::move(tkn));});
+    } else {
+        _cond.notify_one();
+    }
+}
+
+void Resolver::worker(std::stop_token tkn) {
+    std::unique_lock lk(_mx);
+    while (true) {
+        ++_idle;
+        bool ok = _cond.wait(lk, tkn, [&]{return !_queue.empty();});
+        --_idle;
+        if (!ok) break;
+        Key key = std::move(_queue.front());
+        _queue.erase(_queue.begin());
+        lk.unlock();
+        auto result = call_getaddrinfo(key, 0);
+        lk.lock();
+        auto &e = _cache[key];
+        e.result = result;
+        e.expires = std::chrono::steady_clock::now() + (result->error?_negative_ttl:_ttl);
+        auto waiting = std::move(e.waiting);
+        e.waiting.clear();
+        lk.unlock();
+        for (auto &cb: waiting) {
+            if (tkn.stop_requested()) break;
+            cb(result);
+        }
+        lk.lock();
+    }
+}
+
+}
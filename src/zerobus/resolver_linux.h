@@ -0,0 +1,106 @@
+#pragma once
+#include <sys/socket.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <stop_token>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace zerobus {
+
+///Resolves host names on helper threads and caches results
+/**
+ * getaddrinfo() can block for seconds, so it is never called from the
+ * IO thread. Helper threads are started on demand up to the given limit, so a
+ * slow lookup doesn't block lookups of other hosts. Results (including failures) are cached, so reconnect to the
+ * same host doesn't need to wait for the resolver again. Concurrent requests
+ * for the same host are merged into one lookup.
+ */
+class Resolver {
+public:
+
+    ///one resolved address
+    struct Address {
+        sockaddr_storage addr;
+        socklen_t len;
+        int family;
+        int socktype;
+        int protocol;
+    };
+
+    ///result of the resolution
+    struct Result {
+        ///resolved addresses (empty on error)
+        std::vector<Address> addresses;
+        ///error code of getaddrinfo (zero on success)
+        int error = 0;
+        ///description of the error
+        std::string error_message() const;
+    };
+
+    using ResultPtr = std::shared_ptr<const Result>;
+    using Callback = std::function<void(const ResultPtr &)>;
+
+    ///construct
+    /**
+     * @param ttl how long is successful result cached
+     * @param negative_ttl how long is failure cached
+     * @param max_threads maximum count of helper threads
+     */
+    Resolver(std::chrono::seconds ttl, std::chrono::seconds negative_ttl, unsigned int max_threads);
+    ~Resolver();
+    Resolver(const Resolver &) = delete;
+    Resolver &operator=(const Resolver &) = delete;
+
+    ///resolve address without blocking
+    /**
+     * @param host host name
+     * @param port numeric port
+     * @return result if the address is numeric or the result is cached. Otherwise
+     * returns nullptr and the caller must use resolve()
+     */
+    ResultPtr lookup(const std::string &host, const std::string &port);
+
+    ///resolve address on a helper thread
+    /**
+     * @param host host name
+     * @param port numeric port
+     * @param cb callback called from a helper thread when the result is ready. It
+     * is not called, if the resolver is destroyed before
+     */
+    void resolve(const std::string &host, const std::string &port, Callback cb);
+
+    ///stop helper threads, pending callbacks are not called
+    void stop();
+
+protected:
+
+    struct Entry {
+        ResultPtr result;
+        std::chrono::steady_clock::time_point expires;
+        std::vector<Callback> waiting;  //non-empty while the lookup is in progress
+    };
+
+    using Key = std::pair<std::string, std::string>;
+
+    std::chrono::seconds _ttl;
+    std::chrono::seconds _negative_ttl;
+    unsigned int _max_threads;
+    unsigned int _idle = 0;    //count of threads waiting for a request
+    std::mutex _mx;
+    std::condition_variable_any _cond;
+    std::map<Key, Entry> _cache;
+    std::vector<Key> _queue;
+    std::vector<std::jthread> _threads;
+
+    void worker(std::stop_token tkn);
+    static ResultPtr call_getaddrinfo(const Key &key, int flags);
+};
+
+}
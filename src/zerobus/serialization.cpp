@@ -24,6 +24,10 @@ enum class MessageType: std::uint8_t {
         ///close all groups (lost context)
         new_session = 0xF6,
         update_serial = 0xF5,
+        ///version of channel list
+        channels_version = 0xF4,
+        ///request to resend channels changed since version
+        channels_resync = 0xF3,
 };
 
 Deserialization::Result Deserialization::operator ()(std::string_view msgtext) {
@@ -85,6 +89,16 @@ Deserialization::Result Deserialization::operator ()(std::string_view msgtext) {
             auto serial = read_string(msgtext);
             return Msg::UpdateSerial{serial};
         }
+        case MessageType::channels_version: {
+            auto epoch = read_uint(msgtext);
+            auto version = read_uint(msgtext);
+            return Msg::ChannelVersion{static_cast<std::uint32_t>(epoch), static_cast<std::uint32_t>(version)};
+        }
+        case MessageType::channels_resync: {
+            auto epoch = read_uint(msgtext);
+            auto version = read_uint(msgtext);
+            return Msg::ChannelResync{static_cast<std::uint32_t>(epoch), static_cast<std::uint32_t>(version)};
+        }
 
     }
 }
@@ -175,10 +189,24 @@ std::string_view Serialization::operator ()(const Msg::UpdateSerial &msg) {
     return finish_write();
 }
 
+std::string_view Serialization::operator ()(const Msg::ChannelVersion &msg) {
+    compose_message(start_write(), MessageType::channels_version, msg.epoch, msg.version);
+    return finish_write();
+}
+
+std::string_view Serialization::operator ()(const Msg::ChannelResync &msg) {
+    compose_message(start_write(), MessageType::channels_resync, msg.epoch, msg.version);
+    return finish_write();
+}
+
 std::string_view Serialization::finish_write() const {
     return {_buffer.data(), _buffer.size()};
 }
 
+std::shared_ptr<const std::vector<char> > Serialization::release_buffer() {
+    return std::make_shared<const std::vector<char> >(std::move(_buffer));
+}
+
 std::string_view Serialization::operator ()(const Msg::GroupEmpty &msg) {
     compose_message(start_write(), MessageType::group_empty, msg.group);
     return finish_write();
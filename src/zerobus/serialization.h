@@ -4,6 +4,7 @@
 #include <iterator>
 #include <variant>
 #include <iostream>
+#include <memory>
 
 namespace zerobus {
 
@@ -32,7 +33,9 @@ public:
             Msg::CloseGroup,
             Msg::GroupEmpty,
             Msg::NewSession,
-            Msg::UpdateSerial>;
+            Msg::UpdateSerial,
+            Msg::ChannelVersion,
+            Msg::ChannelResync>;
 
     Result operator()(std::string_view msgtext);
 public: //static helpers
@@ -65,6 +68,8 @@ public:
     std::string_view operator()(const Msg::GroupEmpty &msg);
     std::string_view operator()(const Msg::NewSession &msg);
     std::string_view operator()(const Msg::UpdateSerial &msg);
+    std::string_view operator()(const Msg::ChannelVersion &msg);
+    std::string_view operator()(const Msg::ChannelResync &msg);
 
     template<typename ... Args>
     std::string_view operator()(std::uint8_t msg_type, const Args & ... args) {
@@ -73,6 +78,14 @@ public:
         return finish_write();
     }
 
+    ///Take buffer containing the last serialized message
+    /**
+     * View returned by the last serialization remains valid as long as the
+     * result is held. Next serialization allocates a new buffer
+     * @return buffer
+     */
+    std::shared_ptr<const std::vector<char> > release_buffer();
+
 public: //static helpers
 
     template<std::output_iterator<char> Iter>
@@ -0,0 +1,313 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <optional>
+#include <vector>
+
+namespace zerobus {
+
+///Hierarchical timing wheel
+/**
+ * Timers are stored in 8 levels of 64 slots with resolution of one microsecond
+ * of the steady (monotonic) clock. Arm and cancel are O(1). Advancing the wheel
+ * skips empty slots using occupancy bitmaps, so the cost doesn't depend on
+ * time elapsed since last advance. Timers on upper levels are cascaded
+ * to lower levels when their slot is reached.
+ *
+ * Entries are kept in a vector and linked by indices. Every entry has
+ * a generation counter, which is part of its ID, so ID of an expired or canceled
+ * timer can't hit a different timer
+ *
+ * @tparam Payload data associated with the timer, returned when timer expires
+ *
+ * @note object is not MT safe
+ */
+template<typename Payload>
+class TimerWheel {
+public:
+
+    using Clock = std::chrono::steady_clock;
+    using TimePoint = Clock::time_point;
+    ///ID of the timer. Low 32 bits contains index, high 32 bits contains generation
+    using ID = std::uint64_t;
+
+    ///ID which is never returned by arm()
+    static constexpr ID invalid_id = 0;
+
+    TimerWheel():_curtime(to_tick(Clock::now())) {}
+
+    ///arm the timer
+    /**
+     * @param tp time point when timer expires. If the time point is in the past,
+     * the timer expires on next advance()
+     * @param payload payload
+     * @return id of the timer. Returns invalid_id, if tp is TimePoint::max()
+     */
+    ID arm(TimePoint tp, Payload payload) {
+        if (tp == TimePoint::max()) return invalid_id;
+        std::uint32_t idx = alloc_entry();
+        Entry &e = _entries[idx];
+        e.payload = std::move(payload);
+        schedule(idx, to_tick(tp));
+        return make_id(idx, e.generation);
+    }
+
+    ///cancel the timer
+    /**
+     * @param id id of the timer
+     * @retval true canceled
+     * @retval false timer not found (already expired or canceled)
+     */
+    bool cancel(ID id) {
+        auto idx = find(id);
+        if (idx == npos) return false;
+        unlink(idx);
+        free_entry(idx);
+        return true;
+    }
+
+    ///retrieve payload of pending timer
+    /**
+     * @param id id of the timer
+     * @return pointer to payload or nullptr if there is no such timer
+     */
+    Payload *get(ID id) {
+        auto idx = find(id);
+        if (idx == npos) return nullptr;
+        return &_entries[idx].payload;
+    }
+
+    ///advance the wheel to given time
+    /**
+     * Moves all timers, which expired until given time, to the expired list. Use
+     * pop_expired() to retrieve them
+     * @param now current time
+     */
+    void advance(TimePoint now) {
+        std::uint64_t curtime = to_tick(now);
+        if (curtime <= _curtime) return;
+        std::uint64_t elapsed = curtime - _curtime;
+        ListHead todo;
+        for (unsigned int level = 0; level < levels; ++level) {
+            std::uint64_t pending;
+            const unsigned int shift = level * level_bits;
+            if ((elapsed >> shift) > slot_mask) {
+                pending = ~std::uint64_t(0);
+            } else {
+                int lelapsed = static_cast<int>(slot_mask & (elapsed >> shift));
+                int oslot = static_cast<int>(slot_mask & (_curtime >> shift));
+                int nslot = static_cast<int>(slot_mask & (curtime >> shift));
+                std::uint64_t span = (std::uint64_t(1) << lelapsed) - 1;
+                pending = std::rotl(span, oslot);
+                pending |= std::rotr(std::rotl(span, nslot), lelapsed);
+                pending |= std::uint64_t(1) << nslot;
+            }
+            while (pending & _occupied[level]) {
+                int slot = std::countr_zero(pending & _occupied[level]);
+                splice(todo, _lists[level * slots + slot]);
+                _occupied[level] &= ~(std::uint64_t(1) << slot);
+            }
+            if (!(pending & 1)) break;  //didn't wrap around, upper levels are not affected
+            //next level must tick at least once
+            elapsed = std::max<std::uint64_t>(elapsed, std::uint64_t(slots) << shift);
+        }
+        _curtime = curtime;
+        while (todo.first != npos) {
+            auto idx = todo.first;
+            remove_from(todo, idx);
+            schedule(idx, _entries[idx].expires);
+        }
+    }
+
+    ///Expired timer
+    struct Expired {
+        ID id;
+        Payload payload;
+    };
+
+    ///pop one expired timer
+    /**
+     * @return expired timer, or no value, if there are no more expired timers
+     */
+    std::optional<Expired> pop_expired() {
+        auto idx = _lists[expired_list].first;
+        if (idx == npos) return {};
+        remove_from(_lists[expired_list], idx);
+        Entry &e = _entries[idx];
+        std::optional<Expired> out(Expired{make_id(idx, e.generation), std::move(e.payload)});
+        free_entry(idx);
+        return out;
+    }
+
+    ///calculate time when advance() should be called
+    /**
+     * @return time point of nearest expiration. The result can be earlier than
+     * actual expiration of any timer, when a timer needs to be cascaded
+     * to the lower level. Returns TimePoint::max() if there is no timer
+     */
+    TimePoint next_expiration() const {
+        if (_lists[expired_list].first != npos) return from_tick(_curtime);
+        std::uint64_t timeout = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t relmask = 0;
+        for (unsigned int level = 0; level < levels; ++level) {
+            const unsigned int shift = level * level_bits;
+            if (_occupied[level]) {
+                int slot = static_cast<int>(slot_mask & (_curtime >> shift));
+                std::uint64_t t = static_cast<std::uint64_t>(
+                        std::countr_zero(std::rotr(_occupied[level], slot)) + (level?1:0)) << shift;
+                t -= relmask & _curtime;
+                timeout = std::min(timeout, t);
+            }
+            relmask = (relmask << level_bits) | slot_mask;
+        }
+        if (timeout == std::numeric_limits<std::uint64_t>::max()) return TimePoint::max();
+        return from_tick(_curtime + timeout);
+    }
+
+    ///returns true, if there are no timers
+    bool empty() const {
+        return _active == 0;
+    }
+
+    ///converts time point to wheel's tick (rounded up)
+    static std::uint64_t to_tick(TimePoint tp) {
+        auto us = std::chrono::ceil<std::chrono::microseconds>(tp.time_since_epoch()).count();
+        return us < 0?0:static_cast<std::uint64_t>(us);
+    }
+    ///converts wheel's tick to time point
+    static TimePoint from_tick(std::uint64_t tick) {
+        return TimePoint(std::chrono::duration_cast<Clock::duration>(
+                std::chrono::microseconds(static_cast<std::int64_t>(tick))));
+    }
+
+protected:
+
+    static constexpr unsigned int level_bits = 6;
+    static constexpr unsigned int slots = 1 << level_bits;
+    static constexpr std::uint64_t slot_mask = slots - 1;
+    static constexpr unsigned int levels = 8;
+    static constexpr std::uint64_t max_timeout = (std::uint64_t(1) << (levels * level_bits)) - 1;
+    static constexpr std::uint32_t npos = std::numeric_limits<std::uint32_t>::max();
+    static constexpr std::uint16_t expired_list = levels * slots;
+
+    struct Entry {
+        std::uint64_t expires = 0;
+        std::uint32_t prev = npos;
+        std::uint32_t next = npos;
+        std::uint32_t generation = 1;
+        std::uint16_t list = expired_list;   //index of list where entry is stored
+        bool active = false;
+        Payload payload = {};
+    };
+
+    struct ListHead {
+        std::uint32_t first = npos;
+        std::uint32_t last = npos;
+    };
+
+    std::vector<Entry> _entries;
+    //lists of all slots of all levels, the last list contains expired timers
+    std::array<ListHead, levels * slots + 1> _lists = {};
+    std::array<std::uint64_t, levels> _occupied = {};
+    std::uint32_t _first_free = npos;
+    std::uint32_t _active = 0;
+    std::uint64_t _curtime;
+
+    static ID make_id(std::uint32_t idx, std::uint32_t gen) {
+        return (static_cast<ID>(gen) << 32) | idx;
+    }
+
+    std::uint32_t find(ID id) const {
+        auto idx = static_cast<std::uint32_t>(id & 0xFFFFFFFF);
+        auto gen = static_cast<std::uint32_t>(id >> 32);
+        if (idx >= _entries.size()) return npos;
+        const Entry &e = _entries[idx];
+        if (!e.active || e.generation != gen) return npos;
+        return idx;
+    }
+
+    std::uint32_t alloc_entry() {
+        std::uint32_t idx;
+        if (_first_free == npos) {
+            idx = static_cast<std::uint32_t>(_entries.size());
+            _entries.emplace_back();
+        } else {
+            idx = _first_free;
+            _first_free = _entries[idx].next;
+        }
+        _entries[idx].active = true;
+        ++_active;
+        return idx;
+    }
+
+    void free_entry(std::uint32_t idx) {
+        Entry &e = _entries[idx];
+        e.payload = {};
+        e.active = false;
+        if (++e.generation == 0) e.generation = 1;
+        e.prev = npos;
+        e.next = _first_free;
+        _first_free = idx;
+        --_active;
+    }
+
+    void push_back(ListHead &lst, std::uint32_t idx) {
+        Entry &e = _entries[idx];
+        e.next = npos;
+        e.prev = lst.last;
+        if (lst.last == npos) lst.first = idx;
+        else _entries[lst.last].next = idx;
+        lst.last = idx;
+    }
+
+    void remove_from(ListHead &lst, std::uint32_t idx) {
+        Entry &e = _entries[idx];
+        if (e.prev == npos) lst.first = e.next;
+        else _entries[e.prev].next = e.next;
+        if (e.next == npos) lst.last = e.prev;
+        else _entries[e.next].prev = e.prev;
+        e.prev = e.next = npos;
+    }
+
+    void splice(ListHead &target, ListHead &source) {
+        if (source.first == npos) return;
+        if (target.last == npos) {
+            target = source;
+        } else {
+            _entries[target.last].next = source.first;
+            _entries[source.first].prev = target.last;
+            target.last = source.last;
+        }
+        source = {};
+    }
+
+    void unlink(std::uint32_t idx) {
+        auto lst = _entries[idx].list;
+        ListHead &h = _lists[lst];
+        remove_from(h, idx);
+        if (lst != expired_list && h.first == npos) {
+            _occupied[lst / slots] &= ~(std::uint64_t(1) << (lst % slots));
+        }
+    }
+
+    void schedule(std::uint32_t idx, std::uint64_t expires) {
+        Entry &e = _entries[idx];
+        e.expires = expires;
+        if (expires > _curtime) {
+            std::uint64_t rem = std::min(expires - _curtime, max_timeout);
+            unsigned int level = static_cast<unsigned int>(std::bit_width(rem) - 1) / level_bits;
+            unsigned int slot = static_cast<unsigned int>(slot_mask & ((expires >> (level * level_bits)) - (level?1:0)));
+            e.list = static_cast<std::uint16_t>(level * slots + slot);
+            _occupied[level] |= std::uint64_t(1) << slot;
+        } else {
+            e.list = expired_list;
+        }
+        push_back(_lists[e.list], idx);
+    }
+};
+
+}
@@ -157,7 +157,7 @@ Builder::Builder(bool client)
     :_client(client) {
     if (_client) {
         std::random_device dev;
-        _rnd.seed(dev());
+        _rnd = std::make_unique<std::default_random_engine>(dev());
     }
 }
 
@@ -167,6 +167,11 @@ bool Builder::build(const Message &msg, std::vector<char> &output) {
 bool Builder::build(const Message &msg, std::string &output) {
     return build_t(msg, [&](char c){output.push_back(c);});
 }
+bool Builder::build_header(const Message &msg, std::vector<char> &output) {
+    if (_client || msg.type == Type::connClose) return false;
+    char masking_key[4];
+    return build_header_t(msg, msg.payload.size(), masking_key, [&](char c){output.push_back(c);});
+}
 
 
 template<std::invocable<char> Fn>
@@ -183,6 +188,21 @@ bool Builder::build_t(const Message &message, Fn &&output) {
         payload = {tmp.c_str(), tmp.length()+1};
     }
 
+    char masking_key[4];
+    if (!build_header_t(message, payload.size(), masking_key, output)) return false;
+
+    int idx =0;
+    for (char c: payload) {
+        c ^= masking_key[idx];
+        idx = (idx + 1) & 0x3;
+        output(c);
+    }
+    return true;
+
+}
+
+template<std::invocable<char> Fn>
+bool Builder::build_header_t(const Message &message, std::uint64_t len, char *masking_key, Fn &&output) {
     // opcode and FIN bit
     char opcode = opcodeContFrame;
     bool fin = message.fin;
@@ -200,8 +220,6 @@ bool Builder::build_t(const Message &message, Fn &&output) {
     _fragmented = !fin;
     output((fin << 7) | opcode);
     // payload length
-    std::uint64_t len = payload.size();
-
     char mm = _client?0x80:0;
     if (len < 126) {
         output(mm| static_cast<char>(len));
@@ -220,13 +238,11 @@ bool Builder::build_t(const Message &message, Fn &&output) {
         output(static_cast<char>((len >> 8) & 0xFF));
         output(static_cast<char>(len & 0xFF));
     }
-    char masking_key[4];
-
     if (_client) {
         std::uniform_int_distribution<> dist(0, 255);
 
         for (int i = 0; i < 4; ++i) {
-            masking_key[i] = static_cast<char>(dist(_rnd));
+            masking_key[i] = static_cast<char>(dist(*_rnd));
             output(masking_key[i]);
         }
     } else {
@@ -234,15 +250,7 @@ bool Builder::build_t(const Message &message, Fn &&output) {
             masking_key[i] = 0;
         }
     }
-
-    int idx =0;
-    for (char c: payload) {
-        c ^= masking_key[idx];
-        idx = (idx + 1) & 0x3;
-        output(c);
-    }
     return true;
-
 }
 
 
@@ -1,6 +1,7 @@
 #pragma once
 
 
+#include <memory>
 #include <random>
 
 #include <string_view>
@@ -212,14 +213,29 @@ public:
     bool build(const Message &msg, std::vector<char> &output);
     bool build(const Message &msg, std::string &output);
 
+    ///build frame header only
+    /**
+     * Payload of the message must be sent right after the header without change.
+     * This is possible only for server frames (no masking) and for
+     * frames other than connClose.
+     *
+     * @param msg message
+     * @param output buffer where header is appended
+     * @retval true header built
+     * @retval false header can't be built separately, use build()
+     */
+    bool build_header(const Message &msg, std::vector<char> &output);
+
 protected:
     template<std::invocable<char> Fn>
     bool build_t(const Message &message, Fn &&output);
+    template<std::invocable<char> Fn>
+    bool build_header_t(const Message &message, std::uint64_t len, char *masking_key, Fn &&output);
 
 protected:
     bool _client = false;
     bool _fragmented = false;
-    std::default_random_engine _rnd;
+    std::unique_ptr<std::default_random_engine> _rnd;  //masking keys (client only)
 };
 
 ///calculate WebSocket Accept header value from key